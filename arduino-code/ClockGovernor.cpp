@@ -0,0 +1,84 @@
+#include "ClockGovernor.h"
+#include "constants.h"
+#include <Arduino.h>
+
+const ClockGovernor::OperatingPointInfo ClockGovernor::operatingPoints[OPERATING_POINT_COUNT] = {
+    {8, 2, 1, 900},
+    {24, 2, 3, 2400},
+    {48, 1, 2, 5500},
+    {80, 1, 4, 9000},
+};
+
+ClockGovernor::ClockGovernor(ClockSwitch clockSwitch)
+    : clockSwitch(clockSwitch), current(IDLE_POINT), ceiling(PLL_80MHZ), burstCycles(INITIAL_BURST_CYCLES), burstStart(0), inBurst(false), sweep(0), statistics()
+{
+}
+
+bool ClockGovernor::fitsReserve(OperatingPoint point)
+{
+  const OperatingPointInfo &info = operatingPoints[point];
+  if (info.runMicroamps <= HARVEST_MICROAMPS)
+    return true;
+
+  // uA * cycles / MHz = pC
+  uint64_t deficit = (uint64_t)(info.runMicroamps - HARVEST_MICROAMPS) * burstCycles / info.megahertz;
+  return deficit <= (uint64_t)RESERVE_NANOCOULOMBS * 1000;
+}
+
+ClockGovernor::OperatingPoint ClockGovernor::choose(bool harvesting)
+{
+#ifdef CLOCK_GOVERNOR_SWEEP
+  // Every point in turn, to measure the time to signature at each of them
+  return (OperatingPoint)(sweep++ % (ceiling + 1));
+#else
+  if (!harvesting)
+    return ceiling;
+
+  for (int8_t point = ceiling; point > IDLE_POINT; point--)
+  {
+    if (fitsReserve((OperatingPoint)point))
+      return (OperatingPoint)point;
+  }
+  return IDLE_POINT;
+#endif
+}
+
+bool ClockGovernor::switchTo(OperatingPoint point)
+{
+  if (point == current)
+    return true;
+  if (clockSwitch != nullptr && !clockSwitch(point))
+  {
+#ifdef DEBUG
+    Serial1.printf("Could not switch to %u MHz\n", operatingPoints[point].megahertz);
+#endif
+    return false;
+  }
+  current = point;
+  return true;
+}
+
+ClockGovernor::OperatingPoint ClockGovernor::beginBurst(bool harvesting)
+{
+  switchTo(choose(harvesting));
+  inBurst = true;
+  burstStart = micros();
+  return current;
+}
+
+void ClockGovernor::endBurst()
+{
+  if (!inBurst)
+    return;
+  inBurst = false;
+
+  uint32_t elapsed = micros() - burstStart;
+  Statistics &pointStatistics = statistics[current];
+  pointStatistics.bursts++;
+  pointStatistics.totalMicros += elapsed;
+  if (elapsed > pointStatistics.maxMicros)
+    pointStatistics.maxMicros = elapsed;
+  burstCycles = elapsed * operatingPoints[current].megahertz;
+
+  switchTo(IDLE_POINT);
+}
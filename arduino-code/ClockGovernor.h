@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+
+// Runs the STM32L432 at the idle operating point and raises SYSCLK only for crypto bursts (signing). How far it
+// raises it depends on the supply: on harvested energy the burst may draw no more than the EH output delivers
+// plus what the capacitor behind it can bridge, otherwise it runs at the fastest point.
+//
+// The clock switching itself is done by the ClockSwitch given to the constructor (HAL code in arduino-code.ino).
+// The I2C and USART kernel clocks run from HSI16, so the bus timings do not change with SYSCLK.
+class ClockGovernor
+{
+public:
+  enum OperatingPoint
+  {
+    MSI_8MHZ,  // idle, range 2
+    MSI_24MHZ, // range 2
+    MSI_48MHZ, // range 1
+    PLL_80MHZ, // range 1, PLL from MSI 8 MHz
+    OPERATING_POINT_COUNT
+  };
+
+  static const OperatingPoint IDLE_POINT = MSI_8MHZ;
+
+  struct OperatingPointInfo
+  {
+    uint8_t megahertz;
+    uint8_t voltageRange;  // PWR_REGULATOR_VOLTAGE_SCALE1 or 2
+    uint8_t flashLatency;  // wait states for megahertz in voltageRange
+    uint16_t runMicroamps; // typical run current from flash (datasheet, rounded up)
+  };
+
+  static const OperatingPointInfo operatingPoints[OPERATING_POINT_COUNT];
+
+  // The EH output is good for 2-3 mA. C1 (10 uF) can give about 0.8 V before the LDO drops out
+  static const uint16_t HARVEST_MICROAMPS = 2500;
+  static const uint16_t RESERVE_NANOCOULOMBS = 8000;
+  // Assumed before the first burst has been measured, about one uECC_sign on the Cortex-M4
+  static const uint32_t INITIAL_BURST_CYCLES = 4000000;
+
+  struct Statistics
+  {
+    uint32_t bursts;
+    uint32_t totalMicros;
+    uint32_t maxMicros;
+  };
+
+  // Switches from the idle point to point or from point back to the idle point. Returns false if the clock could
+  // not be switched, the governor then stays where it was
+  typedef bool (*ClockSwitch)(OperatingPoint point);
+
+  ClockGovernor(ClockSwitch clockSwitch = nullptr);
+
+  // The point a burst starts at now
+  OperatingPoint choose(bool harvesting);
+
+  // Raises the clock for a burst. harvesting: the tag runs on the ST25DV's EH output
+  OperatingPoint beginBurst(bool harvesting);
+  // Drops back to the idle point and accounts the burst to the point it ran at
+  void endBurst();
+
+  // Bursts never go above ceiling
+  inline void setCeiling(OperatingPoint point)
+  {
+    ceiling = point;
+  }
+
+  inline OperatingPoint getCurrent()
+  {
+    return current;
+  }
+
+  // Of the last burst, converted from micros at the point it ran at
+  inline uint32_t getBurstCycles()
+  {
+    return burstCycles;
+  }
+
+  inline const Statistics &getStatistics(OperatingPoint point)
+  {
+    return statistics[point];
+  }
+
+private:
+  bool fitsReserve(OperatingPoint point);
+  bool switchTo(OperatingPoint point);
+
+  ClockSwitch clockSwitch;
+  OperatingPoint current;
+  OperatingPoint ceiling;
+  uint32_t burstCycles;
+  uint32_t burstStart;
+  bool inBurst;
+  uint8_t sweep; // next point with CLOCK_GOVERNOR_SWEEP
+  Statistics statistics[OPERATING_POINT_COUNT];
+};
@@ -0,0 +1,125 @@
+#include "EntropyPool.h"
+#include <string.h>
+
+// Keeps the compiler from moving pool accesses across a head or tail access
+static inline void compilerBarrier()
+{
+  __asm__ volatile("" ::: "memory");
+}
+
+EntropyPool::EntropyPool(SampleWait waitForSample) : waitForSample(waitForSample), pool(), head(0), tail(0), failed(false), sampleCount(0), startupRemaining(STARTUP_SAMPLES),
+                                                     lastSample(0), repetitions(0), windowSample(0), windowMatches(0), windowPosition(0), repetitionFailures(0), proportionFailures(0), waits(0)
+{
+}
+
+bool EntropyPool::testByte(uint8_t sample)
+{
+  // Repetition count test: the same value too many times in a row
+  if (repetitions > 0 && sample == lastSample)
+  {
+    if (++repetitions >= REPETITION_CUTOFF)
+    {
+      repetitionFailures++;
+      return false;
+    }
+  }
+  else
+  {
+    lastSample = sample;
+    repetitions = 1;
+  }
+
+  // Adaptive proportion test: the first value of a window too often within it
+  if (windowPosition == 0)
+  {
+    windowSample = sample;
+    windowMatches = 1;
+  }
+  else if (sample == windowSample && ++windowMatches >= PROPORTION_CUTOFF)
+  {
+    proportionFailures++;
+    return false;
+  }
+  if (++windowPosition == PROPORTION_WINDOW)
+    windowPosition = 0;
+
+  return true;
+}
+
+bool EntropyPool::addSample(uint32_t sample)
+{
+  sampleCount++;
+  if (failed)
+    return false;
+
+  for (uint8_t i = 0; i < sizeof(sample); i++)
+  {
+    if (!testByte((uint8_t)(sample >> (i * 8))))
+    {
+      failed = true;
+      return false;
+    }
+  }
+
+  if (startupRemaining > 0)
+  {
+    startupRemaining -= (startupRemaining > sizeof(sample)) ? sizeof(sample) : startupRemaining;
+    return true;
+  }
+
+  if (isFull())
+    return false;
+
+  // CAPACITY is a multiple of the word size, so a word never wraps
+  uint16_t offset = head % CAPACITY;
+  memcpy(&pool[offset], &sample, sizeof(sample));
+  compilerBarrier(); // stored before read() can see them
+  head = head + sizeof(sample);
+  return !isFull();
+}
+
+bool EntropyPool::read(uint8_t *dest, unsigned size)
+{
+  while (size > 0)
+  {
+    if (failed)
+      return false;
+
+    uint16_t length = available();
+    if (length == 0)
+    {
+      waits++;
+      if (!waitForSample())
+        return false;
+      continue;
+    }
+    if (length > size)
+      length = size;
+    compilerBarrier(); // not read before head said they were there
+
+    uint16_t offset = tail % CAPACITY;
+    if (length > CAPACITY - offset)
+      length = CAPACITY - offset;
+    memcpy(dest, &pool[offset], length);
+    memset(&pool[offset], 0, length);
+    compilerBarrier(); // copied and wiped before addSample() can reuse them
+    tail = tail + length;
+
+    dest += length;
+    size -= length;
+  }
+
+  // A health test may have failed after the bytes were stored
+  return !failed;
+}
+
+void EntropyPool::reset()
+{
+  memset(pool, 0, sizeof(pool));
+  head = 0;
+  tail = 0;
+  startupRemaining = STARTUP_SAMPLES;
+  repetitions = 0;
+  windowPosition = 0;
+  failed = false;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+
+// Random bytes from the RNG peripheral, collected ahead of time so that uECC takes them with a memcpy instead of
+// waiting for the RNG while signing. The RNG interrupt hands every 32-bit word to addSample(), which runs the
+// continuous health tests of NIST SP 800-90B (4.4) on its bytes before storing them. read() only waits for the
+// RNG for the part of a request the pool cannot serve.
+//
+// One producer (the RNG interrupt, or waitForSample) and one consumer (read) share the pool without locking. This
+// relies on a single core: compiler barriers order the bytes against the head and tail updates, no DMB is needed.
+class EntropyPool
+{
+public:
+  // Bytes, a power of two
+  static const uint16_t CAPACITY = 256;
+
+  // The tests assume 4 bits of entropy per byte, well below what the RNG delivers, and a false alarm
+  // probability of 2^-20 (SP 800-90B 4.4.1 and 4.4.2)
+  static const uint8_t REPETITION_CUTOFF = 6; // 1 + ceil(20 / 4)
+  static const uint16_t PROPORTION_WINDOW = 512;
+  static const uint16_t PROPORTION_CUTOFF = 62;
+  // Tested and discarded after begin() and reset() before any byte is handed out (SP 800-90B 4.3)
+  static const uint16_t STARTUP_SAMPLES = 1024;
+
+  // Called by read() when the pool is empty. Has to deliver at least one word through addSample() before
+  // returning, and return false if the RNG could not
+  typedef bool (*SampleWait)();
+
+  EntropyPool(SampleWait waitForSample);
+
+  // Tests the bytes of sample and stores them. Returns true if there is room for another word, false when the
+  // pool is full or a health test failed: the RNG can stop until read() makes room again or until reset()
+  bool addSample(uint32_t sample);
+
+  // Copies size bytes to dest and wipes them from the pool. Returns false if the RNG failed or a health test
+  // failed, in which case nothing more is handed out until reset()
+  bool read(uint8_t *dest, unsigned size);
+
+  // Drops the pool and starts over with the startup tests, after the RNG has been reinitialized. Not to be called
+  // while the RNG interrupt can run
+  void reset();
+
+  inline uint16_t available()
+  {
+    return (uint16_t)(head - tail);
+  }
+
+  inline bool isFull()
+  {
+    return available() > CAPACITY - sizeof(uint32_t);
+  }
+
+  inline bool hasFailed()
+  {
+    return failed;
+  }
+
+  // Words passed to addSample(), including those of the startup tests
+  inline uint32_t getSampleCount()
+  {
+    return sampleCount;
+  }
+
+  inline uint16_t getRepetitionFailures()
+  {
+    return repetitionFailures;
+  }
+
+  inline uint16_t getProportionFailures()
+  {
+    return proportionFailures;
+  }
+
+  // read() calls that had to wait for the RNG
+  inline uint32_t getWaits()
+  {
+    return waits;
+  }
+
+private:
+  bool testByte(uint8_t sample);
+
+  SampleWait waitForSample;
+  uint8_t pool[CAPACITY];
+  volatile uint16_t head; // free running, written by the producer
+  volatile uint16_t tail; // free running, written by the consumer
+  volatile bool failed;
+  volatile uint32_t sampleCount;
+  uint16_t startupRemaining;
+
+  // Repetition count test
+  uint8_t lastSample;
+  uint8_t repetitions;
+  // Adaptive proportion test
+  uint8_t windowSample;
+  uint16_t windowMatches;
+  uint16_t windowPosition;
+
+  uint16_t repetitionFailures;
+  uint16_t proportionFailures;
+  uint32_t waits;
+};
@@ -0,0 +1,23 @@
+#include "IdleScheduler.h"
+
+IdleScheduler::IdleScheduler(EnterIdle enterIdle) : enterIdle(enterIdle), entries()
+{
+}
+
+IdleScheduler::Mode IdleScheduler::choose(bool messagePending, bool backgroundWork)
+{
+  if (messagePending)
+    return RUN;
+  if (backgroundWork)
+    return SLEEP;
+  return STOP2;
+}
+
+IdleScheduler::Mode IdleScheduler::idle(bool messagePending, bool backgroundWork)
+{
+  Mode mode = choose(messagePending, backgroundWork);
+  entries[mode]++;
+  if (mode != RUN && enterIdle != nullptr)
+    enterIdle(mode);
+  return mode;
+}
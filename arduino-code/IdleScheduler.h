@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+// Decides how the MCU waits when loop() has nothing left to do. STOP2 keeps RAM and the peripheral registers and
+// draws about a micro amp, but stops every clock but LSE/LSI: it is only entered when nothing but the GPO can
+// bring new work. While there is background work, such as a message waiting out its settle time, the RNG filling
+// the entropy pool, jobs that can run or wait for the field to settle, or a reply on its way to the mailbox through
+// DMA, the core only sleeps and interrupts keep it going. The GPO EXTI line wakes the MCU from either mode.
+//
+// Entering the mode is done by the EnterIdle function given to the constructor (HAL code in arduino-code.ino). It
+// is called with interrupts disabled and returns with the clocks restored, before the interrupt that woke the MCU
+// runs.
+class IdleScheduler
+{
+public:
+  enum Mode
+  {
+    RUN,   // work is pending, do not wait at all
+    SLEEP, // core clock stopped, peripherals running
+    STOP2,
+    MODE_COUNT
+  };
+
+  typedef void (*EnterIdle)(Mode mode);
+
+  IdleScheduler(EnterIdle enterIdle = nullptr);
+
+  // messagePending: the GPO fired and loop() has not seen it yet. backgroundWork: a message waits out its settle
+  // time, the RNG is filling the entropy pool, jobs can make progress or a transfer is pending
+  Mode choose(bool messagePending, bool backgroundWork);
+
+  // Waits in the mode chosen. To be called with interrupts disabled, so that no wakeup is lost between sampling
+  // the arguments and entering the mode
+  Mode idle(bool messagePending, bool backgroundWork);
+
+  // Times the mode was chosen
+  inline uint32_t getEntries(Mode mode)
+  {
+    return entries[mode];
+  }
+
+private:
+  EnterIdle enterIdle;
+  uint32_t entries[MODE_COUNT];
+};
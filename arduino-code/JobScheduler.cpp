@@ -0,0 +1,103 @@
+#include "JobScheduler.h"
+#include "constants.h"
+#include <Arduino.h>
+
+JobScheduler::JobScheduler(ReadSupply readSupply)
+    : readSupply(readSupply), jobs(), supplyStable(false), settling(false), sampled(false), sampledAt(0), fieldSeen(false), fieldSince(0)
+{
+}
+
+void JobScheduler::setJob(JobId id, Step step, void *context)
+{
+  jobs[id].step = step;
+  jobs[id].context = context;
+}
+
+void JobScheduler::request(JobId id)
+{
+  jobs[id].pending = true;
+}
+
+void JobScheduler::sampleSupply()
+{
+  uint32_t now = micros();
+  if (sampled && now - sampledAt < SAMPLE_INTERVAL_MICROS)
+    return;
+  sampled = true;
+  sampledAt = now;
+
+  bool fieldOn, harvesting;
+  if (!readSupply(&fieldOn, &harvesting))
+  {
+    supplyStable = false;
+    settling = false;
+    return;
+  }
+  if (!fieldOn)
+    fieldSeen = false;
+  else if (!fieldSeen)
+  {
+    fieldSeen = true;
+    fieldSince = now;
+  }
+
+  if (!harvesting)
+    supplyStable = true;
+  else
+    supplyStable = fieldSeen && now - fieldSince >= FIELD_SETTLE_MICROS;
+  settling = harvesting && fieldSeen && !supplyStable;
+}
+
+void JobScheduler::run()
+{
+  if (!hasPendingJobs())
+    return;
+  sampleSupply();
+
+  for (uint8_t id = 0; id < JOB_COUNT; id++)
+  {
+    Job &job = jobs[id];
+    if (!job.pending || job.step == nullptr)
+      continue;
+
+    if (!supplyStable)
+    {
+      if (job.running)
+      {
+        job.running = false;
+        job.statistics.aborted++;
+      }
+      if (!job.deferred)
+      {
+        job.deferred = true;
+        job.statistics.deferred++;
+      }
+      continue;
+    }
+
+    if (!job.running)
+    {
+      job.running = true;
+      job.statistics.runs++;
+    }
+    job.deferred = false;
+    job.statistics.steps++;
+    StepResult result = job.step(job.context);
+    if (result == STEP_MORE)
+      continue;
+
+    job.running = false;
+    if (result == STEP_DONE)
+    {
+      job.pending = false;
+      job.statistics.completed++;
+    }
+    else
+    {
+      job.statistics.aborted++;
+#ifdef DEBUG
+      Serial1.printf("Job %u failed\n", id);
+#endif
+    }
+  }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+
+// Runs work that can wait, such as refilling the entropy pool, rewriting the NDEF records or erasing the µC eeprom
+// page, only while the supply is stable, so a job is not cut off halfway by a brown out. The supply is stable when
+// the ST25DV's EH output is off (the tag runs from another supply) or when it is on and the RF field has been
+// present for FIELD_SETTLE_MICROS.
+//
+// A job is done in steps, one per run(). The supply is sampled before each step: a job that has to stop between
+// steps is counted as aborted and continues from where it was once the supply is stable again. A step has to be
+// short and must leave things consistent when it returns.
+class JobScheduler
+{
+public:
+  enum JobId
+  {
+    ENTROPY_REFILL,
+    NDEF_UPDATE,
+    CONTRACT_ADDRESS_SAVE,
+    JOB_COUNT
+  };
+
+  enum StepResult
+  {
+    STEP_DONE,
+    STEP_MORE,   // call again on the next run()
+    STEP_FAILED, // counted as aborted, the job is tried again on the next run()
+  };
+
+  // The phone is still settling in the field, the first few ms it is often moved off again
+  static const uint32_t FIELD_SETTLE_MICROS = 20000;
+  // The supply is read at most once per interval, loop() runs after every RNG word while the pool fills
+  static const uint32_t SAMPLE_INTERVAL_MICROS = 1000;
+
+  struct Statistics
+  {
+    uint32_t runs;     // started, or resumed after an abort
+    uint32_t completed;
+    uint32_t aborted;  // stopped because the supply became unstable or a step failed
+    uint32_t deferred; // had to wait for a stable supply before the next step
+    uint32_t steps;
+  };
+
+  typedef StepResult (*Step)(void *context);
+
+  // Reads the RF field and EH output state. Returns false if it could not, the supply is then taken as unstable
+  typedef bool (*ReadSupply)(bool *fieldOn, bool *harvesting);
+
+  JobScheduler(ReadSupply readSupply);
+
+  void setJob(JobId id, Step step, void *context);
+
+  // Marks the job to be run, nothing happens if it already is
+  void request(JobId id);
+
+  // Does one step of every pending job if the supply is stable, call from the main loop
+  void run();
+
+  inline bool isPending(JobId id)
+  {
+    return jobs[id].pending;
+  }
+
+  inline bool hasPendingJobs()
+  {
+    for (uint8_t id = 0; id < JOB_COUNT; id++)
+    {
+      if (jobs[id].pending)
+        return true;
+    }
+    return false;
+  }
+
+  // Jobs are pending and the next run() can make progress: the supply is stable or the field is settling. Jobs
+  // waiting for anything else, e.g. an unreadable status, are left until something else wakes the MCU
+  inline bool hasWork()
+  {
+    return hasPendingJobs() && (supplyStable || settling);
+  }
+
+  // As of the last sample taken by run(), not sampled again here. Safe to read from interrupts
+  inline bool isSupplyStable()
+  {
+    return supplyStable;
+  }
+
+  inline const Statistics &getStatistics(JobId id)
+  {
+    return jobs[id].statistics;
+  }
+
+private:
+  struct Job
+  {
+    Step step;
+    void *context;
+    bool pending;
+    bool running;  // started and not done
+    bool deferred; // counted in statistics.deferred since the last step
+    Statistics statistics;
+  };
+
+  void sampleSupply();
+
+  ReadSupply readSupply;
+  Job jobs[JOB_COUNT];
+  volatile bool supplyStable;
+  bool settling; // harvesting, the field is on but has not been for FIELD_SETTLE_MICROS yet
+  bool sampled;
+  uint32_t sampledAt;
+  bool fieldSeen;
+  uint32_t fieldSince;
+};
@@ -0,0 +1,91 @@
+#include "KeccakDRBG.h"
+#include <string.h>
+
+// Keccak-512 absorbs 72 bytes per permutation
+static const uint8_t KECCAK512_RATE = 72;
+
+// Not optimized away like a memset of memory that is not read again
+static void wipeMemory(void *memory, size_t length)
+{
+  volatile uint8_t *bytes = (volatile uint8_t *)memory;
+  while (length--)
+    *bytes++ = 0;
+}
+
+KeccakDRBG::KeccakDRBG(EntropySource source) : source(source), keccak(Keccak::Keccak512), key(), counter(0), bytesSinceReseed(0), seeded(false), reseedCount(0), permutations(0)
+{
+}
+
+void KeccakDRBG::nextBlock(uint8_t block[2 * BLOCK_LENGTH])
+{
+  static const uint8_t generateLabel = 'G';
+  keccak.reset();
+  keccak.add(key, KEY_LENGTH);
+  keccak.add(&counter, sizeof(counter));
+  keccak.add(&generateLabel, 1);
+  keccak.getHash(block);
+  keccak.reset();
+  permutations += (KEY_LENGTH + sizeof(counter) + 1) / KECCAK512_RATE + 1;
+
+  counter++;
+  memcpy(key, block, KEY_LENGTH);
+}
+
+bool KeccakDRBG::generate(uint8_t *dest, unsigned size)
+{
+  if (!seeded || bytesSinceReseed >= RESEED_INTERVAL)
+  {
+    if (!reseed())
+      return false;
+  }
+
+  uint8_t block[2 * BLOCK_LENGTH];
+  while (size > 0)
+  {
+    nextBlock(block);
+    uint8_t length = size > BLOCK_LENGTH ? BLOCK_LENGTH : size;
+    memcpy(dest, &block[KEY_LENGTH], length);
+    dest += length;
+    size -= length;
+    bytesSinceReseed += length;
+  }
+  wipeMemory(block, sizeof(block));
+  return true;
+}
+
+bool KeccakDRBG::reseed()
+{
+  static const uint8_t reseedLabel = 'R';
+  uint8_t seed[SEED_LENGTH];
+  if (!source(seed, SEED_LENGTH))
+  {
+    wipeMemory(seed, sizeof(seed));
+    return false;
+  }
+
+  uint8_t digest[2 * KEY_LENGTH];
+  keccak.reset();
+  keccak.add(key, KEY_LENGTH);
+  keccak.add(&counter, sizeof(counter));
+  keccak.add(seed, SEED_LENGTH);
+  keccak.add(&reseedLabel, 1);
+  keccak.getHash(digest);
+  keccak.reset();
+  permutations += (KEY_LENGTH + sizeof(counter) + SEED_LENGTH + 1) / KECCAK512_RATE + 1;
+
+  memcpy(key, digest, KEY_LENGTH);
+  wipeMemory(digest, sizeof(digest));
+  wipeMemory(seed, sizeof(seed));
+  bytesSinceReseed = 0;
+  seeded = true;
+  reseedCount++;
+  return true;
+}
+
+void KeccakDRBG::wipe()
+{
+  wipeMemory(key, sizeof(key));
+  keccak.reset();
+  counter = 0;
+  seeded = false;
+}
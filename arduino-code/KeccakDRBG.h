@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "keccak.h"
+
+// Deterministic random bit generator for uECC, seeded from the hardware RNG. Every block of output is
+// Keccak-512(key || counter || 'G'): its first half replaces the key and its second half is handed out, so the
+// state left in RAM does not give away earlier output. Reseeding hashes fresh entropy into the key.
+class KeccakDRBG
+{
+public:
+  static const uint8_t KEY_LENGTH = 32;
+  static const uint8_t BLOCK_LENGTH = 32; // output per Keccak-f[1600] permutation
+  // The entropy pool assumes 4 bits per byte, so this is 256 bits
+  static const uint8_t SEED_LENGTH = 64;
+  // Output between reseeds, about 64 signatures
+  static const uint32_t RESEED_INTERVAL = 4096;
+
+  // Fills dest with size bytes of entropy. Returns false if it could not
+  typedef bool (*EntropySource)(uint8_t *dest, unsigned size);
+
+  KeccakDRBG(EntropySource source);
+
+  // Reseeds first if the DRBG has not been seeded, was wiped or has reached RESEED_INTERVAL. Returns false if
+  // reseeding failed
+  bool generate(uint8_t *dest, unsigned size);
+
+  // Mixes SEED_LENGTH bytes from the entropy source into the key
+  bool reseed();
+
+  // Forgets the state. The next generate() starts from fresh entropy only, so nothing handed out afterwards
+  // relates to what was handed out before, e.g. once the wallet has a new key
+  void wipe();
+
+  inline bool isSeeded()
+  {
+    return seeded;
+  }
+
+  inline uint32_t getReseedCount()
+  {
+    return reseedCount;
+  }
+
+  // Keccak-f[1600] permutations so far
+  inline uint32_t getPermutations()
+  {
+    return permutations;
+  }
+
+private:
+  void nextBlock(uint8_t block[2 * BLOCK_LENGTH]);
+
+  EntropySource source;
+  Keccak keccak;
+  uint8_t key[KEY_LENGTH];
+  uint64_t counter;
+  uint32_t bytesSinceReseed;
+  bool seeded;
+  uint32_t reseedCount;
+  uint32_t permutations;
+};
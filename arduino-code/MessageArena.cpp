@@ -0,0 +1,25 @@
+#include "MessageArena.h"
+
+MessageArena::MessageArena() : buffer(), top(MAILBOX_LENGTH), highWaterMark(MAILBOX_LENGTH), phase(IDLE)
+{
+}
+
+void MessageArena::beginPhase(Phase newPhase)
+{
+  if (newPhase == RECEIVE || newPhase == REPLY)
+    top = MAILBOX_LENGTH;
+  phase = newPhase;
+}
+
+uint8_t *MessageArena::allocate(uint16_t size)
+{
+  uint16_t alignedSize = (size + 3) & ~3;
+  if (alignedSize > ARENA_LENGTH - top)
+    return nullptr;
+
+  uint8_t *memory = &buffer[top];
+  top += alignedSize;
+  if (top > highWaterMark)
+    highWaterMark = top;
+  return memory;
+}
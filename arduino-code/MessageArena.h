@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include "constants.h"
+
+// Single statically sized buffer shared by the mailbox frame and the scratch memory of the message handlers.
+// The first MAILBOX_LENGTH bytes hold the received frame, the reply is constructed in place on top of it.
+// Scratch memory is handed out above the frame and is released as soon as the reply phase begins.
+class MessageArena
+{
+public:
+  enum Phase
+  {
+    IDLE,
+    RECEIVE,
+    COMPUTE,
+    REPLY,
+  };
+
+  MessageArena();
+
+  // Switches to the given phase. RECEIVE and REPLY release all scratch allocations.
+  void beginPhase(Phase newPhase);
+
+  // Returns 4-byte aligned scratch memory or nullptr if the arena is exhausted.
+  uint8_t *allocate(uint16_t size);
+
+  inline uint8_t *frame()
+  {
+    return buffer;
+  }
+
+  inline Phase getPhase()
+  {
+    return phase;
+  }
+
+  inline uint16_t getHighWaterMark()
+  {
+    return highWaterMark;
+  }
+
+private:
+  uint8_t buffer[ARENA_LENGTH] __attribute__((aligned(4)));
+  uint16_t top;
+  uint16_t highWaterMark;
+  Phase phase;
+};
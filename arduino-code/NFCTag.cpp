@@ -6,8 +6,22 @@
 uint8_t NFCTag::correctPassword[PASSWORD_LENGTH] = {0x0};
 uint8_t NFCTag::wrongPassword[PASSWORD_LENGTH] = {0x1};
 
-NFCTag::NFCTag(Wallet &wallet)
-    : initialized(false), wallet(wallet), message(), messageLength(0)
+// Indexed by message id. Lengths include the message id byte and are validated before the handler is called.
+constexpr NFCTag::MessageHandlerEntry NFCTag::messageHandlers[MESSAGE_HANDLER_COUNT] = {
+    {SIGN, &NFCTag::processSignMessage, 1 + KECCAK_HASH_LENGTH, 1 + KECCAK_HASH_LENGTH},
+    {CONTRACT_ADDRESS, &NFCTag::processContractAddress, 1 + LUKSO_ADDRESS_AS_STRING_LENGTH, 1 + LUKSO_ADDRESS_AS_STRING_LENGTH},
+    {HELLO, &NFCTag::processHello, 1, 1},
+    {GET_IDENTITY, &NFCTag::processGetIdentity, 1, 1},
+    {DIAGNOSTICS, &NFCTag::processDiagnostics, 1, 2},
+};
+
+constexpr bool NFCTag::messageHandlersIndexedById(uint8_t index)
+{
+  return index == MESSAGE_HANDLER_COUNT || (messageHandlers[index].id == index && messageHandlersIndexedById(index + 1));
+}
+
+NFCTag::NFCTag(Wallet &wallet, SFE_ST25DV64KC_Bus *bus, ClockGovernor *governor, JobScheduler *jobs)
+    : initialized(false), wallet(wallet), bus(bus), governor(governor), jobs(jobs), deviceUID(), contractAddress(), contractAddressSet(false), ndefContractAddress(), arena(), message(arena.frame()), messageLength(0), messageStatistics(), replyWriteFailures(0)
 {
 }
 
@@ -26,14 +40,6 @@ bool NFCTag::initConfiguration()
     return false;
   }
 
-  if (!st25.setLockCCFile(false))
-  {
-#ifdef DEBUG
-    Serial1.println("Failed to lock cc file");
-#endif
-    return false;
-  }
-
 #if CC_FILE_SIZE == 4
   if (!st25.writeCCFile4Byte())
 #else
@@ -46,65 +52,52 @@ bool NFCTag::initConfiguration()
     return false;
   }
 
-  if (!st25.setLockCCFile(true))
-  {
-#ifdef DEBUG
-    Serial1.println("Failed to lock cc file");
+  // The register updates are committed together: one read of the configuration, merged writes, LOCK_CFG last
+  SFE_ST25DV64KC_RegisterTransaction transaction;
+
+  // lock the cc file (LOCK_CCFILE only blocks RF writes, the file above is written over I2C)
+#if CC_FILE_SIZE == 4
+  transaction.updateBits(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_LOCK_CCFILE, BIT_LOCK_CCFILE_LCKBCK0, true);
+#else
+  transaction.updateBits(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_LOCK_CCFILE, BIT_LOCK_CCFILE_LCKBCK0 | BIT_LOCK_CCFILE_LCKBCK1, true);
 #endif
-    return false;
-  }
 
   // enable energy harvesting
-  if (!st25.setEH_MODEBit(false))
-  {
-#ifdef DEBUG
-    Serial1.println("Failed to enable energy harvesting");
-#endif
-    return false;
-  }
+  transaction.updateBits(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_EH_MODE, BIT_EH_MODE_EH_MODE, false);
 
   // enable Mailbox (Fast transfer mode)
-  if (!st25.enableMailbox())
-  {
-#ifdef DEBUG
-    Serial1.println("Failed to enable mailbox");
-#endif
-    return false;
-  }
+  transaction.updateBits(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_FTM, BIT_FTM_MB_MODE, true);
 
   // Disable writing through RF
-  if (!st25.setAreaRfRwProtection(1, SF_ST25DV_RF_RW_PROTECTION::RF_RW_READ_SECURITY_WRITE_NEVER))
-  {
-#ifdef DEBUG
-    Serial1.println("Failed to disable writing through RF");
-#endif
-    return false;
-  }
+  transaction.updateBits(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA1SS, 0x0C, false);
+  transaction.updateBits(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA1SS, ((uint8_t)SF_ST25DV_RF_RW_PROTECTION::RF_RW_READ_SECURITY_WRITE_NEVER) << 2, true);
 
   // Disable all interrupts except for 'rf puts a message into the mailbox' (interrupt service service)
-  if (!st25.setGPO1Bit(BIT_GPO1_FIELD_CHANGE_EN | BIT_GPO1_RF_USER_EN | BIT_GPO1_RF_ACTIVITY_EN | BIT_GPO1_RF_INTERRUPT_EN | BIT_GPO1_RF_GET_MSG_EN | BIT_GPO1_RF_WRITE_EN, false))
-  {
-#ifdef DEBUG
-    Serial1.println("Failed to disable GPO1 bits: BIT_GPO1_FIELD_CHANGE_EN | BIT_GPO1_RF_USER_EN | BIT_GPO1_RF_ACTIVITY_EN | BIT_GPO1_RF_INTERRUPT_EN | BIT_GPO1_RF_GET_MSG_EN | BIT_GPO1_RF_WRITE_EN");
-#endif
-    return false;
-  }
+  transaction.updateBits(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_GPO1, BIT_GPO1_FIELD_CHANGE_EN | BIT_GPO1_RF_USER_EN | BIT_GPO1_RF_ACTIVITY_EN | BIT_GPO1_RF_INTERRUPT_EN | BIT_GPO1_RF_GET_MSG_EN | BIT_GPO1_RF_WRITE_EN, false);
+  transaction.updateBits(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_GPO1, BIT_GPO1_RF_PUT_MSG_EN | BIT_GPO1_GPO_EN, true);
 
-  if (!st25.setGPO1Bit(BIT_GPO1_RF_PUT_MSG_EN | BIT_GPO1_GPO_EN, true))
+  transaction.updateBits(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_LOCK_CFG, BIT_LOCK_CFG_LCK_CFG, true);
+
+  SFE_ST25DV64KC_RegisterTransaction::Report report;
+  if (!st25.commitRegisterTransaction(transaction, &report))
   {
 #ifdef DEBUG
-    Serial1.println("Failed to enable GPO1 bits: BIT_GPO1_RF_PUT_MSG_EN | BIT_GPO1_GPO_EN");
+    Serial1.println("Failed to write configuration");
 #endif
     return false;
   }
 
-  if (!st25.lockConfiguration())
-  {
 #ifdef DEBUG
-    Serial1.println("Failed to lock configuration");
+  Serial1.print("Configuration: ");
+  Serial1.print(report.updates);
+  Serial1.print(" registers, ");
+  Serial1.print(report.reads);
+  Serial1.print(" reads, ");
+  Serial1.print(report.writes);
+  Serial1.print(" writes, ");
+  Serial1.print(report.busMicros);
+  Serial1.println(" us");
 #endif
-    return false;
-  }
 
   // close security session with incorrect password
   st25.openI2CSession(wrongPassword);
@@ -136,6 +129,16 @@ bool NFCTag::init()
     }
   }
 
+  if (!st25.getDeviceUID(deviceUID))
+  {
+#ifdef DEBUG
+    Serial1.println("Failed to read device uid");
+#endif
+    return false;
+  }
+
+  loadContractAddress();
+
   if (!st25.setMailboxActive(true))
   {
 #ifdef DEBUG
@@ -144,6 +147,12 @@ bool NFCTag::init()
     return false;
   }
 
+  if (jobs != nullptr)
+  {
+    jobs->setJob(JobScheduler::NDEF_UPDATE, &NFCTag::runNDEFUpdate, this);
+    jobs->setJob(JobScheduler::CONTRACT_ADDRESS_SAVE, &NFCTag::runContractAddressSave, this);
+  }
+
   initialized = true;
   return true;
 }
@@ -154,7 +163,13 @@ bool NFCTag::begin()
   Wire.setSDA(PB7);
   Wire.begin();
 
-  if (!st25.begin(Wire))
+#ifdef SFE_ST25DV64KC_DMA_BUS_AVAILABLE
+  static SFE_ST25DV64KC_DMABus dmaBus(Wire);
+  if (bus == nullptr && dmaBus.begin())
+    bus = &dmaBus;
+#endif
+
+  if (!(bus != nullptr ? st25.begin(*bus) : st25.begin(Wire)))
   {
 #ifdef DEBUG
     Serial1.println("NFC tag ST25 not detected. Freezing...");
@@ -175,18 +190,33 @@ bool NFCTag::writeMessage(uint8_t *message, uint16_t messageLength)
     return false;
   if (messageLength > MAILBOX_LENGTH)
     return false;
+  arena.beginPhase(MessageArena::REPLY);
+
+  // The bus reads the reply straight from the frame, every later transfer waits for it to finish
+  if (st25.writeToMailboxAsync(message, messageLength, &NFCTag::onReplyWritten, this))
+    return true;
   return st25.writeToMailbox(message, messageLength);
 }
 
+void NFCTag::onReplyWritten(bool success, void *context)
+{
+  if (!success)
+    static_cast<NFCTag *>(context)->replyWriteFailures++;
+}
+
+void NFCTag::completeTransfers()
+{
+  if (st25.isTransferPending() && !st25.isTransferInFlight())
+    st25.waitForTransfer();
+}
+
 bool NFCTag::fetchMessage()
 {
   if (!initialized)
     return false;
-  uint16_t newMessageLength = st25.getMailboxMessageLength();
-  if (newMessageLength == 0)
-    return false;
-
-  if (!st25.readFromMailbox(message, newMessageLength))
+  arena.beginPhase(MessageArena::RECEIVE);
+  uint16_t newMessageLength;
+  if (!st25.readMailboxMessage(message, MAILBOX_LENGTH, &newMessageLength) || newMessageLength == 0)
     return false;
 
   messageLength = newMessageLength;
@@ -196,103 +226,481 @@ bool NFCTag::fetchMessage()
 
 bool NFCTag::handleMessage()
 {
+  static_assert(messageHandlersIndexedById(), "messageHandlers must be indexed by message id");
+
   if (!initialized)
     return false;
   if (!fetchMessage() || messageLength == 0)
     return false;
 
-  if (messageLength == 1)
+  uint8_t messageId = message[0];
+  if (messageId >= MESSAGE_HANDLER_COUNT || messageHandlers[messageId].handler == nullptr)
   {
-    messageReply[0] = INVALID_MESSAGE_LENGTH;
-    writeMessage(messageReply, 1);
+    writeError(UNKOWN_MESSAGE);
     return true;
   }
 
-  switch (message[0])
+  const MessageHandlerEntry &entry = messageHandlers[messageId];
+  MessageStatistics &statistics = messageStatistics[messageId];
+  uint32_t start = micros();
+
+  bool success;
+  if (messageLength < entry.minLength || messageLength > entry.maxLength)
   {
-  case SIGN:
-    processSignMessage();
-    break;
-  case CONTRACT_ADDRESS:
-    processContractAddress();
-    break;
-  default:
-    messageReply[0] = UNKOWN_MESSAGE;
-    writeMessage(messageReply, 1);
+    writeError(INVALID_MESSAGE_LENGTH);
+    success = false;
   }
+  else
+  {
+    arena.beginPhase(MessageArena::COMPUTE);
+    success = (this->*entry.handler)();
+  }
+
+  arena.beginPhase(MessageArena::IDLE);
+
+  uint32_t elapsed = micros() - start;
+  statistics.calls++;
+  if (!success)
+    statistics.failures++;
+  statistics.totalMicros += elapsed;
+  if (elapsed > statistics.maxMicros)
+    statistics.maxMicros = elapsed;
 
   return true;
 }
 
+const NFCTag::MessageStatistics &NFCTag::getMessageStatistics(uint8_t messageId)
+{
+  static const MessageStatistics none = {};
+  if (messageId >= MESSAGE_HANDLER_COUNT)
+    return none;
+  return messageStatistics[messageId];
+}
+
+void NFCTag::writeError(MessageId error)
+{
+  message[0] = error;
+  writeMessage(message, 1);
+}
+
 bool NFCTag::processSignMessage()
 {
-  if (messageLength - 1 != KECCAK_HASH_LENGTH)
+  // The signature is written over the hash, which uECC still reads after storing r
+  uint8_t *messageHash = arena.allocate(KECCAK_HASH_LENGTH);
+  if (messageHash == nullptr)
   {
-    messageReply[0] = INVALID_MESSAGE_LENGTH;
-    writeMessage(messageReply, 1);
+    writeError(UNKOWN_ERROR);
     return false;
   }
+  memcpy(messageHash, &message[1], KECCAK_HASH_LENGTH);
+
+  if (governor != nullptr)
+    governor->beginBurst(isHarvesting());
+  bool signedMessage = wallet.signHashedMessage(messageHash, &message[1]);
+  if (governor != nullptr)
+    governor->endBurst();
 
-  if (!wallet.signHashedMessage(&message[1], &messageReply[1]))
+  if (!signedMessage)
   {
-    messageReply[0] = UNKOWN_ERROR;
-    writeMessage(messageReply, 1);
+    writeError(UNKOWN_ERROR);
     return false;
   }
 
-  messageReply[0] = SIGN;
-  messageReplyLength = SIGNATURE_LENGTH + 1;
-  writeMessage(messageReply, messageReplyLength);
+  message[0] = SIGN;
+  writeMessage(message, SIGNATURE_LENGTH + 1);
 
   return true;
 }
 
+bool NFCTag::isHarvesting()
+{
+  bool fieldOn, harvesting;
+  if (!readSupply(&fieldOn, &harvesting))
+    return true;
+  return harvesting;
+}
+
+bool NFCTag::readSupply(bool *fieldOn, bool *harvesting)
+{
+  uint8_t ehCtrlDyn;
+  if (!st25.st25_io.readSingleByte(SF_ST25DV64KC_ADDRESS::DATA, DYN_REG_EH_CTRL_DYN, &ehCtrlDyn))
+    return false;
+  *fieldOn = (ehCtrlDyn & BIT_EH_CTRL_DYN_FIELD_ON) != 0;
+  *harvesting = (ehCtrlDyn & BIT_EH_CTRL_DYN_EH_ON) != 0;
+  return true;
+}
+
 bool NFCTag::processContractAddress()
 {
-  if (messageLength - 1 != LUKSO_ADDRESS_AS_STRING_LENGTH)
+  // Validated in place, the frame has room for the terminating zero
+  char *newContractAddress = (char *)&message[1];
+  newContractAddress[LUKSO_ADDRESS_AS_STRING_LENGTH] = 0;
+
+  if (newContractAddress[0] != '0' || (newContractAddress[1] != 'X' && newContractAddress[1] != 'x'))
   {
-    messageReply[0] = INVALID_MESSAGE_LENGTH;
-    writeMessage(messageReply, 1);
+    writeError(INVALID_MESSAGE_FORMAT);
     return false;
   }
 
-  uint8_t newContractAddress[LUKSO_ADDRESS_AS_STRING_LENGTH + 1];
-  message[LUKSO_ADDRESS_AS_STRING_LENGTH + 2] = 0;
-  memcpy(newContractAddress, &message[1], LUKSO_ADDRESS_AS_STRING_LENGTH + 1);
+  // Stored as bytes through hex2bin, which reads anything else as zero nibbles
+  for (uint8_t i = 2; i < LUKSO_ADDRESS_AS_STRING_LENGTH; i++)
+  {
+    if (!((newContractAddress[i] >= 'A' && newContractAddress[i] <= 'F') || (newContractAddress[i] >= 'a' && newContractAddress[i] <= 'f') || (newContractAddress[i] >= '0' && newContractAddress[i] <= '9')))
+    {
+      writeError(INVALID_MESSAGE_FORMAT);
+      return false;
+    }
+  }
 
-  if (newContractAddress[0] != '0' || (newContractAddress[1] != 'X' && newContractAddress[1] != 'x'))
+  saveContractAddress(newContractAddress);
+  if (jobs != nullptr)
   {
-    messageReply[0] = INVALID_MESSAGE_FORMAT;
-    writeMessage(messageReply, 1);
-    return false;
+    // Written once the field is stable, an EEPROM row cut off by a brown out would leave the records unreadable
+    memcpy(ndefContractAddress, newContractAddress, sizeof(ndefContractAddress));
+    jobs->request(JobScheduler::NDEF_UPDATE);
   }
+  else
+  {
+    updateNDEFRecords(newContractAddress);
+  }
+
+  message[0] = CONTRACT_ADDRESS;
+  writeMessage(message, 1);
+  return true;
+}
+
+bool NFCTag::processHello()
+{
+  uint8_t *reply = message;
+  *reply++ = HELLO;
+
+  *reply++ = HELLO_TAG_FIRMWARE_VERSION;
+  *reply++ = 3;
+  *reply++ = FIRMWARE_VERSION_MAJOR;
+  *reply++ = FIRMWARE_VERSION_MINOR;
+  *reply++ = FIRMWARE_VERSION_PATCH;
+
+  *reply++ = HELLO_TAG_MESSAGE_IDS;
+  uint8_t *messageIdsLength = reply++;
+  *messageIdsLength = 0;
+  for (uint8_t id = 0; id < MESSAGE_HANDLER_COUNT; id++)
+  {
+    if (messageHandlers[id].handler == nullptr)
+      continue;
+    *reply++ = id;
+    (*messageIdsLength)++;
+  }
+
+  *reply++ = HELLO_TAG_MAX_FRAME_SIZE;
+  *reply++ = 2;
+  *reply++ = MAILBOX_LENGTH >> 8;
+  *reply++ = MAILBOX_LENGTH & 0xFF;
+
+  *reply++ = HELLO_TAG_BATCH_LIMIT;
+  *reply++ = 1;
+  *reply++ = SIGN_BATCH_LIMIT;
+
+  *reply++ = HELLO_TAG_CURVE;
+  *reply++ = 1;
+  *reply++ = CURVE_ID_SECP256K1;
+
+  *reply++ = HELLO_TAG_KEY_SLOTS;
+  *reply++ = 1;
+  *reply++ = KEY_SLOT_COUNT;
+
+  writeMessage(message, reply - message);
+  return true;
+}
+
+bool NFCTag::processGetIdentity()
+{
+  // [GET_IDENTITY][public key][address][device uid][contract address set][contract address (if set)]
+  uint8_t *reply = message;
+  *reply++ = GET_IDENTITY;
+  memcpy(reply, wallet.getPublicKey(), PUBLIC_KEY_LENGTH);
+  reply += PUBLIC_KEY_LENGTH;
+  memcpy(reply, wallet.getLuksoAddressBytes(), LUKSO_ADDRESS_LENGTH);
+  reply += LUKSO_ADDRESS_LENGTH;
+  memcpy(reply, deviceUID, DEVICE_UID_LENGTH);
+  reply += DEVICE_UID_LENGTH;
+  *reply++ = contractAddressSet ? 1 : 0;
+  if (contractAddressSet)
+  {
+    memcpy(reply, contractAddress, LUKSO_ADDRESS_LENGTH);
+    reply += LUKSO_ADDRESS_LENGTH;
+  }
+
+  writeMessage(message, reply - message);
+  return true;
+}
 
-  for (uint8_t i = 0; i < LUKSO_ADDRESS_AS_STRING_LENGTH; i++)
+static uint8_t *putUint16(uint8_t *target, uint16_t value)
+{
+  *target++ = value >> 8;
+  *target++ = value & 0xFF;
+  return target;
+}
+
+static uint8_t *putUint32(uint8_t *target, uint32_t value)
+{
+  target = putUint16(target, value >> 16);
+  return putUint16(target, value & 0xFFFF);
+}
+
+bool NFCTag::processDiagnostics()
+{
+  uint8_t page = messageLength > 1 ? message[1] : (uint8_t)DIAGNOSTICS_PAGE_COUNTERS;
+  SFE_ST25DV64KC_Trace &trace = getTrace();
+  uint8_t *reply = message;
+  *reply++ = DIAGNOSTICS;
+
+  if (page == DIAGNOSTICS_PAGE_TRACE)
   {
-    if (!((newContractAddress[i] >= 'A' && newContractAddress[i] <= 'Z') || (newContractAddress[i] >= 'a' && newContractAddress[i] <= 'z') || (newContractAddress[i] >= '0' && newContractAddress[i] <= '9')))
+    // As many of the most recent transfers as fit into the one byte TLV length, copied through the arena scratch
+    // memory a few at a time
+    const uint8_t entryLength = 14;
+    const uint8_t tlvEntries = (255 - 4) / entryLength;
+    const uint8_t arenaEntries = ARENA_SCRATCH_LENGTH / sizeof(SFE_ST25DV64KC_Trace::Entry);
+    SFE_ST25DV64KC_Trace::Entry *entries = (SFE_ST25DV64KC_Trace::Entry *)arena.allocate(arenaEntries * sizeof(SFE_ST25DV64KC_Trace::Entry));
+    if (entries == nullptr)
     {
-      messageReply[0] = INVALID_MESSAGE_FORMAT;
-      writeMessage(messageReply, 1);
+      writeError(UNKOWN_ERROR);
       return false;
     }
+    uint32_t recorded = trace.getRecorded();
+    uint8_t count = recorded < SFE_ST25DV64KC_TRACE_LENGTH ? recorded : SFE_ST25DV64KC_TRACE_LENGTH;
+    if (count > tlvEntries)
+      count = tlvEntries;
+
+    *reply++ = DIAGNOSTICS_TAG_TRACE;
+    *reply++ = 4 + count * entryLength;
+    reply = putUint32(reply, recorded);
+    for (uint8_t remaining = count; remaining > 0;)
+    {
+      uint8_t chunk = remaining < arenaEntries ? remaining : arenaEntries;
+      trace.copyEntries(entries, chunk, remaining - chunk);
+      for (uint8_t i = 0; i < chunk; i++)
+      {
+        reply = putUint32(reply, entries[i].startMicros);
+        reply = putUint32(reply, entries[i].durationMicros);
+        reply = putUint16(reply, entries[i].registerAddress);
+        reply = putUint16(reply, entries[i].length);
+        *reply++ = entries[i].flags;
+        *reply++ = entries[i].attempt;
+      }
+      remaining -= chunk;
+    }
+
+    writeMessage(message, reply - message);
+    return true;
+  }
+
+  if (page == DIAGNOSTICS_PAGE_JOBS)
+  {
+    for (uint8_t id = 0; jobs != nullptr && id < JobScheduler::JOB_COUNT; id++)
+    {
+      const JobScheduler::Statistics &job = jobs->getStatistics((JobScheduler::JobId)id);
+      *reply++ = DIAGNOSTICS_TAG_JOB;
+      *reply++ = 1 + 5 * 4;
+      *reply++ = id;
+      reply = putUint32(reply, job.runs);
+      reply = putUint32(reply, job.completed);
+      reply = putUint32(reply, job.aborted);
+      reply = putUint32(reply, job.deferred);
+      reply = putUint32(reply, job.steps);
+    }
+
+    writeMessage(message, reply - message);
+    return true;
+  }
+
+  if (page != DIAGNOSTICS_PAGE_COUNTERS)
+  {
+    writeError(INVALID_MESSAGE_FORMAT);
+    return false;
   }
 
-  updateNDEFRecords((const char *)newContractAddress);
+  const SFE_ST25DV64KC_Trace::Counters &i2c = trace.getCounters();
+  *reply++ = DIAGNOSTICS_TAG_I2C;
+  *reply++ = 8 * 4;
+  reply = putUint32(reply, i2c.reads);
+  reply = putUint32(reply, i2c.writes);
+  reply = putUint32(reply, i2c.bytesRead);
+  reply = putUint32(reply, i2c.bytesWritten);
+  reply = putUint32(reply, i2c.nacks);
+  reply = putUint32(reply, i2c.retries);
+  reply = putUint32(reply, i2c.readMicros);
+  reply = putUint32(reply, i2c.writeMicros);
+
+  const SFE_ST2525DV64KC_IO::BusyStatistics &busy = getBusyStatistics();
+  *reply++ = DIAGNOSTICS_TAG_EEPROM_BUSY;
+  *reply++ = 7 * 4;
+  reply = putUint32(reply, busy.writeCycles);
+  reply = putUint32(reply, busy.programCycles);
+  reply = putUint32(reply, busy.polls);
+  reply = putUint32(reply, busy.timeouts);
+  reply = putUint32(reply, busy.totalMicros);
+  reply = putUint32(reply, busy.maxMicros);
+  reply = putUint32(reply, busy.waitMicros);
+
+  *reply++ = DIAGNOSTICS_TAG_ARENA;
+  *reply++ = 2;
+  reply = putUint16(reply, arena.getHighWaterMark());
+
+  *reply++ = DIAGNOSTICS_TAG_REPLY_FAILURES;
+  *reply++ = 4;
+  reply = putUint32(reply, replyWriteFailures);
+
+  // This call is counted once the reply is written
+  for (uint8_t id = 0; id < MESSAGE_HANDLER_COUNT; id++)
+  {
+    *reply++ = DIAGNOSTICS_TAG_MESSAGE;
+    *reply++ = 1 + 4 * 4;
+    *reply++ = id;
+    reply = putUint32(reply, messageStatistics[id].calls);
+    reply = putUint32(reply, messageStatistics[id].failures);
+    reply = putUint32(reply, messageStatistics[id].totalMicros);
+    reply = putUint32(reply, messageStatistics[id].maxMicros);
+  }
+
+  const SFE_ST25DV64KC::RegisterCacheStatistics &cache = getRegisterCacheStatistics();
+  *reply++ = DIAGNOSTICS_TAG_REGISTER_CACHE;
+  *reply++ = 3 * 4;
+  reply = putUint32(reply, cache.hits);
+  reply = putUint32(reply, cache.misses);
+  reply = putUint32(reply, cache.skippedWrites);
+
+  if (governor != nullptr)
+  {
+    for (uint8_t point = 0; point < ClockGovernor::OPERATING_POINT_COUNT; point++)
+    {
+      const ClockGovernor::Statistics &clock = governor->getStatistics((ClockGovernor::OperatingPoint)point);
+      *reply++ = DIAGNOSTICS_TAG_CLOCK;
+      *reply++ = 1 + 3 * 4;
+      *reply++ = ClockGovernor::operatingPoints[point].megahertz;
+      reply = putUint32(reply, clock.bursts);
+      reply = putUint32(reply, clock.totalMicros);
+      reply = putUint32(reply, clock.maxMicros);
+    }
+  }
 
-  messageReply[0] = CONTRACT_ADDRESS;
-  writeMessage(messageReply, 1);
+  writeMessage(message, reply - message);
   return true;
 }
 
-void NFCTag::updateNDEFRecords(const char *contractAddress)
+void NFCTag::loadContractAddress()
 {
-  uint16_t memLoc = st25.getCCFileLen();
-  st25.setMailboxActive(false);
-  st25.writeNDEFURI("phygital.tuszy.com", SFE_ST25DV_NDEF_URI_ID_CODE_HTTPS_WWW, &memLoc, true, false);
-  st25.writeNDEFText(wallet.getLuksoAddress(), &memLoc, false, contractAddress == nullptr);
+  if (EEPROM.read(EEPROM_CONTRACT_ADDRESS_SET_ADDRESS) == EEPROM_CONTRACT_ADDRESS_SET_MAGIC_VALUE)
+  {
+    for (uint8_t i = 0; i < LUKSO_ADDRESS_LENGTH; i++)
+      contractAddress[i] = EEPROM.read(EEPROM_CONTRACT_ADDRESS_ADDRESS + i);
+    contractAddressSet = true;
+    return;
+  }
+
+  // Tags provisioned before the contract address was mirrored into the µC eeprom only have it in the NDEF records
+#ifdef NDEF_EXTERNAL_TYPE_RECORDS
+  uint8_t storedContractAddress[LUKSO_ADDRESS_LENGTH];
+  uint16_t length = sizeof(storedContractAddress);
+  if (st25.readNDEFRecord(SFE_ST25DV_NDEF_TNF_EXTERNAL, (const uint8_t *)NDEF_EXTERNAL_TYPE_CONTRACT, strlen(NDEF_EXTERNAL_TYPE_CONTRACT), storedContractAddress, &length) && length == LUKSO_ADDRESS_LENGTH)
+    saveContractAddress(storedContractAddress);
+#else
+  char storedContractAddress[LUKSO_ADDRESS_AS_STRING_LENGTH + 1];
+  if (st25.readNDEFText(storedContractAddress, sizeof(storedContractAddress), 2) && strlen(storedContractAddress) == LUKSO_ADDRESS_AS_STRING_LENGTH)
+    saveContractAddress(storedContractAddress);
+#endif
+}
+
+void NFCTag::saveContractAddress(const char *newContractAddress)
+{
+  uint8_t newContractAddressBytes[LUKSO_ADDRESS_LENGTH];
+  hex2bin(newContractAddress + 2, newContractAddressBytes);
+  saveContractAddress(newContractAddressBytes);
+}
+
+void NFCTag::saveContractAddress(const uint8_t *newContractAddress)
+{
+  if (contractAddressSet && memcmp(contractAddress, newContractAddress, LUKSO_ADDRESS_LENGTH) == 0)
+    return;
+  memcpy(contractAddress, newContractAddress, LUKSO_ADDRESS_LENGTH);
+  contractAddressSet = true;
+
+  // The page also holds the wallet keys, it is only erased once the supply is stable
+  if (jobs != nullptr && initialized)
+    jobs->request(JobScheduler::CONTRACT_ADDRESS_SAVE);
+  else
+    storeContractAddress();
+}
+
+void NFCTag::storeContractAddress()
+{
+  // Every EEPROM.write erases and programs the whole emulated eeprom page. The bytes are staged in the page buffer
+  // instead, the magic value last, and programmed together
+  eeprom_buffer_fill();
+  for (uint8_t i = 0; i < LUKSO_ADDRESS_LENGTH; i++)
+    eeprom_buffered_write_byte(EEPROM_CONTRACT_ADDRESS_ADDRESS + i, contractAddress[i]);
+  eeprom_buffered_write_byte(EEPROM_CONTRACT_ADDRESS_SET_ADDRESS, EEPROM_CONTRACT_ADDRESS_SET_MAGIC_VALUE);
+  eeprom_buffer_flush();
+}
+
+JobScheduler::StepResult NFCTag::runContractAddressSave(void *context)
+{
+  static_cast<NFCTag *>(context)->storeContractAddress();
+  return JobScheduler::STEP_DONE;
+}
+
+JobScheduler::StepResult NFCTag::runNDEFUpdate(void *context)
+{
+  NFCTag *nfcTag = static_cast<NFCTag *>(context);
+  return nfcTag->updateNDEFRecords(nfcTag->ndefContractAddress) ? JobScheduler::STEP_DONE : JobScheduler::STEP_FAILED;
+}
+
+bool NFCTag::updateNDEFRecords(const char *contractAddress)
+{
+  // The whole message is composed first, so the mailbox is only off while the changed rows are written
+  uint8_t ndefMessage[NDEF_MESSAGE_LENGTH];
+  SFE_ST25DV64KC_NDEFComposer composer(ndefMessage, sizeof(ndefMessage));
+  composer.addURI("phygital.tuszy.com", SFE_ST25DV_NDEF_URI_ID_CODE_HTTPS_WWW);
+#ifdef NDEF_EXTERNAL_TYPE_RECORDS
+  // saveContractAddress() has stored the binary form of contractAddress
+  composer.addExternal(NDEF_EXTERNAL_TYPE_ADDRESS, wallet.getLuksoAddressBytes(), LUKSO_ADDRESS_LENGTH);
   if (contractAddress != nullptr)
-    st25.writeNDEFText(contractAddress, &memLoc, false, true);
+    composer.addExternal(NDEF_EXTERNAL_TYPE_CONTRACT, this->contractAddress, LUKSO_ADDRESS_LENGTH);
+#else
+  composer.addText(wallet.getLuksoAddress());
+  if (contractAddress != nullptr)
+    composer.addText(contractAddress);
+#endif
+
+  // Setting the same contract address again leaves the records as they are
+  if (st25.isNDEFMessageWritten(composer))
+  {
+#ifdef DEBUG
+    Serial1.println("NDEF update: unchanged");
+#endif
+    return true;
+  }
+
+  // Only the rows holding changed bytes are written, usually those of the contract address record
+  SFE_ST25DV64KC_NDEF::NDEFWriteReport report;
+  st25.setMailboxActive(false);
+  bool success = st25.writeNDEFMessage(composer, nullptr, &report);
   st25.setMailboxActive(true);
+
+#ifdef DEBUG
+  Serial1.print("NDEF update: ");
+  Serial1.print(report.bytes);
+  Serial1.print(" bytes in ");
+  Serial1.print(report.ranges);
+  Serial1.print(" writes, ");
+  Serial1.print(report.rowsWritten);
+  Serial1.print(" rows written, ");
+  Serial1.print(report.rowsUnchanged);
+  Serial1.println(" rows unchanged");
+  if (!success)
+    Serial1.println("Failed to write NDEF records");
+#endif
+  return success;
 }
 
 bool NFCTag::isInitialized()
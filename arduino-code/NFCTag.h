@@ -6,6 +6,9 @@
 #include "keccak.h"
 #include "constants.h"
 #include "Wallet.h"
+#include "MessageArena.h"
+#include "ClockGovernor.h"
+#include "JobScheduler.h"
 
 class NFCTag
 {
@@ -14,6 +17,9 @@ public:
   {
     SIGN = 0x00,
     CONTRACT_ADDRESS = 0x01,
+    HELLO = 0x02,
+    GET_IDENTITY = 0x03,
+    DIAGNOSTICS = 0x04,
 
     INVALID_MESSAGE_FORMAT = 0xFC,
     INVALID_MESSAGE_LENGTH = 0xFD,
@@ -21,14 +27,109 @@ public:
     UNKOWN_MESSAGE = 0xFF,
   };
 
-  NFCTag(Wallet &wallet);
+  // TLV tags of the HELLO reply: [HELLO][tag][length][value]...
+  enum HelloTag
+  {
+    HELLO_TAG_FIRMWARE_VERSION = 0x01, // major, minor, patch
+    HELLO_TAG_MESSAGE_IDS = 0x02,      // one byte per supported message id
+    HELLO_TAG_MAX_FRAME_SIZE = 0x03,   // uint16, big endian
+    HELLO_TAG_BATCH_LIMIT = 0x04,      // hashes per SIGN frame
+    HELLO_TAG_CURVE = 0x05,            // CURVE_ID_*
+    HELLO_TAG_KEY_SLOTS = 0x06,        // number of key slots
+  };
+
+  // DIAGNOSTICS request: [DIAGNOSTICS] or [DIAGNOSTICS][page], reply: [DIAGNOSTICS][tag][length][value]...
+  // All numbers are big endian.
+  enum DiagnosticsPage
+  {
+    DIAGNOSTICS_PAGE_COUNTERS = 0x00,
+    DIAGNOSTICS_PAGE_TRACE = 0x01,
+    DIAGNOSTICS_PAGE_JOBS = 0x02,
+  };
+
+  enum DiagnosticsTag
+  {
+    DIAGNOSTICS_TAG_I2C = 0x01,            // uint32 reads, writes, bytes read, bytes written, NACKs, retries, read us, write us
+    DIAGNOSTICS_TAG_EEPROM_BUSY = 0x02,    // uint32 write cycles, program cycles, polls, timeouts, total us, max us, wait us
+    DIAGNOSTICS_TAG_ARENA = 0x03,          // uint16 high water mark
+    DIAGNOSTICS_TAG_REPLY_FAILURES = 0x04, // uint32 failed asynchronous reply writes
+    DIAGNOSTICS_TAG_MESSAGE = 0x05,        // message id, uint32 calls, failures, total us, max us; once per message id
+    DIAGNOSTICS_TAG_REGISTER_CACHE = 0x06, // uint32 hits, misses, skipped writes
+    DIAGNOSTICS_TAG_CLOCK = 0x07,          // MHz, uint32 signatures, total us, max us; once per clock operating point
+    DIAGNOSTICS_TAG_JOB = 0x08,            // job id, uint32 runs, completed, aborted, deferred, steps; once per job
+    DIAGNOSTICS_TAG_TRACE = 0x10,          // uint32 transfers recorded, then per transfer: uint32 start us,
+                                           // uint32 us, uint16 register, uint16 length, flags, attempt
+  };
+
+  struct MessageStatistics
+  {
+    uint32_t calls;
+    uint32_t failures;
+    uint32_t totalMicros;
+    uint32_t maxMicros;
+  };
+
+  // Talks to the ST25DV through bus if given, otherwise through Wire (or DMA with I2C_DMA). Signs at the clock
+  // governor's operating points if given. Leaves NDEF rewrites and saving the contract address to the job scheduler
+  // if given, otherwise they are done before the reply
+  NFCTag(Wallet &wallet, SFE_ST25DV64KC_Bus *bus = nullptr, ClockGovernor *governor = nullptr, JobScheduler *jobs = nullptr);
 
   bool init();
   bool isInitialized();
 
   bool handleMessage();
 
+  // Retries a reply transfer started by handleMessage that failed, call from the main loop. Does not wait for one
+  // still on the bus: its completion interrupt wakes the MCU, which can sleep meanwhile
+  void completeTransfers();
+
+  // The reply transfer is on the bus or waits for its retry
+  inline bool isTransferPending()
+  {
+    return st25.isTransferPending();
+  }
+
+  // Reads FIELD_ON and EH_ON of the ST25DV's EH_CTRL_DYN register. Returns false if it could not
+  bool readSupply(bool *fieldOn, bool *harvesting);
+
+  const MessageStatistics &getMessageStatistics(uint8_t messageId);
+
+  inline uint16_t getArenaHighWaterMark()
+  {
+    return arena.getHighWaterMark();
+  }
+
+  inline const SFE_ST2525DV64KC_IO::BusyStatistics &getBusyStatistics()
+  {
+    return st25.st25_io.getBusyStatistics();
+  }
+
+  inline const SFE_ST25DV64KC::RegisterCacheStatistics &getRegisterCacheStatistics()
+  {
+    return st25.getRegisterCacheStatistics();
+  }
+
+  inline SFE_ST25DV64KC_Trace &getTrace()
+  {
+    return st25.st25_io.getTrace();
+  }
+
+  static constexpr uint8_t MESSAGE_HANDLER_COUNT = DIAGNOSTICS + 1;
+
 private:
+  typedef bool (NFCTag::*MessageHandler)();
+
+  struct MessageHandlerEntry
+  {
+    uint8_t id;
+    MessageHandler handler;
+    uint16_t minLength;
+    uint16_t maxLength;
+  };
+
+  static const MessageHandlerEntry messageHandlers[MESSAGE_HANDLER_COUNT];
+  static constexpr bool messageHandlersIndexedById(uint8_t index = 0);
+
   static uint8_t correctPassword[PASSWORD_LENGTH];
   static uint8_t wrongPassword[PASSWORD_LENGTH];
 
@@ -36,21 +137,52 @@ private:
   bool begin();
   bool fetchMessage();
   bool writeMessage(uint8_t *message, uint16_t messageLength);
+  void writeError(MessageId error);
+  static void onReplyWritten(bool success, void *context);
 
   bool processSignMessage();
 
   bool processContractAddress();
 
-  void updateNDEFRecords(const char *contractAddress);
+  bool processHello();
+
+  bool processGetIdentity();
+
+  bool processDiagnostics();
+
+  void loadContractAddress();
+  void saveContractAddress(const char *contractAddress);
+  void saveContractAddress(const uint8_t *contractAddress);
+  // Programs contractAddress into the µC eeprom with one page erase
+  void storeContractAddress();
+  static JobScheduler::StepResult runContractAddressSave(void *context);
+
+  // Returns false if the records could not be written
+  bool updateNDEFRecords(const char *contractAddress);
+  static JobScheduler::StepResult runNDEFUpdate(void *context);
+
+  // The ST25DV's EH output is on, i.e. the tag runs on harvested energy. Assumed when the status cannot be read
+  bool isHarvesting();
 
   bool initialized;
 
   Wallet &wallet;
+  SFE_ST25DV64KC_Bus *bus;
+  ClockGovernor *governor;
+  JobScheduler *jobs;
   SFE_ST25DV64KC_NDEF st25;
 
-  uint8_t message[MAILBOX_LENGTH];
+  uint8_t deviceUID[DEVICE_UID_LENGTH];
+  uint8_t contractAddress[LUKSO_ADDRESS_LENGTH];
+  bool contractAddressSet;
+  // As received, for the NDEF update left to the job scheduler
+  char ndefContractAddress[LUKSO_ADDRESS_AS_STRING_LENGTH + 1];
+
+  // Received frame and reply share the arena frame, the reply overwrites the message in place
+  MessageArena arena;
+  uint8_t *const message;
   uint16_t messageLength;
 
-  uint8_t messageReply[MAILBOX_LENGTH];
-  uint16_t messageReplyLength;
+  MessageStatistics messageStatistics[MESSAGE_HANDLER_COUNT];
+  volatile uint32_t replyWriteFailures;
 };
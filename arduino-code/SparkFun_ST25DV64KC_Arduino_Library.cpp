@@ -19,11 +19,39 @@
 #include "SparkFun_ST25DV64KC_Arduino_Library.h"
 #include "SparkFun_ST25DV64KC_Arduino_Library_Constants.h"
 
+// Registers in the shadow cache. Only the bits in mask are kept (the other MB_CTRL_DYN bits are status bits).
+// System configuration can only be changed over RF with the configuration password and never once LOCK_CFG is set.
+// RF writable registers are always read and written through.
+static const struct
+{
+  SF_ST25DV64KC_ADDRESS addressType;
+  uint16_t registerAddress;
+  uint8_t mask;
+  bool rfWritable;
+} shadowRegisters[] = {
+    {SF_ST25DV64KC_ADDRESS::SYSTEM, REG_GPO1, 0xFF, false},
+    {SF_ST25DV64KC_ADDRESS::SYSTEM, REG_EH_MODE, 0xFF, false},
+    {SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA1SS, 0xFF, false},
+    {SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA2SS, 0xFF, false},
+    {SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA3SS, 0xFF, false},
+    {SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA4SS, 0xFF, false},
+    {SF_ST25DV64KC_ADDRESS::SYSTEM, REG_FTM, 0xFF, false},
+    {SF_ST25DV64KC_ADDRESS::DATA, REG_MB_CTRL_DYN, BIT_MB_CTRL_DYN_MB_EN, true},
+};
+
 bool SFE_ST25DV64KC::begin(TwoWire &i2cPort)
 {
+  invalidateRegisterCache();
   st25_io.begin(i2cPort);
   return isConnected();
 }
+
+bool SFE_ST25DV64KC::begin(SFE_ST25DV64KC_Bus &bus)
+{
+  invalidateRegisterCache();
+  st25_io.begin(bus);
+  return isConnected();
+}
 #ifdef DEBUG
 void SFE_ST25DV64KC::setErrorCallback(void (*errorCallback)(SF_ST25DV64KC_ERROR errorCode))
 {
@@ -187,9 +215,11 @@ bool SFE_ST25DV64KC::writeI2CPassword(uint8_t *password)
   }
 
   // Disable Fast Transfer Mode (datasheet page 75)
-  bool ftmIsSet = st25_io.isBitSet(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_FTM, BIT_FTM_MB_MODE);
+  uint8_t ftm = 0;
+  bool success = readShadowRegister(SHADOW_FTM, &ftm);
+  bool ftmIsSet = ftm & BIT_FTM_MB_MODE;
 
-  bool success = st25_io.clearRegisterBit(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_FTM, BIT_FTM_MB_MODE);
+  success &= updateShadowRegisterBits(SHADOW_FTM, BIT_FTM_MB_MODE, false);
 
   // Passwords are written MSB first and need to be sent twice with 0x07 sent after the first
   // set of 8 bytes.
@@ -209,7 +239,7 @@ bool SFE_ST25DV64KC::writeI2CPassword(uint8_t *password)
   success &= st25_io.writeMultipleBytes(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_I2C_PASSWD_BASE, tempBuffer, 17);
 
   if (ftmIsSet)
-    success &= st25_io.setRegisterBit(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_FTM, BIT_FTM_MB_MODE);
+    success &= updateShadowRegisterBits(SHADOW_FTM, BIT_FTM_MB_MODE, true);
 
   if (!success)
   {
@@ -434,21 +464,27 @@ bool SFE_ST25DV64KC::getEEPROMWriteProtectionBit(uint8_t memoryArea)
 }
 
 bool SFE_ST25DV64KC::writeEEPROM(uint16_t baseAddress, uint8_t *data, uint16_t dataLength)
+{
+  _userMemoryWriteCount++;
+  return writeUserMemory(baseAddress, data, dataLength);
+}
+
+bool SFE_ST25DV64KC::writeUserMemory(uint16_t baseAddress, uint8_t *data, uint16_t dataLength)
 {
 #ifdef DEBUG
   // Disable FTM temporarily if enabled
-  bool ftmEnabled = st25_io.isBitSet(SF_ST25DV64KC_ADDRESS::DATA, REG_MB_CTRL_DYN, BIT_FTM_MB_MODE);
-
-  bool success = true;
+  uint8_t mbCtrl = 0;
+  bool success = readShadowRegister(SHADOW_MB_CTRL_DYN, &mbCtrl);
+  bool ftmEnabled = mbCtrl & BIT_MB_CTRL_DYN_MB_EN;
 
   if (ftmEnabled)
-    success &= st25_io.clearRegisterBit(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_FTM, BIT_FTM_MB_MODE);
+    success &= updateShadowRegisterBits(SHADOW_FTM, BIT_FTM_MB_MODE, false);
 
   success &= st25_io.writeMultipleBytes(SF_ST25DV64KC_ADDRESS::DATA, baseAddress, data, dataLength);
 
   // Restore FTM if previously enabled
   if (ftmEnabled)
-    success &= st25_io.setRegisterBit(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_FTM, BIT_FTM_MB_MODE);
+    success &= updateShadowRegisterBits(SHADOW_FTM, BIT_FTM_MB_MODE, true);
 
   if (!success)
   {
@@ -572,52 +608,12 @@ bool SFE_ST25DV64KC::setAreaRfRwProtection(uint8_t memoryArea, SF_ST25DV_RF_RW_P
   uint8_t value = 0;
   bool result = false;
 
-  switch (memoryArea)
-  {
-    case 1:
-      result = st25_io.readSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA1SS, &value);
-      break;
-
-    case 2:
-      result = st25_io.readSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA2SS, &value);
-      break;
-
-    case 3:
-      result = st25_io.readSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA3SS, &value);
-      break;
-
-    case 4:
-      result = st25_io.readSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA4SS, &value);
-      break;
-
-    default:
-      break;
-  }
+  result = readShadowRegister((ShadowRegister)(SHADOW_RFA1SS + memoryArea - 1), &value);
 
   value &= ~0x0C;              // Clear the two RW bits
   value |= ((uint8_t)rw) << 2; // Or in the new RW bits
 
-  switch (memoryArea)
-  {
-    case 1:
-      result &= st25_io.writeSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA1SS, value);
-      break;
-
-    case 2:
-      result &= st25_io.writeSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA2SS, value);
-      break;
-
-    case 3:
-      result &= st25_io.writeSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA3SS, value);
-      break;
-
-    case 4:
-      result &= st25_io.writeSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA4SS, value);
-      break;
-
-    default:
-      break;
-  }
+  result &= writeShadowRegister((ShadowRegister)(SHADOW_RFA1SS + memoryArea - 1), value);
 
   if (!result)
   {
@@ -642,23 +638,7 @@ SF_ST25DV_RF_RW_PROTECTION SFE_ST25DV64KC::getAreaRfRwProtection(uint8_t memoryA
   uint8_t value = 0;
   bool result = false;
 
-  switch (memoryArea)
-  {
-    case 1:
-      result = st25_io.readSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA1SS, &value);
-      break;
-
-    case 2:
-      result = st25_io.readSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA2SS, &value);
-      break;
-
-    case 3:
-      result = st25_io.readSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA3SS, &value);
-      break;
-
-    default:
-      break;
-  }
+  result = readShadowRegister((ShadowRegister)(SHADOW_RFA1SS + memoryArea - 1), &value);
 
   if (!result)
   {
@@ -684,52 +664,12 @@ bool SFE_ST25DV64KC::setAreaRfPwdCtrl(uint8_t memoryArea, SF_ST25DV_RF_PWD_CTRL
   uint8_t value = 0;
   bool result = false;
 
-  switch (memoryArea)
-  {
-    case 1:
-      result = st25_io.readSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA1SS, &value);
-      break;
-
-    case 2:
-      result = st25_io.readSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA2SS, &value);
-      break;
-
-    case 3:
-      result = st25_io.readSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA3SS, &value);
-      break;
-
-    case 4:
-      result = st25_io.readSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA4SS, &value);
-      break;
-
-    default:
-      break;
-  }
+  result = readShadowRegister((ShadowRegister)(SHADOW_RFA1SS + memoryArea - 1), &value);
 
   value &= ~0x03;            // Clear the two pwd ctrl bits
   value |= (uint8_t)pwdCtrl; // Or in the new pwd ctrl bits
 
-  switch (memoryArea)
-  {
-    case 1:
-      result &= st25_io.writeSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA1SS, value);
-      break;
-
-    case 2:
-      result &= st25_io.writeSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA2SS, value);
-      break;
-
-    case 3:
-      result &= st25_io.writeSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA3SS, value);
-      break;
-
-    case 4:
-      result &= st25_io.writeSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA4SS, value);
-      break;
-
-    default:
-      break;
-  }
+  result &= writeShadowRegister((ShadowRegister)(SHADOW_RFA1SS + memoryArea - 1), value);
 
   if (!result)
   {
@@ -754,27 +694,7 @@ SF_ST25DV_RF_PWD_CTRL SFE_ST25DV64KC::getAreaRfPwdCtrl(uint8_t memoryArea)
   uint8_t value = 0;
   bool result = false;
 
-  switch (memoryArea)
-  {
-    case 1:
-      result = st25_io.readSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA1SS, &value);
-      break;
-
-    case 2:
-      result = st25_io.readSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA2SS, &value);
-      break;
-
-    case 3:
-      result = st25_io.readSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA3SS, &value);
-      break;
-
-    case 4:
-      result = st25_io.readSingleByte(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_RFA4SS, &value);
-      break;
-
-    default:
-      break;
-  }
+  result = readShadowRegister((ShadowRegister)(SHADOW_RFA1SS + memoryArea - 1), &value);
 
   if (!result)
   {
@@ -794,12 +714,7 @@ bool SFE_ST25DV64KC::RFFieldDetected()
 
 bool SFE_ST25DV64KC::setGPO1Bit(uint8_t bitMask, bool enabled)
 {
-  bool success;
-
-  if (enabled)
-    success = st25_io.setRegisterBit(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_GPO1, bitMask);
-  else
-    success = st25_io.clearRegisterBit(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_GPO1, bitMask);
+  bool success = updateShadowRegisterBits(SHADOW_GPO1, bitMask, enabled);
 
   if (!success)
   {
@@ -813,7 +728,8 @@ bool SFE_ST25DV64KC::setGPO1Bit(uint8_t bitMask, bool enabled)
 
 bool SFE_ST25DV64KC::getGPO1Bit(uint8_t bitMask)
 {
-  return st25_io.isBitSet(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_GPO1, bitMask);
+  uint8_t value = 0;
+  return readShadowRegister(SHADOW_GPO1, &value) && (value & bitMask);
 }
 
 bool SFE_ST25DV64KC::setGPO2Bit(uint8_t bitMask, bool enabled)
@@ -882,12 +798,7 @@ uint8_t SFE_ST25DV64KC::getIT_STS_Dyn()
 
 bool SFE_ST25DV64KC::setEH_MODEBit(bool value)
 {
-  bool success;
-
-  if (value)
-    success = st25_io.setRegisterBit(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_EH_MODE, BIT_EH_MODE_EH_MODE);
-  else
-    success = st25_io.clearRegisterBit(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_EH_MODE, BIT_EH_MODE_EH_MODE);
+  bool success = updateShadowRegisterBits(SHADOW_EH_MODE, BIT_EH_MODE_EH_MODE, value);
 
   if (!success)
   {
@@ -901,7 +812,8 @@ bool SFE_ST25DV64KC::setEH_MODEBit(bool value)
 
 bool SFE_ST25DV64KC::getEH_MODEBit()
 {
-  return st25_io.isBitSet(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_EH_MODE, BIT_EH_MODE_EH_MODE);
+  uint8_t value = 0;
+  return readShadowRegister(SHADOW_EH_MODE, &value) && (value & BIT_EH_MODE_EH_MODE);
 }
 
 bool SFE_ST25DV64KC::setEH_CTRL_DYNBit(uint8_t bitMask, bool value)
@@ -941,9 +853,33 @@ bool SFE_ST25DV64KC::lockConfiguration()
   return true;
 }
 
+bool SFE_ST25DV64KC::commitRegisterTransaction(SFE_ST25DV64KC_RegisterTransaction &transaction, SFE_ST25DV64KC_RegisterTransaction::Report *report)
+{
+  bool success = transaction.execute(st25_io, report);
+
+  // Backwards: the transaction writes dynamic registers before system ones, and storing FTM may clear MB_EN
+  for (int8_t i = SHADOW_REGISTER_COUNT - 1; i >= 0; i--)
+  {
+    uint8_t value;
+    if (transaction.getCommittedValue(shadowRegisters[i].addressType, shadowRegisters[i].registerAddress, &value))
+      storeShadowRegister((ShadowRegister)i, value);
+    else if (!success)
+      _shadowValid &= ~(1 << i);
+  }
+
+  if (!success)
+  {
+#ifdef DEBUG
+    SAFE_CALLBACK(_errorCallback, SF_ST25DV64KC_ERROR::I2C_TRANSMISSION_ERROR);
+#endif
+  }
+
+  return success;
+}
+
 bool SFE_ST25DV64KC::enableMailbox()
 {
-  if (!st25_io.setRegisterBit(SF_ST25DV64KC_ADDRESS::SYSTEM, REG_FTM, BIT_FTM_MB_MODE))
+  if (!updateShadowRegisterBits(SHADOW_FTM, BIT_FTM_MB_MODE, true))
   {
 #ifdef DEBUG
     SAFE_CALLBACK(_errorCallback, SF_ST25DV64KC_ERROR::I2C_TRANSMISSION_ERROR);
@@ -956,12 +892,8 @@ bool SFE_ST25DV64KC::enableMailbox()
 
 bool SFE_ST25DV64KC::setMailboxActive(bool value)
 {
-  bool success;
-
-  if (value)
-    success = st25_io.setRegisterBit(SF_ST25DV64KC_ADDRESS::DATA, REG_MB_CTRL_DYN, BIT_MB_CTRL_DYN_MB_EN);
-  else
-    success = st25_io.clearRegisterBit(SF_ST25DV64KC_ADDRESS::DATA, REG_MB_CTRL_DYN, BIT_MB_CTRL_DYN_MB_EN);
+  // MB_EN is the only writable bit, no need to read the register first
+  bool success = writeShadowRegister(SHADOW_MB_CTRL_DYN, value ? BIT_MB_CTRL_DYN_MB_EN : 0);
 
   if (!success)
   {
@@ -975,7 +907,7 @@ bool SFE_ST25DV64KC::setMailboxActive(bool value)
 
 uint16_t SFE_ST25DV64KC::getMailboxMessageLength()
 {
-  if (!st25_io.isBitSet(SF_ST25DV64KC_ADDRESS::DATA, DYN_REG_EH_CTRL_DYN, BIT_MB_CTRL_DYN_RF_PUT_MSG))
+  if (!st25_io.isBitSet(SF_ST25DV64KC_ADDRESS::DATA, REG_MB_CTRL_DYN, BIT_MB_CTRL_DYN_RF_PUT_MSG))
     return 0;
 
   uint8_t length = 0;
@@ -991,3 +923,110 @@ uint16_t SFE_ST25DV64KC::getMailboxMessageLength()
 
   return length + 1;
 }
+
+bool SFE_ST25DV64KC::readMailboxMessage(uint8_t *buffer, uint16_t maxLength, uint16_t *length)
+{
+  *length = 0;
+
+  // MB_CTRL_DYN and MB_LEN_DYN are adjacent
+  uint8_t status[2];
+  if (!st25_io.readMultipleBytes(SF_ST25DV64KC_ADDRESS::DATA, REG_MB_CTRL_DYN, status, sizeof(status)))
+  {
+#ifdef DEBUG
+    SAFE_CALLBACK(_errorCallback, SF_ST25DV64KC_ERROR::I2C_TRANSMISSION_ERROR);
+#endif
+    return false;
+  }
+
+  if (!(status[0] & BIT_MB_CTRL_DYN_RF_PUT_MSG))
+    return true;
+
+  uint16_t messageLength = status[1] + 1;
+  if (messageLength > maxLength)
+    return false;
+
+  if (!st25_io.readMultipleBytesFromBuffer(buffer, messageLength))
+  {
+#ifdef DEBUG
+    SAFE_CALLBACK(_errorCallback, SF_ST25DV64KC_ERROR::I2C_TRANSMISSION_ERROR);
+#endif
+    return false;
+  }
+
+  *length = messageLength;
+  return true;
+}
+
+void SFE_ST25DV64KC::invalidateRegisterCache()
+{
+  _shadowValid = 0;
+}
+
+bool SFE_ST25DV64KC::readShadowRegister(ShadowRegister shadow, uint8_t *value)
+{
+  // An RF reader can change RF writable bits at any time, they are always read from the IC
+  if ((_shadowValid & (1 << shadow)) && !shadowRegisters[shadow].rfWritable)
+  {
+    _registerCacheStatistics.hits++;
+    *value = _shadowValues[shadow];
+    return true;
+  }
+
+  _registerCacheStatistics.misses++;
+  if (!st25_io.readSingleByte(shadowRegisters[shadow].addressType, shadowRegisters[shadow].registerAddress, value))
+    return false;
+
+  *value &= shadowRegisters[shadow].mask;
+  storeShadowRegister(shadow, *value);
+  return true;
+}
+
+bool SFE_ST25DV64KC::writeShadowRegister(ShadowRegister shadow, uint8_t value)
+{
+  value &= shadowRegisters[shadow].mask;
+
+  // Rewriting a configuration register costs an EEPROM write cycle, skip it if nothing changes.
+  // RF writable bits are always written, the shadow copy may be stale.
+  if ((_shadowValid & (1 << shadow)) && !shadowRegisters[shadow].rfWritable && _shadowValues[shadow] == value)
+  {
+    _registerCacheStatistics.skippedWrites++;
+    return true;
+  }
+
+  if (!st25_io.writeSingleByte(shadowRegisters[shadow].addressType, shadowRegisters[shadow].registerAddress, value))
+  {
+    _shadowValid &= ~(1 << shadow);
+    return false;
+  }
+
+  storeShadowRegister(shadow, value);
+  return true;
+}
+
+void SFE_ST25DV64KC::storeShadowRegister(ShadowRegister shadow, uint8_t value)
+{
+  _shadowValues[shadow] = value & shadowRegisters[shadow].mask;
+  _shadowValid |= (1 << shadow);
+
+  // Leaving fast transfer mode disables and empties the mailbox
+  if (shadow == SHADOW_FTM && !(value & BIT_FTM_MB_MODE))
+  {
+    _shadowValues[SHADOW_MB_CTRL_DYN] = 0;
+    _shadowValid |= (1 << SHADOW_MB_CTRL_DYN);
+  }
+}
+
+bool SFE_ST25DV64KC::updateShadowRegisterBits(ShadowRegister shadow, uint8_t bitMask, bool set)
+{
+  uint8_t value;
+
+  if (!readShadowRegister(shadow, &value))
+    return false;
+
+  if (set)
+    value |= bitMask;
+  else
+    value &= ~bitMask;
+
+  return writeShadowRegister(shadow, value);
+}
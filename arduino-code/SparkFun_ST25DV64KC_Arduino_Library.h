@@ -22,6 +22,7 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include "SparkFun_ST25DV64KC_IO.h"
+#include "SparkFun_ST25DV64KC_RegisterTransaction.h"
 #include "SparkFun_ST25DV64KC_Arduino_Library_Constants.h"
 
 class SFE_ST25DV64KC
@@ -54,6 +55,9 @@ class SFE_ST25DV64KC
     // Initializes ST25DV64KC.
     bool begin(TwoWire &wirePort = Wire);
 
+    // Initializes ST25DV64KC on an arbitrary bus (see SparkFun_ST25DV64KC_Bus.h).
+    bool begin(SFE_ST25DV64KC_Bus &bus);
+
     // Checks if ST25DK64KC is connected and that chip ID matches the expected result.
     bool isConnected();
 
@@ -75,6 +79,36 @@ class SFE_ST25DV64KC
       return st25_io.readMultipleBytesFromBuffer(buffer, packetLength);
     }
 
+    // Writes multiple values to mailbox without waiting for the transfer, see SFE_ST2525DV64KC_IO
+    inline bool writeToMailboxAsync(uint8_t *const buffer, uint16_t packetLength, SFE_ST25DV64KC_TransferCallback callback, void *context)
+    {
+      return st25_io.writeMultipleBytesToBufferAsync(buffer, packetLength, callback, context);
+    }
+
+    // Reads multiple values from mailbox without waiting for the transfer, see SFE_ST2525DV64KC_IO
+    inline bool readFromMailboxAsync(uint8_t *const buffer, uint16_t packetLength, SFE_ST25DV64KC_TransferCallback callback, void *context)
+    {
+      return st25_io.readMultipleBytesFromBufferAsync(buffer, packetLength, callback, context);
+    }
+
+    // Returns true while an asynchronous transfer is pending
+    inline bool isTransferPending()
+    {
+      return st25_io.isTransferPending();
+    }
+
+    // Returns true while an asynchronous transfer is on the bus, see SFE_ST2525DV64KC_IO
+    inline bool isTransferInFlight()
+    {
+      return st25_io.isTransferInFlight();
+    }
+
+    // Blocks until a pending asynchronous transfer has finished
+    inline void waitForTransfer()
+    {
+      st25_io.waitForTransfer();
+    }
+
     // Gets device UID (8 bytes).
     bool getDeviceUID(uint8_t *values);
 
@@ -122,6 +156,13 @@ class SFE_ST25DV64KC
     // Writes block of data to EEPROM.
     bool writeEEPROM(uint16_t baseAddress, uint8_t *data, uint16_t dataLength);
 
+    // Counts the writeEEPROM() calls, so that RAM copies of user memory can tell that they are stale.
+    // Writes made through RF are not counted.
+    inline uint32_t getUserMemoryWriteCount()
+    {
+      return _userMemoryWriteCount;
+    }
+
     // Sets memory area boundary. memoryNumber ranges from 1 to 3.
     // endAddressValue must comply with datasheet's area size specifications (page 14).
     // Returns true if memory was correctly programmed and passed all checks, false otherwise.
@@ -185,6 +226,10 @@ class SFE_ST25DV64KC
     // Prevents RF writing to configuration
     bool lockConfiguration();
 
+    // Commits the queued register updates (see SparkFun_ST25DV64KC_RegisterTransaction.h) and refreshes the
+    // register shadow cache with the values read and written. report (optional) receives the bus usage.
+    bool commitRegisterTransaction(SFE_ST25DV64KC_RegisterTransaction &transaction, SFE_ST25DV64KC_RegisterTransaction::Report *report = nullptr);
+
     // Enables the mailbox (need to be called only once)
     bool enableMailbox();
 
@@ -193,6 +238,61 @@ class SFE_ST25DV64KC
 
     // Gets the mailbox message length
     uint16_t getMailboxMessageLength();
+
+    // Receives a message put into the mailbox through RF: MB_CTRL_DYN and MB_LEN_DYN in one read, then the
+    // message straight into buffer. length is 0 if there is no message. Returns false on I2C errors or if the
+    // message is longer than maxLength.
+    bool readMailboxMessage(uint8_t *buffer, uint16_t maxLength, uint16_t *length);
+
+    // Register shadow cache statistics
+    struct RegisterCacheStatistics
+    {
+      uint32_t hits;          // reads answered from the shadow copy
+      uint32_t misses;        // reads that went to the bus
+      uint32_t skippedWrites; // writes of the value the register already holds
+    };
+
+    // GPO1, EH_MODE, RFAxSS and FTM are shadowed: reads are answered from the last value read or written, writes
+    // go through. MB_CTRL_DYN.MB_EN, which an RF reader can reset at any time, is always read from the IC. Call
+    // this when something other than this driver may have changed them.
+    void invalidateRegisterCache();
+
+    inline const RegisterCacheStatistics &getRegisterCacheStatistics()
+    {
+      return _registerCacheStatistics;
+    }
+
+    inline void resetRegisterCacheStatistics()
+    {
+      _registerCacheStatistics = {};
+    }
+
+  private:
+    enum ShadowRegister : uint8_t
+    {
+      SHADOW_GPO1,
+      SHADOW_EH_MODE,
+      SHADOW_RFA1SS,
+      SHADOW_RFA2SS,
+      SHADOW_RFA3SS,
+      SHADOW_RFA4SS,
+      SHADOW_FTM,
+      SHADOW_MB_CTRL_DYN,
+      SHADOW_REGISTER_COUNT
+    };
+
+    uint8_t _shadowValues[SHADOW_REGISTER_COUNT] = {};
+    uint16_t _shadowValid = 0;
+    RegisterCacheStatistics _registerCacheStatistics = {};
+
+    bool readShadowRegister(ShadowRegister shadow, uint8_t *value);
+    bool writeShadowRegister(ShadowRegister shadow, uint8_t value);
+    bool updateShadowRegisterBits(ShadowRegister shadow, uint8_t bitMask, bool set);
+    void storeShadowRegister(ShadowRegister shadow, uint8_t value);
+
+    uint32_t _userMemoryWriteCount = 0;
+
+    bool writeUserMemory(uint16_t baseAddress, uint8_t *data, uint16_t dataLength);
 };
 
 #include "SparkFun_ST25DV64KC_NDEF.h"
@@ -80,6 +80,12 @@ static const uint8_t LEN_MAILBOX = 0xff;
 // EEPROM size
 static const uint16_t EEPROM_SIZE = 0x2000;
 
+// EEPROM programming row, the IC programs each row touched by a write separately
+static const uint16_t EEPROM_ROW_SIZE = 0x10;
+
+// Maximum number of bytes in one I2C sequential write
+static const uint16_t MAX_SEQUENTIAL_WRITE_SIZE = 0x100;
+
 // Registers' bits definitions
 #define BIT_FTM_MB_MODE (1 << 0)
 
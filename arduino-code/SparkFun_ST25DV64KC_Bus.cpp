@@ -0,0 +1,226 @@
+/*
+  This is a library written for the ST25DV64KC Dynamic RFID Tag.
+  SparkFun sells these at its website:
+  https://www.sparkfun.com/products/
+
+  Do you like this library? Help support open source hardware. Buy a board!
+
+  This file implements the bus interface the IO layer transfers through.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SparkFun_ST25DV64KC_Bus.h"
+
+bool SFE_ST25DV64KC_WireBus::probe(uint8_t address)
+{
+  _i2cPort->beginTransmission(static_cast<int>(address));
+  return _i2cPort->endTransmission() == 0;
+}
+
+bool SFE_ST25DV64KC_WireBus::memRead(uint8_t address, uint16_t memAddress, uint8_t *buffer, uint16_t length)
+{
+#ifdef SFE_ST25DV64KC_WIRE_HAL_READ
+  // Memory address, repeated start and data in one transfer, without the Wire RX buffer in between
+  return HAL_I2C_Mem_Read(&_i2cPort->getHandle()->handle, address << 1, memAddress, I2C_MEMADD_SIZE_16BIT, buffer, length, halReadTimeoutMs) == HAL_OK;
+#else
+  _i2cPort->beginTransmission(static_cast<int>(address));
+  _i2cPort->write(memAddress >> 8);
+  _i2cPort->write(memAddress & 0xFF);
+
+  // Repeated start instead of stop + start
+  if (_i2cPort->endTransmission(false) != 0)
+    return false;
+
+  // requestFrom() returns the count as uint8_t, a 256 byte mailbox read reports 0
+  if (_i2cPort->requestFrom(static_cast<int>(address), static_cast<int>(length)) != static_cast<uint8_t>(length))
+    return false;
+
+  return _i2cPort->readBytes(buffer, length) == length;
+#endif
+}
+
+bool SFE_ST25DV64KC_WireBus::memWrite(uint8_t address, uint16_t memAddress, const uint8_t *buffer, uint16_t length)
+{
+  _i2cPort->beginTransmission(static_cast<int>(address));
+  _i2cPort->write(memAddress >> 8);
+  _i2cPort->write(memAddress & 0xFF);
+  _i2cPort->write(buffer, length);
+
+  return _i2cPort->endTransmission() == 0;
+}
+
+bool SFE_ST25DV64KC_WireBus::memReadAsync(uint8_t address, uint16_t memAddress, uint8_t *buffer, uint16_t length, SFE_ST25DV64KC_TransferCallback callback, void *context)
+{
+  bool success = memRead(address, memAddress, buffer, length);
+  if (callback != nullptr)
+    callback(success, context);
+  return true;
+}
+
+bool SFE_ST25DV64KC_WireBus::memWriteAsync(uint8_t address, uint16_t memAddress, const uint8_t *buffer, uint16_t length, SFE_ST25DV64KC_TransferCallback callback, void *context)
+{
+  bool success = memWrite(address, memAddress, buffer, length);
+  if (callback != nullptr)
+    callback(success, context);
+  return true;
+}
+
+#ifdef SFE_ST25DV64KC_DMA_BUS_AVAILABLE
+
+// The HAL completion callbacks are global, route them to the one DMA bus
+static SFE_ST25DV64KC_DMABus *dmaBus = nullptr;
+
+SFE_ST25DV64KC_DMABus::SFE_ST25DV64KC_DMABus(TwoWire &wirePort)
+    : _wirePort(wirePort), _handle(nullptr), _dmaTx(), _dmaRx(), _pending(false), _callback(nullptr), _context(nullptr)
+{
+}
+
+bool SFE_ST25DV64KC_DMABus::begin()
+{
+  _handle = &_wirePort.getHandle()->handle;
+  if (_handle == nullptr)
+    return false;
+
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  _dmaTx.Instance = DMA1_Channel6;
+  _dmaTx.Init.Request = DMA_REQUEST_3;
+  _dmaTx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+  _dmaTx.Init.PeriphInc = DMA_PINC_DISABLE;
+  _dmaTx.Init.MemInc = DMA_MINC_ENABLE;
+  _dmaTx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  _dmaTx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  _dmaTx.Init.Mode = DMA_NORMAL;
+  _dmaTx.Init.Priority = DMA_PRIORITY_LOW;
+  if (HAL_DMA_Init(&_dmaTx) != HAL_OK)
+    return false;
+  __HAL_LINKDMA(_handle, hdmatx, _dmaTx);
+
+  _dmaRx.Instance = DMA1_Channel7;
+  _dmaRx.Init = _dmaTx.Init;
+  _dmaRx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+  if (HAL_DMA_Init(&_dmaRx) != HAL_OK)
+    return false;
+  __HAL_LINKDMA(_handle, hdmarx, _dmaRx);
+
+  HAL_NVIC_SetPriority(DMA1_Channel6_IRQn, 2, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel6_IRQn);
+  HAL_NVIC_SetPriority(DMA1_Channel7_IRQn, 2, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel7_IRQn);
+
+  dmaBus = this;
+  return true;
+}
+
+bool SFE_ST25DV64KC_DMABus::probe(uint8_t address)
+{
+  while (isBusy())
+    ;
+  return HAL_I2C_IsDeviceReady(_handle, address << 1, 1, blockingTimeoutMs) == HAL_OK;
+}
+
+bool SFE_ST25DV64KC_DMABus::memRead(uint8_t address, uint16_t memAddress, uint8_t *buffer, uint16_t length)
+{
+  while (isBusy())
+    ;
+  return HAL_I2C_Mem_Read(_handle, address << 1, memAddress, I2C_MEMADD_SIZE_16BIT, buffer, length, blockingTimeoutMs) == HAL_OK;
+}
+
+bool SFE_ST25DV64KC_DMABus::memWrite(uint8_t address, uint16_t memAddress, const uint8_t *buffer, uint16_t length)
+{
+  while (isBusy())
+    ;
+  return HAL_I2C_Mem_Write(_handle, address << 1, memAddress, I2C_MEMADD_SIZE_16BIT, const_cast<uint8_t *>(buffer), length, blockingTimeoutMs) == HAL_OK;
+}
+
+bool SFE_ST25DV64KC_DMABus::memReadAsync(uint8_t address, uint16_t memAddress, uint8_t *buffer, uint16_t length, SFE_ST25DV64KC_TransferCallback callback, void *context)
+{
+  if (isBusy())
+    return false;
+
+  _callback = callback;
+  _context = context;
+  _pending = true;
+  if (HAL_I2C_Mem_Read_DMA(_handle, address << 1, memAddress, I2C_MEMADD_SIZE_16BIT, buffer, length) != HAL_OK)
+  {
+    _pending = false;
+    return false;
+  }
+  return true;
+}
+
+bool SFE_ST25DV64KC_DMABus::memWriteAsync(uint8_t address, uint16_t memAddress, const uint8_t *buffer, uint16_t length, SFE_ST25DV64KC_TransferCallback callback, void *context)
+{
+  if (isBusy())
+    return false;
+
+  _callback = callback;
+  _context = context;
+  _pending = true;
+  if (HAL_I2C_Mem_Write_DMA(_handle, address << 1, memAddress, I2C_MEMADD_SIZE_16BIT, const_cast<uint8_t *>(buffer), length) != HAL_OK)
+  {
+    _pending = false;
+    return false;
+  }
+  return true;
+}
+
+bool SFE_ST25DV64KC_DMABus::isBusy()
+{
+  poll();
+  return _pending;
+}
+
+void SFE_ST25DV64KC_DMABus::poll()
+{
+  // HAL_I2C_ErrorCallback belongs to the Wire library, so a failed transfer is only noticed by the handle
+  // returning to ready without a completion callback.
+  if (_pending && HAL_I2C_GetState(_handle) == HAL_I2C_STATE_READY)
+    complete(_handle, HAL_I2C_GetError(_handle) == HAL_I2C_ERROR_NONE);
+}
+
+void SFE_ST25DV64KC_DMABus::complete(I2C_HandleTypeDef *handle, bool success)
+{
+  // poll() and the completion interrupt may race for the same transfer, only the first one reports it
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  bool pending = handle == _handle && _pending;
+  if (pending)
+    _pending = false;
+  __set_PRIMASK(primask);
+
+  if (pending && _callback != nullptr)
+    _callback(success, _context);
+}
+
+extern "C" void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *handle)
+{
+  if (dmaBus != nullptr)
+    dmaBus->complete(handle, true);
+}
+
+extern "C" void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *handle)
+{
+  if (dmaBus != nullptr)
+    dmaBus->complete(handle, true);
+}
+
+extern "C" void DMA1_Channel6_IRQHandler(void)
+{
+  if (dmaBus != nullptr)
+    HAL_DMA_IRQHandler(dmaBus->getHandle()->hdmatx);
+}
+
+extern "C" void DMA1_Channel7_IRQHandler(void)
+{
+  if (dmaBus != nullptr)
+    HAL_DMA_IRQHandler(dmaBus->getHandle()->hdmarx);
+}
+
+#endif
@@ -0,0 +1,132 @@
+/*
+  This is a library written for the ST25DV64KC Dynamic RFID Tag.
+  SparkFun sells these at its website:
+  https://www.sparkfun.com/products/
+
+  Do you like this library? Help support open source hardware. Buy a board!
+
+  This file declares the bus interface the IO layer transfers through, the blocking Wire implementation
+  and the STM32 HAL DMA implementation.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SPARKFUN_ST25DV64KC_BUS_
+#define _SPARKFUN_ST25DV64KC_BUS_
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "constants.h"
+
+// Completion callback of an asynchronous transfer. DMA buses call it from interrupt context.
+typedef void (*SFE_ST25DV64KC_TransferCallback)(bool success, void *context);
+
+class SFE_ST25DV64KC_Bus
+{
+public:
+  virtual ~SFE_ST25DV64KC_Bus(){};
+
+  // Returns true if the device acknowledges its device select code.
+  virtual bool probe(uint8_t address) = 0;
+
+  // Blocking transfers at a 16 bit memory address. Return false on NACK or bus error.
+  virtual bool memRead(uint8_t address, uint16_t memAddress, uint8_t *buffer, uint16_t length) = 0;
+  virtual bool memWrite(uint8_t address, uint16_t memAddress, const uint8_t *buffer, uint16_t length) = 0;
+
+  // Asynchronous transfers. Return false if the transfer could not be started, otherwise the callback is called
+  // exactly once with the result. The buffer must stay untouched until then. One transfer can be pending at a time.
+  virtual bool memReadAsync(uint8_t address, uint16_t memAddress, uint8_t *buffer, uint16_t length, SFE_ST25DV64KC_TransferCallback callback, void *context) = 0;
+  virtual bool memWriteAsync(uint8_t address, uint16_t memAddress, const uint8_t *buffer, uint16_t length, SFE_ST25DV64KC_TransferCallback callback, void *context) = 0;
+
+  // True while an asynchronous transfer is pending.
+  virtual bool isBusy() = 0;
+
+  // Drives completion for buses that can't signal it from an interrupt.
+  virtual void poll(){};
+};
+
+// Reads go straight from the HAL I2C driver of the Wire instance into the caller's buffer
+#if defined(ARDUINO_ARCH_STM32) && defined(HAL_I2C_MODULE_ENABLED)
+#define SFE_ST25DV64KC_WIRE_HAL_READ
+#endif
+
+// Blocking transfers through TwoWire. Asynchronous transfers complete before the call returns.
+class SFE_ST25DV64KC_WireBus : public SFE_ST25DV64KC_Bus
+{
+public:
+  SFE_ST25DV64KC_WireBus() : _i2cPort(nullptr){};
+
+  void setPort(TwoWire &wirePort)
+  {
+    _i2cPort = &wirePort;
+  }
+
+  bool probe(uint8_t address) override;
+  bool memRead(uint8_t address, uint16_t memAddress, uint8_t *buffer, uint16_t length) override;
+  bool memWrite(uint8_t address, uint16_t memAddress, const uint8_t *buffer, uint16_t length) override;
+  bool memReadAsync(uint8_t address, uint16_t memAddress, uint8_t *buffer, uint16_t length, SFE_ST25DV64KC_TransferCallback callback, void *context) override;
+  bool memWriteAsync(uint8_t address, uint16_t memAddress, const uint8_t *buffer, uint16_t length, SFE_ST25DV64KC_TransferCallback callback, void *context) override;
+
+  bool isBusy() override
+  {
+    return false;
+  }
+
+protected:
+  TwoWire *_i2cPort;
+
+#ifdef SFE_ST25DV64KC_WIRE_HAL_READ
+  // A 256 byte mailbox read takes 23 ms at 100 kHz
+  static const uint32_t halReadTimeoutMs = 50;
+#endif
+};
+
+#if defined(I2C_DMA) && defined(HAL_I2C_MODULE_ENABLED) && defined(HAL_DMA_MODULE_ENABLED)
+#define SFE_ST25DV64KC_DMA_BUS_AVAILABLE
+
+// Transfers through the HAL I2C driver of the Wire instance. Asynchronous transfers use DMA1 channel 6 (TX) and
+// channel 7 (RX) of I2C1 (STM32L432). The event interrupt stays with the Wire library, which forwards it to the HAL.
+class SFE_ST25DV64KC_DMABus : public SFE_ST25DV64KC_Bus
+{
+public:
+  SFE_ST25DV64KC_DMABus(TwoWire &wirePort);
+
+  // Sets up the DMA channels, call after Wire.begin()
+  bool begin();
+
+  bool probe(uint8_t address) override;
+  bool memRead(uint8_t address, uint16_t memAddress, uint8_t *buffer, uint16_t length) override;
+  bool memWrite(uint8_t address, uint16_t memAddress, const uint8_t *buffer, uint16_t length) override;
+  bool memReadAsync(uint8_t address, uint16_t memAddress, uint8_t *buffer, uint16_t length, SFE_ST25DV64KC_TransferCallback callback, void *context) override;
+  bool memWriteAsync(uint8_t address, uint16_t memAddress, const uint8_t *buffer, uint16_t length, SFE_ST25DV64KC_TransferCallback callback, void *context) override;
+  bool isBusy() override;
+  void poll() override;
+
+  // Called by the HAL completion callbacks
+  void complete(I2C_HandleTypeDef *handle, bool success);
+
+  I2C_HandleTypeDef *getHandle()
+  {
+    return _handle;
+  }
+
+private:
+  static const uint32_t blockingTimeoutMs = 25;
+
+  TwoWire &_wirePort;
+  I2C_HandleTypeDef *_handle;
+  DMA_HandleTypeDef _dmaTx;
+  DMA_HandleTypeDef _dmaRx;
+
+  volatile bool _pending;
+  SFE_ST25DV64KC_TransferCallback _callback;
+  void *_context;
+};
+#endif
+
+#endif
@@ -21,45 +21,177 @@
 
 bool SFE_ST2525DV64KC_IO::begin(TwoWire &i2cPort)
 {
-  _i2cPort = &i2cPort;
+  _wireBus.setPort(i2cPort);
+  return begin(_wireBus);
+}
+
+bool SFE_ST2525DV64KC_IO::begin(SFE_ST25DV64KC_Bus &bus)
+{
+  _bus = &bus;
+  _trace.begin();
   return isConnected();
 }
 
 bool SFE_ST2525DV64KC_IO::isConnected()
 {
-  _i2cPort->beginTransmission(static_cast<int>(SF_ST25DV64KC_ADDRESS::SYSTEM));
-  return _i2cPort->endTransmission() == 0;
+  waitForTransfer();
+  return _bus->probe(static_cast<uint8_t>(SF_ST25DV64KC_ADDRESS::SYSTEM));
+}
+
+bool SFE_ST2525DV64KC_IO::isTransferPending()
+{
+  return _bus->isBusy() || _async.retryPending;
+}
+
+bool SFE_ST2525DV64KC_IO::isTransferInFlight()
+{
+  return _bus->isBusy();
+}
+
+void SFE_ST2525DV64KC_IO::waitForTransfer()
+{
+  _attempt = 0;
+
+  while (_bus->isBusy())
+    _bus->poll();
+
+  waitUntilReady();
+
+  if (!_async.retryPending)
+    return;
+
+  _async.retryPending = false;
+  bool success = _async.write ? writeMultipleBytesToBuffer(_async.buffer, _async.length) : readMultipleBytesFromBuffer(_async.buffer, _async.length);
+  if (_async.callback != nullptr)
+    _async.callback(success, _async.context);
+}
+
+bool SFE_ST2525DV64KC_IO::waitUntilReady()
+{
+  if (!_programming)
+    return true;
+
+  _programming = false;
+  uint32_t start = micros();
+  bool ready = pollForAck(ackPollTimeoutMicrosPerRow * _programmingRows);
+  uint32_t end = micros();
+
+  if (!ready)
+  {
+    _busyStatistics.timeouts++;
+    return false;
+  }
+
+  // Exact when called right after the write, otherwise the time until the IC was found ready again
+  uint32_t busyMicros = end - _programmingSince;
+  _busyStatistics.totalMicros += busyMicros;
+  if (busyMicros > _busyStatistics.maxMicros)
+    _busyStatistics.maxMicros = busyMicros;
+  _busyStatistics.waitMicros += end - start;
+  return true;
+}
+
+bool SFE_ST2525DV64KC_IO::pollForAck(uint32_t timeoutMicros)
+{
+  // The IC NACKs its device select code until the write cycle has finished
+  uint32_t start = micros();
+  while (!_bus->probe(static_cast<uint8_t>(SF_ST25DV64KC_ADDRESS::SYSTEM)))
+  {
+    _busyStatistics.polls++;
+    if (micros() - start >= timeoutMicros)
+      return false;
+  }
+  return true;
+}
+
+void SFE_ST2525DV64KC_IO::retryWait()
+{
+  _trace.countRetry();
+  if (_attempt < 0xFF)
+    _attempt++;
+  pollForAck((uint32_t)retryDelay * 1000);
+}
+
+bool SFE_ST2525DV64KC_IO::busRead(const SF_ST25DV64KC_ADDRESS address, const uint16_t registerAddress, uint8_t *const buffer, uint16_t length)
+{
+  waitUntilReady();
+
+  uint32_t start = SFE_ST25DV64KC_Trace::now();
+  bool success = _bus->memRead(static_cast<uint8_t>(address), registerAddress, buffer, length);
+  _trace.record((address == SF_ST25DV64KC_ADDRESS::SYSTEM ? SFE_ST25DV64KC_Trace::TRACE_SYSTEM : 0) | (success ? 0 : SFE_ST25DV64KC_Trace::TRACE_NACK),
+                registerAddress, length, _attempt, start);
+  if (success)
+    _attempt = 0;
+  return success;
+}
+
+bool SFE_ST2525DV64KC_IO::busWrite(const SF_ST25DV64KC_ADDRESS address, const uint16_t registerAddress, const uint8_t *const buffer, uint16_t length)
+{
+  waitUntilReady();
+
+  uint32_t start = SFE_ST25DV64KC_Trace::now();
+  bool success = _bus->memWrite(static_cast<uint8_t>(address), registerAddress, buffer, length);
+  _trace.record(SFE_ST25DV64KC_Trace::TRACE_WRITE | (address == SF_ST25DV64KC_ADDRESS::SYSTEM ? SFE_ST25DV64KC_Trace::TRACE_SYSTEM : 0) | (success ? 0 : SFE_ST25DV64KC_Trace::TRACE_NACK),
+                registerAddress, length, _attempt, start);
+  if (!success)
+    return false;
+  _attempt = 0;
+
+  // User memory and system configuration are EEPROM, dynamic registers and mailbox are not
+  if (address == SF_ST25DV64KC_ADDRESS::SYSTEM || registerAddress < EEPROM_SIZE)
+  {
+    _programming = true;
+    _programmingSince = micros();
+    if (address == SF_ST25DV64KC_ADDRESS::SYSTEM)
+      _programmingRows = 1;
+    else
+      _programmingRows = rowsTouched(registerAddress, length);
+    _busyStatistics.writeCycles++;
+    _busyStatistics.programCycles += _programmingRows;
+  }
+  return true;
+}
+
+uint16_t SFE_ST2525DV64KC_IO::rowsTouched(uint16_t address, uint16_t length)
+{
+  if (length == 0)
+    return 0;
+  return (address + length - 1) / EEPROM_ROW_SIZE - address / EEPROM_ROW_SIZE + 1;
+}
+
+void SFE_ST2525DV64KC_IO::asyncTransferDone(bool success, void *context)
+{
+  SFE_ST2525DV64KC_IO *io = static_cast<SFE_ST2525DV64KC_IO *>(context);
+  io->_trace.record(SFE_ST25DV64KC_Trace::TRACE_ASYNC | (io->_async.write ? SFE_ST25DV64KC_Trace::TRACE_WRITE : 0) | (success ? 0 : SFE_ST25DV64KC_Trace::TRACE_NACK),
+                    MAILBOX_BASE, io->_async.length, 0, io->_async.start);
+  if (!success)
+  {
+    // Can't wait for the IC here (interrupt context), leave it to waitForTransfer()
+    io->_async.retryPending = true;
+    return;
+  }
+
+  if (io->_async.callback != nullptr)
+    io->_async.callback(true, io->_async.context);
 }
 
 bool SFE_ST2525DV64KC_IO::writeMultipleBytes(const SF_ST25DV64KC_ADDRESS address, const uint16_t registerAddress, uint8_t *const buffer, uint16_t const packetLength)
 {
+  waitForTransfer();
+
   // Split long writes up into multiple chunks
   uint16_t bytesWritten = 0;
 
-  // If the IC is busy - e.g. completing a previous write - the I2C transmission is NACK'd and fails.
-  // For each chunk: try up to maxRetries times, waiting retryDelay ms between tries.
+  // If the IC is busy - e.g. completing a write started through RF - the I2C transmission is NACK'd and fails.
+  // For each chunk: try up to maxRetries times, ACK polling up to retryDelay ms between tries.
   bool result = true;
   uint8_t maxTries = maxRetries;
 
   while ((bytesWritten < packetLength) && (result))
   {
-    uint8_t bytesToWrite; // Write the data in chunks of readWriteChunkSize max
-    if ((packetLength - bytesWritten) > ((uint16_t)readWriteChunkSize))
-      bytesToWrite = readWriteChunkSize - 2; // Write a maximum of readWriteChunkSize bytes total - including the register address
-    else
-      bytesToWrite = packetLength - bytesWritten;
-
-    _i2cPort->beginTransmission(static_cast<int>(address));
-
-    uint8_t temp = static_cast<uint16_t>(registerAddress + bytesWritten) >> 8;
-    _i2cPort->write(temp);
-    temp = (registerAddress + bytesWritten) & 0xff;
-    _i2cPort->write(temp);
-
-    for (uint16_t i = 0; i < bytesToWrite; i++)
-      _i2cPort->write(buffer[i + bytesWritten]);
+    uint16_t bytesToWrite = writeChunkLength(address, registerAddress + bytesWritten, packetLength - bytesWritten);
 
-    bool success = (_i2cPort->endTransmission() == 0);
+    bool success = busWrite(address, registerAddress + bytesWritten, buffer + bytesWritten, bytesToWrite);
 
     if (success)
     {
@@ -72,26 +204,45 @@ bool SFE_ST2525DV64KC_IO::writeMultipleBytes(const SF_ST25DV64KC_ADDRESS address
       if (maxTries == 0)
         result = false;
       else
-        delay(retryDelay);
+        retryWait();
     }
   }
 
   return result;
 }
 
+uint16_t SFE_ST2525DV64KC_IO::writeChunkLength(const SF_ST25DV64KC_ADDRESS address, const uint16_t registerAddress, uint16_t remaining)
+{
+  if (address == SF_ST25DV64KC_ADDRESS::DATA && registerAddress < EEPROM_SIZE)
+  {
+    // As much as the TX buffer holds, ending on a row boundary unless it is the last chunk, so no row is
+    // programmed twice
+    uint16_t length = remaining < maxWriteChunkSize ? remaining : maxWriteChunkSize;
+    if (length < remaining)
+    {
+      uint16_t end = (registerAddress + length) & ~(EEPROM_ROW_SIZE - 1);
+      if (end > registerAddress)
+        length = end - registerAddress;
+    }
+    return length;
+  }
+
+  // Write a maximum of readWriteChunkSize bytes total - including the register address
+  if (remaining > ((uint16_t)readWriteChunkSize))
+    return readWriteChunkSize - 2;
+  return remaining;
+}
+
 bool SFE_ST2525DV64KC_IO::writeMultipleBytesToBuffer(uint8_t *const buffer, uint16_t packetLength)
 {
+  waitForTransfer();
+
   packetLength %= 257;
   uint8_t maxTries = maxRetries;
 
   while (maxTries > 0)
   {
-    _i2cPort->beginTransmission(static_cast<int>(SF_ST25DV64KC_ADDRESS::DATA));
-    _i2cPort->write(MAILBOX_BASE >> 8);
-    _i2cPort->write(MAILBOX_BASE & 0xFF);
-    _i2cPort->write(buffer, packetLength);
-
-    if (_i2cPort->endTransmission() == 0)
+    if (busWrite(SF_ST25DV64KC_ADDRESS::DATA, MAILBOX_BASE, buffer, packetLength))
     {
       return true;
     }
@@ -99,58 +250,58 @@ bool SFE_ST2525DV64KC_IO::writeMultipleBytesToBuffer(uint8_t *const buffer, uint
     {
       maxTries--;
       if (maxTries > 0)
-        delay(retryDelay);
+        retryWait();
     }
   }
 
   return false;
 }
 
+bool SFE_ST2525DV64KC_IO::writeMultipleBytesToBufferAsync(uint8_t *const buffer, uint16_t packetLength, SFE_ST25DV64KC_TransferCallback callback, void *context)
+{
+  waitForTransfer();
+
+  packetLength %= 257;
+  _async.write = true;
+  _async.buffer = buffer;
+  _async.length = packetLength;
+  _async.callback = callback;
+  _async.context = context;
+  _async.start = micros();
+  return _bus->memWriteAsync(static_cast<uint8_t>(SF_ST25DV64KC_ADDRESS::DATA), MAILBOX_BASE, buffer, packetLength, &asyncTransferDone, this);
+}
+
 bool SFE_ST2525DV64KC_IO::readMultipleBytes(const SF_ST25DV64KC_ADDRESS address, const uint16_t registerAddress, uint8_t *const buffer, uint16_t packetLength)
 {
+  waitForTransfer();
+
   bool success = true; // Return true if packetLength is zero
 
   // Split long reads up into multiple chunks
   uint16_t bytesRead = 0;
 
-  // If the IC is busy - e.g. completing a previous write - the I2C transmission is NACK'd and fails.
-  // For each chunk: try up to maxRetries times, waiting retryDelay ms between tries.
+  // If the IC is busy - e.g. completing a write started through RF - the I2C transmission is NACK'd and fails.
+  // For each chunk: try up to maxRetries times, ACK polling up to retryDelay ms between tries.
   uint8_t maxTries = maxRetries;
 
   while ((bytesRead < packetLength) && (maxTries > 0))
   {
-    uint8_t bytesToRead; // Read the data in chunks of readWriteChunkSize max
-    if ((packetLength - bytesRead) > ((uint16_t)readWriteChunkSize))
-      bytesToRead = readWriteChunkSize;
+    uint16_t bytesToRead; // Read the data in chunks of maxReadChunkSize max
+    if ((packetLength - bytesRead) > maxReadChunkSize)
+      bytesToRead = maxReadChunkSize;
     else
       bytesToRead = packetLength - bytesRead;
 
-    _i2cPort->beginTransmission(static_cast<int>(address));
-
-    uint8_t temp = static_cast<uint16_t>(registerAddress + bytesRead) >> 8;
-    _i2cPort->write(temp);
-    temp = (registerAddress + bytesRead) & 0xff;
-    _i2cPort->write(temp);
-
-    success = (_i2cPort->endTransmission() == 0);
+    success = busRead(address, registerAddress + bytesRead, buffer + bytesRead, bytesToRead);
 
     if (success)
     {
-      success = (_i2cPort->requestFrom(static_cast<int>(address), static_cast<int>(bytesToRead)) == bytesToRead);
-
-      if (success)
-      {
-        for (uint16_t i = 0; i < bytesToRead; i++)
-          buffer[i + bytesRead] = _i2cPort->read();
-
-        bytesRead += bytesToRead;
-        maxTries = maxRetries;
-      }
+      bytesRead += bytesToRead;
+      maxTries = maxRetries;
     }
-
-    if (!success)
+    else
     {
-      delay(retryDelay);
+      retryWait();
       maxTries--;
     }
   }
@@ -160,64 +311,54 @@ bool SFE_ST2525DV64KC_IO::readMultipleBytes(const SF_ST25DV64KC_ADDRESS address,
 
 bool SFE_ST2525DV64KC_IO::readMultipleBytesFromBuffer(uint8_t *const buffer, uint16_t packetLength)
 {
+  waitForTransfer();
+
   packetLength %= 257;
   uint8_t maxTries = maxRetries;
 
   while (maxTries > 0)
   {
-    _i2cPort->beginTransmission(static_cast<int>(SF_ST25DV64KC_ADDRESS::DATA));
-    _i2cPort->write(MAILBOX_BASE >> 8);
-    _i2cPort->write(MAILBOX_BASE & 0xFF);
-
-    if (_i2cPort->endTransmission() == 0)
-    {
-      if (_i2cPort->requestFrom(static_cast<int>(SF_ST25DV64KC_ADDRESS::DATA), static_cast<int>(packetLength)) == packetLength)
-      {
-        for (uint8_t i = 0; i < packetLength && _i2cPort->available(); i++)
-          buffer[i] = _i2cPort->read();
-
-        if (_i2cPort->endTransmission() == 0)
-          return true;
-      }
-    }
+    if (busRead(SF_ST25DV64KC_ADDRESS::DATA, MAILBOX_BASE, buffer, packetLength))
+      return true;
 
     maxTries--;
     if (maxTries > 0)
-      delay(retryDelay);
+      retryWait();
   }
 
   return false;
 }
 
+bool SFE_ST2525DV64KC_IO::readMultipleBytesFromBufferAsync(uint8_t *const buffer, uint16_t packetLength, SFE_ST25DV64KC_TransferCallback callback, void *context)
+{
+  waitForTransfer();
+
+  packetLength %= 257;
+  _async.write = false;
+  _async.buffer = buffer;
+  _async.length = packetLength;
+  _async.callback = callback;
+  _async.context = context;
+  _async.start = micros();
+  return _bus->memReadAsync(static_cast<uint8_t>(SF_ST25DV64KC_ADDRESS::DATA), MAILBOX_BASE, buffer, packetLength, &asyncTransferDone, this);
+}
+
 bool SFE_ST2525DV64KC_IO::readSingleByte(const SF_ST25DV64KC_ADDRESS address, const uint16_t registerAddress, uint8_t *value)
 {
-  // If the IC is busy - e.g. completing a previous write - the I2C transmission is NACK'd and fails.
-  // Try up to maxRetries times, waiting retryDelay ms between tries.
+  waitForTransfer();
+
+  // If the IC is busy - e.g. completing a write started through RF - the I2C transmission is NACK'd and fails.
+  // Try up to maxRetries times, ACK polling up to retryDelay ms between tries.
   uint8_t maxTries = maxRetries;
   bool success = false;
 
   while ((maxTries > 0) && (!success))
   {
-    _i2cPort->beginTransmission(static_cast<int>(address));
-
-    uint8_t temp = static_cast<uint16_t>(registerAddress) >> 8;
-    _i2cPort->write(temp);
-    temp = (registerAddress)&0xff;
-    _i2cPort->write(temp);
-
-    success = (_i2cPort->endTransmission() == 0);
-
-    if (success)
-    {
-      success = (_i2cPort->requestFrom(static_cast<int>(address), 1U) == 1U);
-
-      if (success)
-        *value = _i2cPort->read();
-    }
+    success = busRead(address, registerAddress, value, 1);
 
     if (!success)
     {
-      delay(retryDelay);
+      retryWait();
       maxTries--;
     }
   }
@@ -227,27 +368,20 @@ bool SFE_ST2525DV64KC_IO::readSingleByte(const SF_ST25DV64KC_ADDRESS address, co
 
 bool SFE_ST2525DV64KC_IO::writeSingleByte(const SF_ST25DV64KC_ADDRESS address, const uint16_t registerAddress, const uint8_t value)
 {
-  // If the IC is busy - e.g. completing a previous write - the I2C transmission is NACK'd and fails.
-  // Try up to maxRetries times, waiting retryDelay ms between tries.
+  waitForTransfer();
+
+  // If the IC is busy - e.g. completing a write started through RF - the I2C transmission is NACK'd and fails.
+  // Try up to maxRetries times, ACK polling up to retryDelay ms between tries.
   uint8_t maxTries = maxRetries;
   bool success = false;
 
   while ((maxTries > 0) && (!success))
   {
-    _i2cPort->beginTransmission(static_cast<int>(address));
-
-    uint8_t temp = static_cast<uint16_t>(registerAddress) >> 8;
-    _i2cPort->write(temp);
-    temp = registerAddress & 0xff;
-    _i2cPort->write(temp);
-
-    _i2cPort->write(value);
-
-    success = (_i2cPort->endTransmission() == 0);
+    success = busWrite(address, registerAddress, &value, 1);
 
     if (!success)
     {
-      delay(retryDelay);
+      retryWait();
       maxTries--;
     }
   }
@@ -22,13 +22,68 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include "SparkFun_ST25DV64KC_Arduino_Library_Constants.h"
+#include "SparkFun_ST25DV64KC_Bus.h"
+#include "SparkFun_ST25DV64KC_Trace.h"
+
+// Largest transmission the Wire TX buffer holds (STM32duino grows its buffer up to WIRE_MAX_TX_BUFF_LENGTH)
+#if defined(WIRE_MAX_TX_BUFF_LENGTH)
+#define SFE_ST25DV64KC_WIRE_TX_BUFFER_LENGTH WIRE_MAX_TX_BUFF_LENGTH
+#elif defined(BUFFER_LENGTH)
+#define SFE_ST25DV64KC_WIRE_TX_BUFFER_LENGTH BUFFER_LENGTH
+#else
+#define SFE_ST25DV64KC_WIRE_TX_BUFFER_LENGTH 32
+#endif
 
 class SFE_ST2525DV64KC_IO
 {
+public:
+  struct BusyStatistics
+  {
+    uint32_t writeCycles;   // writes that started an EEPROM write cycle
+    uint32_t programCycles; // EEPROM rows (or configuration registers) programmed by these writes
+    uint32_t polls;         // device selects sent while the IC was busy
+    uint32_t timeouts;
+    uint32_t totalMicros; // end of write to first ACK
+    uint32_t maxMicros;
+    uint32_t waitMicros; // time callers were blocked polling
+  };
+
 private:
-  TwoWire *_i2cPort;
+  SFE_ST25DV64KC_Bus *_bus;
+  SFE_ST25DV64KC_WireBus _wireBus;
+
+  // Pending asynchronous mailbox transfer. A failed transfer is retried blocking by waitForTransfer().
+  struct AsyncTransfer
+  {
+    bool write;
+    uint8_t *buffer;
+    uint16_t length;
+    SFE_ST25DV64KC_TransferCallback callback;
+    void *context;
+    uint32_t start; // micros(), the core may sleep until the transfer is done
+    volatile bool retryPending;
+  };
+  AsyncTransfer _async = {};
+
+  static void asyncTransferDone(bool success, void *context);
+
+  // An EEPROM write cycle started by the last write, polled for completion before the next transfer
+  bool _programming = false;
+  uint32_t _programmingSince = 0;
+  uint16_t _programmingRows = 0;
+  BusyStatistics _busyStatistics = {};
+
+  SFE_ST25DV64KC_Trace _trace;
+  uint8_t _attempt = 0; // retries of the current transfer, for the trace
+
+  bool busRead(const SF_ST25DV64KC_ADDRESS address, const uint16_t registerAddress, uint8_t *const buffer, uint16_t length);
+  bool busWrite(const SF_ST25DV64KC_ADDRESS address, const uint16_t registerAddress, const uint8_t *const buffer, uint16_t length);
+  bool pollForAck(uint32_t timeoutMicros);
+  uint16_t writeChunkLength(const SF_ST25DV64KC_ADDRESS address, const uint16_t registerAddress, uint16_t remaining);
+  void retryWait();
 
 public:
+
   // Default constructor.
   SFE_ST2525DV64KC_IO(){};
 
@@ -40,9 +95,22 @@ public:
   const uint8_t maxRetries = 6;
   const uint8_t retryDelay = 5;
 
+  // Largest user memory write chunk, sized to the Wire TX buffer minus the register address
+  const uint16_t maxWriteChunkSize = (SFE_ST25DV64KC_WIRE_TX_BUFFER_LENGTH - 2 < MAX_SEQUENTIAL_WRITE_SIZE) ? SFE_ST25DV64KC_WIRE_TX_BUFFER_LENGTH - 2 : MAX_SEQUENTIAL_WRITE_SIZE;
+
+  // Longest read in one transfer. Unlike writes, reads do not go through the Wire TX buffer; requestFrom() takes
+  // a uint8_t count though.
+  const uint16_t maxReadChunkSize = 0xFF;
+
+  // ACK polling budget for the end of an EEPROM write cycle, per row programmed (5 ms max per 16 byte row)
+  const uint32_t ackPollTimeoutMicrosPerRow = 7000;
+
   // Starts two wire interface.
   bool begin(TwoWire &wirePort);
 
+  // Starts on an arbitrary bus, e.g. the DMA bus or a host side mock.
+  bool begin(SFE_ST25DV64KC_Bus &bus);
+
   // Returns true if we get a reply from the I2C device.
   bool isConnected();
 
@@ -67,6 +135,45 @@ public:
   // Writes multiple bytes to mailbox from buffer uint8_t array.
   bool writeMultipleBytesToBuffer(uint8_t *const buffer, uint16_t packetLength);
 
+  // Asynchronous mailbox transfers. Return false if the transfer could not be started, otherwise callback is
+  // called once with the result (from interrupt context on DMA buses). The buffer must stay untouched until then.
+  // A NACK'd transfer is retried blocking by the next waitForTransfer().
+  bool readMultipleBytesFromBufferAsync(uint8_t *const buffer, uint16_t packetLength, SFE_ST25DV64KC_TransferCallback callback, void *context);
+  bool writeMultipleBytesToBufferAsync(uint8_t *const buffer, uint16_t packetLength, SFE_ST25DV64KC_TransferCallback callback, void *context);
+
+  // Returns true while an asynchronous transfer is pending.
+  bool isTransferPending();
+
+  // Returns true while an asynchronous transfer is on the bus. A pending transfer that is not has failed and
+  // waits for its retry by waitForTransfer().
+  bool isTransferInFlight();
+
+  // Blocks until a pending asynchronous transfer has finished. Called by every blocking transfer.
+  void waitForTransfer();
+
+  // Blocks until the IC acknowledges again after an EEPROM write. Returns false if the budget ran out.
+  bool waitUntilReady();
+
+  // Busy times observed through ACK polling
+  inline const BusyStatistics &getBusyStatistics()
+  {
+    return _busyStatistics;
+  }
+
+  // Transfer counters and the most recent transfers
+  inline SFE_ST25DV64KC_Trace &getTrace()
+  {
+    return _trace;
+  }
+
+  inline void resetBusyStatistics()
+  {
+    _busyStatistics = {};
+  }
+
+  // User memory rows a write of length bytes at address programs
+  static uint16_t rowsTouched(uint16_t address, uint16_t length);
+
   // Sets a single bit in a specific register. Bit position ranges from 0 (lsb) to 7 (msb).
   bool setRegisterBit(const SF_ST25DV64KC_ADDRESS address, const uint16_t registerAddress, const uint8_t bitMask);
 
@@ -172,6 +172,148 @@ bool SFE_ST25DV64KC_NDEF::writeNDEFEmpty(uint16_t *address)
   return result;
 }
 
+// Returns true if user memory holds bytes at [from, to), as far as the copy in _ndefIndex tells
+bool SFE_ST25DV64KC_NDEF::matchesNDEFIndex(uint16_t from, uint16_t to, const uint8_t *bytes)
+{
+  if (_ndefHeaderLength == 0)
+    return false;
+
+  uint8_t header[4] = {SFE_ST25DV_TYPE5_NDEF_MESSAGE_TLV, (uint8_t)_ndefLength};
+  if (_ndefHeaderLength == 4)
+  {
+    header[1] = 0xFF;
+    header[2] = _ndefLength >> 8;
+    header[3] = _ndefLength & 0xFF;
+  }
+  uint16_t messageStart = _ccFileLen + _ndefHeaderLength;
+  uint16_t messageEnd = messageStart + _ndefLength;
+  const uint8_t *message = _ndefIndex.buffer();
+
+  for (uint16_t address = from; address < to; address++)
+  {
+    uint8_t stored;
+    if (address < _ccFileLen)
+      return false;
+    else if (address < messageStart)
+      stored = header[address - _ccFileLen];
+    else if (address < messageEnd)
+      stored = message[address - messageStart];
+    else if ((address == messageEnd) && _ndefTerminated)
+      stored = SFE_ST25DV_TYPE5_TERMINATOR_TLV;
+    else
+      return false;
+
+    if (stored != bytes[address - from])
+      return false;
+  }
+  return true;
+}
+
+// Returns true if user memory already holds the composed message
+bool SFE_ST25DV64KC_NDEF::isNDEFMessageWritten(SFE_ST25DV64KC_NDEFComposer &composer, uint16_t *address)
+{
+  if (!composer.finish())
+    return false;
+
+  uint16_t memLoc = (address != NULL) ? *address : _ccFileLen;
+  if ((memLoc != _ccFileLen) || !loadNDEFIndex())
+    return false;
+
+  return matchesNDEFIndex(memLoc, memLoc + composer.getLength(), composer.getMessage());
+}
+
+// Finish a composed NDEF message and write the rows of user memory it changes
+bool SFE_ST25DV64KC_NDEF::writeNDEFMessage(SFE_ST25DV64KC_NDEFComposer &composer, uint16_t *address, NDEFWriteReport *report)
+{
+  NDEFWriteReport localReport;
+  if (report == NULL)
+    report = &localReport;
+  memset(report, 0, sizeof(*report));
+
+  if (!composer.finish())
+  {
+#ifdef DEBUG
+    SAFE_CALLBACK(_errorCallback, SF_ST25DV64KC_ERROR::OUT_OF_MEMORY);
+#endif
+    return false; // The records did not fit into the composer's buffer
+  }
+
+  uint16_t memLoc = _ccFileLen; // Write to this memory location
+  if (address != NULL)
+    memLoc = *address;
+
+  const uint8_t *message = composer.getMessage();
+  uint16_t length = composer.getLength();
+  uint16_t end = memLoc + length;
+  bool result = true;
+
+  bool compared = (memLoc == _ccFileLen) && loadNDEFIndex() && (_ndefHeaderLength != 0);
+  if (!compared)
+  {
+    // No copy to compare against: write everything. writeEEPROM does not modify the data.
+    result = writeEEPROM(memLoc, (uint8_t *)message, length);
+    report->bytes = length;
+    report->ranges = 1;
+    report->rowsWritten = SFE_ST2525DV64KC_IO::rowsTouched(memLoc, length);
+  }
+  else
+  {
+    // Row by row: a row whose bytes all match is skipped, consecutive changed rows are written together
+    uint16_t rangeStart = 0;
+    bool inRange = false;
+    for (uint16_t row = memLoc & ~(EEPROM_ROW_SIZE - 1); row < end; row += EEPROM_ROW_SIZE)
+    {
+      uint16_t from = (row > memLoc) ? row : memLoc;
+      uint16_t to = (row + EEPROM_ROW_SIZE < end) ? row + EEPROM_ROW_SIZE : end;
+      bool changed = !matchesNDEFIndex(from, to, &message[from - memLoc]);
+
+      if (changed)
+      {
+        report->rowsWritten++;
+        if (!inRange)
+          rangeStart = from;
+        inRange = true;
+      }
+      else
+        report->rowsUnchanged++;
+
+      if (inRange && (!changed || (to == end)))
+      {
+        uint16_t rangeEnd = changed ? to : from;
+        result &= writeEEPROM(rangeStart, (uint8_t *)&message[rangeStart - memLoc], rangeEnd - rangeStart);
+        report->bytes += rangeEnd - rangeStart;
+        report->ranges++;
+        inRange = false;
+      }
+    }
+  }
+
+  if (!result)
+  {
+    _ndefIndexBuilt = false;
+    return false;
+  }
+
+  // The index takes the written message, so the readers and the next write need not read it back
+  uint8_t headerLength = (message[1] == 0xFF) ? 4 : 2;
+  uint16_t ndefLength = length - headerLength - 1;
+  if ((memLoc == _ccFileLen) && (ndefLength <= SFE_ST25DV64KC_NDEFIndex::CAPACITY))
+  {
+    memcpy(_ndefIndex.buffer(), &message[headerLength], ndefLength);
+    _ndefIndex.parse(ndefLength);
+    _ndefIndexBuilt = true;
+    _ndefIndexWriteCount = getUserMemoryWriteCount();
+    _ndefHeaderLength = headerLength;
+    _ndefLength = ndefLength;
+    _ndefTerminated = true;
+  }
+
+  if (address != NULL)
+    *address = memLoc + length - 1; // Point to the terminator
+
+  return result;
+}
+
 /*
   To create a single NDEF URI short record:
 
@@ -358,264 +500,21 @@ bool SFE_ST25DV64KC_NDEF::writeNDEFURI(const char *uri, uint8_t idCode, uint16_t
 // Returns true if successful, otherwise false
 bool SFE_ST25DV64KC_NDEF::readNDEFURI(char *theURI, uint16_t maxURILen, uint8_t recordNo)
 {
-  uint8_t tlv[4];
-
-  if (!readEEPROM(_ccFileLen, tlv, 4)) // Read the TLV T and L Fields
-    return false;                      // readEEPROM failed
-
-  if (tlv[0] != SFE_ST25DV_TYPE5_NDEF_MESSAGE_TLV) // Check for 0x03
-    return false;
-
-  uint16_t lengthField, eepromAddress;
-
-  if (tlv[1] == 0xFF) // Check for 3-byte length
+  SFE_ST25DV64KC_NDEFIndex *index = getNDEFIndex();
+  if (index != NULL)
   {
-    lengthField = ((uint16_t)tlv[2]) << 8; // 3-byte length
-    lengthField |= tlv[3];
-    eepromAddress = _ccFileLen + 4;
-  }
-  else
-  {
-    lengthField = tlv[1]; // 1-byte length
-    eepromAddress = _ccFileLen + 2;
+    const uint8_t type[] = {SFE_ST25DV_NDEF_URI_RECORD};
+    const SFE_ST25DV64KC_NDEFIndex::Record *record = index->find(SFE_ST25DV_NDEF_TNF_WELL_KNOWN, type, sizeof(type), recordNo);
+    if (record == NULL)
+      return false;
+    SFE_ST25DV64KC_NDEFSegmentSource payload = index->getPayload(*record);
+    return decodeURIPayload(payload, theURI, maxURILen);
   }
 
-  enum
-  {
-    readRecordHeader,
-    readTypeLength,
-    readPayloadLength,
-    readIDLength,
-    readType,
-    matchFoundCheckRecordNo,
-    readAndIgnoreID,
-    readAndIgnorePayload,
-    readPayload,
-    checkEntry,
-    terminatorFound,
-    allDone
-  } loopState = readRecordHeader; // TO DO: handle chunks!
-
-  bool shortRecord;
-  bool hasIDLength;
-  uint8_t typeLength;
-  uint8_t idLength;
-  uint32_t payloadLength;
-  uint8_t thisRecord = 0;
-  uint8_t *payload = NULL;
-  uint8_t tnf;
-
-  while (1)
-  {
-    switch (loopState)
-    {
-      case readRecordHeader:
-        {
-          uint8_t header[1];
-          if (!readEEPROM(eepromAddress, header, 1)) // Read the header
-          {
-            if (payload != NULL)
-              delete[] payload;
-            return false;
-          }
-          eepromAddress++;                                                      // Point to the Type Length
-          shortRecord = (header[0] & SFE_ST25DV_NDEF_SR) == SFE_ST25DV_NDEF_SR; // Is this a short record?
-          hasIDLength = (header[0] & SFE_ST25DV_NDEF_IL) == SFE_ST25DV_NDEF_IL; // Is there an ID length?
-          tnf = header[0] & 0x7;                                                // Extract the TNF
-          // Check for a terminator
-          // Also sanity check that eepromAddress is within bounds
-          if ((tnf == SFE_ST25DV_TYPE5_TERMINATOR_TLV) || (eepromAddress > (_ccFileLen + 4 + lengthField)))
-            loopState = terminatorFound;
-          else
-            loopState = readTypeLength;
-        }
-        break;
-      case readTypeLength:
-        {
-          uint8_t typeLen[1];
-          if (!readEEPROM(eepromAddress, typeLen, 1)) // Read the Type Length
-          {
-            if (payload != NULL)
-              delete[] payload;
-            return false;
-          }
-          typeLength = typeLen[0];
-          eepromAddress++; // Point to the Payload Length
-          loopState = readPayloadLength;
-        }
-        break;
-      case readPayloadLength:
-        {
-          uint8_t payloadLenBytes[4];
-          if (shortRecord)
-          {
-            if (!readEEPROM(eepromAddress, payloadLenBytes, 1)) // Read the Payload Length
-            {
-              if (payload != NULL)
-                delete[] payload;
-              return false;
-            }
-            eepromAddress++; // Point to the ID Length
-            payloadLength = payloadLenBytes[0];
-          }
-          else
-          {
-            if (!readEEPROM(eepromAddress, payloadLenBytes, 4)) // Read the Payload Length
-            {
-              if (payload != NULL)
-                delete[] payload;
-              return false;
-            }
-            eepromAddress += 4; // Point to the ID Length
-            payloadLength = ((uint32_t)payloadLenBytes[0]) << 24;
-            payloadLength |= ((uint32_t)payloadLenBytes[1]) << 16;
-            payloadLength |= ((uint32_t)payloadLenBytes[2]) << 8;
-            payloadLength |= payloadLenBytes[3];
-          }
-          loopState = readIDLength;
-        }
-        break;
-      case readIDLength:
-        {
-          if (hasIDLength)
-          {
-            uint8_t idLen[1];
-            if (!readEEPROM(eepromAddress, idLen, 1)) // Read the ID Length
-            {
-              if (payload != NULL)
-                delete[] payload;
-              return false;
-            }
-            idLength = idLen[0];
-            eepromAddress++; // Point to the Type
-          }
-          else
-            idLength = 0;
-          if (typeLength == 0) // If typeLength is zero, this cannot be a Text Record
-            loopState = readAndIgnoreID;
-          else
-            loopState = readType;
-        }
-        break;
-      case readType:
-        {
-          uint8_t theType[typeLength + 1];                     // Add 1 extra for a NULL
-          if (!readEEPROM(eepromAddress, theType, typeLength)) // Read the Type
-          {
-            if (payload != NULL)
-              delete[] payload;
-            return false;
-          }
-          theType[typeLength] = 0;                                                                   // Null-terminate the Type
-          eepromAddress += typeLength;                                                               // Point to the ID
-          if ((theType[0] == SFE_ST25DV_NDEF_URI_RECORD) && (tnf == SFE_ST25DV_NDEF_TNF_WELL_KNOWN)) // Check for a Type match
-            loopState = matchFoundCheckRecordNo;
-          else
-            loopState = readAndIgnoreID;
-        }
-        break;
-      case readAndIgnoreID:
-        {
-          if (hasIDLength && (idLength > 0))
-          {
-            eepromAddress += idLength; // Skip over the ID Length
-          }
-          loopState = readAndIgnorePayload;
-        }
-        break;
-      case readAndIgnorePayload:
-        {
-          if (payloadLength > 0)
-          {
-            eepromAddress += payloadLength; // Skip over the Payload. No need to read it.
-          }
-          loopState = readRecordHeader; // Move on to the next record
-        }
-        break;
-      case matchFoundCheckRecordNo:
-        {
-          if (hasIDLength && (idLength > 0))
-          {
-            eepromAddress += idLength; // Skip over the ID Length. Point to the payload
-          }
-          thisRecord++; // Increment the record number
-          if (thisRecord == recordNo)
-            loopState = readPayload;
-          else
-            loopState = readAndIgnorePayload;
-        }
-        break;
-      case readPayload:
-        {
-          if (payload != NULL) // Delete any existing payload
-            delete[] payload;
-          payload = new uint8_t[payloadLength]; // Create storage for the payload
-          if (payload == NULL)
-          {
-#ifdef DEBUG
-            SAFE_CALLBACK(_errorCallback, SF_ST25DV64KC_ERROR::OUT_OF_MEMORY);
-#endif
-            return false; // Memory allocation failed
-          }
-
-          if (!readEEPROM(eepromAddress, payload, payloadLength)) // Read the Payload
-          {
-            if (payload != NULL)
-              delete[] payload;
-            return false;
-          }
-          eepromAddress += payloadLength;
-          loopState = checkEntry;
-        }
-        break;
-      case checkEntry:
-        {
-          if ((*payload) > SFE_ST25DV_NDEF_URI_ID_CODE_URN_NFC) // If the UTF-16 bit is set
-          {
-            loopState = terminatorFound; // Bail...
-          }
-          else
-          {
-            if (maxURILen > strlen(getURIPrefix(*payload))) // Is there enough room to hold the prefix?
-            {
-              strcpy(theURI, getURIPrefix(*payload));      // Copy the prefix
-              maxURILen -= strlen(getURIPrefix(*payload)); // Reduce maxURILen
-
-              uint16_t theTextLen = payloadLength - 1;
-              if (theTextLen <= (maxURILen - 1)) // Is there enough space left to store the URI?
-              {
-                memcpy(&theURI[strlen(getURIPrefix(*payload))], payload + 1, theTextLen);
-                theURI[strlen(getURIPrefix(*payload)) + theTextLen] = 0; // NULL-terminate the text
-                loopState = allDone;
-              }
-              else
-              {
-                loopState = terminatorFound; // Not enough room to store theText. Bail...
-              }
-            }
-            else
-            {
-              loopState = terminatorFound; // Not enough room to store theText. Bail...
-            }
-          }
-        }
-        break;
-      case terminatorFound:
-        {
-          if (payload != NULL)
-            delete[] payload;
-          return false;
-        }
-        break;
-      case allDone:
-        {
-          if (payload != NULL)
-            delete[] payload;
-          return true;
-        }
-        break;
-    }
-  }
+  // The message could not be indexed: stream it from the EEPROM
+  SFE_ST25DV64KC_NDEFReader reader(*this, _ccFileLen);
+  const uint8_t type[] = {SFE_ST25DV_NDEF_URI_RECORD};
+  return reader.begin() && reader.find(SFE_ST25DV_NDEF_TNF_WELL_KNOWN, type, sizeof(type), recordNo) && decodeURIPayload(reader, theURI, maxURILen);
 }
 
 const char *SFE_ST25DV64KC_NDEF::getURIPrefix(uint8_t prefixCode)
@@ -1054,286 +953,20 @@ bool SFE_ST25DV64KC_NDEF::writeNDEFWiFi(const char *ssid, const char *passwd, ui
 // Read an NDEF WiFi Record from memory
 bool SFE_ST25DV64KC_NDEF::readNDEFWiFi(char *ssid, uint16_t maxSsidLen, char *passwd, uint16_t maxPasswdLen, uint8_t recordNo)
 {
-  uint8_t tlv[4];
-
-  if (!readEEPROM(_ccFileLen, tlv, 4)) // Read the TLV T and L Fields
-    return false;                      // readEEPROM failed
-
-  if (tlv[0] != SFE_ST25DV_TYPE5_NDEF_MESSAGE_TLV) // Check for 0x03
-    return false;
-
-  uint16_t lengthField, eepromAddress;
-
-  if (tlv[1] == 0xFF) // Check for 3-byte length
-  {
-    lengthField = ((uint16_t)tlv[2]) << 8; // 3-byte length
-    lengthField |= tlv[3];
-    eepromAddress = _ccFileLen + 4;
-  }
-  else
+  SFE_ST25DV64KC_NDEFIndex *index = getNDEFIndex();
+  if (index != NULL)
   {
-    lengthField = tlv[1]; // 1-byte length
-    eepromAddress = _ccFileLen + 2;
+    const SFE_ST25DV64KC_NDEFIndex::Record *record = index->find(SFE_ST25DV_NDEF_TNF_MEDIA, (const uint8_t *)SFE_ST25DV_WIFI_MIME_TYPE, strlen(SFE_ST25DV_WIFI_MIME_TYPE), recordNo);
+    if (record == NULL)
+      return false;
+    SFE_ST25DV64KC_NDEFSegmentSource payload = index->getPayload(*record);
+    return decodeWiFiPayload(payload, ssid, maxSsidLen, passwd, maxPasswdLen);
   }
 
-  enum
-  {
-    readRecordHeader,
-    readTypeLength,
-    readPayloadLength,
-    readIDLength,
-    readType,
-    matchFoundCheckRecordNo,
-    readAndIgnoreID,
-    readAndIgnorePayload,
-    readPayload,
-    checkEntry,
-    terminatorFound,
-    allDone
-  } loopState = readRecordHeader; // TO DO: handle chunks!
-
-  bool shortRecord;
-  bool hasIDLength;
-  uint8_t typeLength;
-  uint8_t idLength;
-  uint32_t payloadLength;
-  uint8_t thisRecord = 0;
-  uint8_t *payload = NULL;
-  uint8_t *payloadPtr;
-  bool ssidFound = false;
-  bool passwdFound = false;
-  bool credentialSeen = false;
-  uint8_t tnf;
-
-  while (1)
-  {
-    switch (loopState)
-    {
-      case readRecordHeader:
-        {
-          uint8_t header[1];
-          if (!readEEPROM(eepromAddress, header, 1)) // Read the header
-          {
-            if (payload != NULL)
-              delete[] payload;
-            return false;
-          }
-          eepromAddress++;                                                      // Point to the Type Length
-          shortRecord = (header[0] & SFE_ST25DV_NDEF_SR) == SFE_ST25DV_NDEF_SR; // Is this a short record?
-          hasIDLength = (header[0] & SFE_ST25DV_NDEF_IL) == SFE_ST25DV_NDEF_IL; // Is there an ID length?
-          tnf = header[0] & 0x7;                                                // Extract the TNF
-          // Check for a terminator
-          // Also sanity check that eepromAddress is within bounds
-          if ((tnf == SFE_ST25DV_TYPE5_TERMINATOR_TLV) || (eepromAddress > (_ccFileLen + 4 + lengthField)))
-            loopState = terminatorFound;
-          else
-            loopState = readTypeLength;
-        }
-        break;
-      case readTypeLength:
-        {
-          uint8_t typeLen[1];
-          if (!readEEPROM(eepromAddress, typeLen, 1)) // Read the Type Length
-          {
-            if (payload != NULL)
-              delete[] payload;
-            return false;
-          }
-          typeLength = typeLen[0];
-          eepromAddress++; // Point to the Payload Length
-          loopState = readPayloadLength;
-        }
-        break;
-      case readPayloadLength:
-        {
-          uint8_t payloadLenBytes[4];
-          if (shortRecord)
-          {
-            if (!readEEPROM(eepromAddress, payloadLenBytes, 1)) // Read the Payload Length
-            {
-              if (payload != NULL)
-                delete[] payload;
-              return false;
-            }
-            eepromAddress++; // Point to the ID Length
-            payloadLength = payloadLenBytes[0];
-          }
-          else
-          {
-            if (!readEEPROM(eepromAddress, payloadLenBytes, 4)) // Read the Payload Length
-            {
-              if (payload != NULL)
-                delete[] payload;
-              return false;
-            }
-            eepromAddress += 4; // Point to the ID Length
-            payloadLength = ((uint32_t)payloadLenBytes[0]) << 24;
-            payloadLength |= ((uint32_t)payloadLenBytes[1]) << 16;
-            payloadLength |= ((uint32_t)payloadLenBytes[2]) << 8;
-            payloadLength |= payloadLenBytes[3];
-          }
-          loopState = readIDLength;
-        }
-        break;
-      case readIDLength:
-        {
-          if (hasIDLength)
-          {
-            uint8_t idLen[1];
-            if (!readEEPROM(eepromAddress, idLen, 1)) // Read the ID Length
-            {
-              if (payload != NULL)
-                delete[] payload;
-              return false;
-            }
-            idLength = idLen[0];
-            eepromAddress++; // Point to the Type
-          }
-          else
-            idLength = 0;
-          if (typeLength == 0) // If type length is zero, this cannot be a WiFi record
-            loopState = readAndIgnoreID;
-          else
-            loopState = readType;
-        }
-        break;
-      case readType:
-        {
-          uint8_t theType[typeLength + 1];                     // Add 1 extra for a NULL
-          if (!readEEPROM(eepromAddress, theType, typeLength)) // Read the Type
-          {
-            if (payload != NULL)
-              delete[] payload;
-            return false;
-          }
-          theType[typeLength] = 0;                                                                                                                                        // Null-terminate the Type
-          eepromAddress += typeLength;                                                                                                                                    // Point to the ID
-          if ((tnf == SFE_ST25DV_NDEF_TNF_MEDIA) && (typeLength == strlen(SFE_ST25DV_WIFI_MIME_TYPE)) && (strcmp((const char *)theType, SFE_ST25DV_WIFI_MIME_TYPE) == 0)) // Check for a Type match
-            loopState = matchFoundCheckRecordNo;
-          else
-            loopState = readAndIgnoreID;
-        }
-        break;
-      case readAndIgnoreID:
-        {
-          if (hasIDLength && (idLength > 0))
-          {
-            eepromAddress += idLength; // Skip over the ID Length
-          }
-          loopState = readAndIgnorePayload;
-        }
-        break;
-      case readAndIgnorePayload:
-        {
-          if (payloadLength > 0)
-          {
-            eepromAddress += payloadLength; // Skip over the Payload. No need to read it.
-          }
-          loopState = readRecordHeader; // Move on to the next record
-        }
-        break;
-      case matchFoundCheckRecordNo:
-        {
-          if (hasIDLength && (idLength > 0))
-          {
-            eepromAddress += idLength; // Skip over the ID Length. Point to the payload
-          }
-          thisRecord++; // Increment the record number
-          if (thisRecord == recordNo)
-            loopState = readPayload;
-          else
-            loopState = readAndIgnorePayload;
-        }
-        break;
-      case readPayload:
-        {
-          if (payload != NULL) // Delete any existing payload
-            delete[] payload;
-          payload = new uint8_t[payloadLength]; // Create storage for the payload
-          if (payload == NULL)
-          {
-#ifdef DEBUG
-            SAFE_CALLBACK(_errorCallback, SF_ST25DV64KC_ERROR::OUT_OF_MEMORY);
-#endif
-            return false; // Memory allocation failed
-          }
-
-          if (!readEEPROM(eepromAddress, payload, payloadLength)) // Read the Payload
-          {
-            if (payload != NULL)
-              delete[] payload;
-            return false;
-          }
-          eepromAddress += payloadLength;
-          payloadPtr = payload;
-          loopState = checkEntry;
-        }
-        break;
-      case checkEntry:
-        {
-          // Check for Credential
-          if ((*payloadPtr == SFE_ST25DV_WIFI_CREDENTIAL[0]) && (*(payloadPtr + 1) == SFE_ST25DV_WIFI_CREDENTIAL[1]))
-          {
-            credentialSeen = true;
-            payloadPtr += 4;
-          }
-          // Check for the SSID
-          else if ((*payloadPtr == SFE_ST25DV_WIFI_SSID[0]) && (*(payloadPtr + 1) == SFE_ST25DV_WIFI_SSID[1]))
-          {
-            uint16_t ssidLen = (((uint16_t) * (payloadPtr + 2)) << 8) | *(payloadPtr + 3);
-            if (ssidLen > (maxSsidLen - 1))
-              loopState = terminatorFound;
-            else
-            {
-              memcpy(ssid, payloadPtr + 4, ssidLen);
-              ssid[ssidLen] = 0; // NULL_terminate the SSID
-              payloadPtr += 4 + ssidLen;
-              ssidFound = true;
-              if ((passwdFound) && (credentialSeen))
-                loopState = allDone;
-            }
-          }
-          // Check for the Password
-          else if ((*payloadPtr == SFE_ST25DV_WIFI_NETWORK_KEY[0]) && (*(payloadPtr + 1) == SFE_ST25DV_WIFI_NETWORK_KEY[1]))
-          {
-            uint16_t pswdLen = (((uint16_t) * (payloadPtr + 2)) << 8) | *(payloadPtr + 3);
-            if (pswdLen > (maxPasswdLen - 1))
-              loopState = terminatorFound;
-            else
-            {
-              memcpy(passwd, payloadPtr + 4, pswdLen);
-              passwd[pswdLen] = 0; // NULL_terminate the Password
-              payloadPtr += 4 + pswdLen;
-              passwdFound = true;
-              if ((ssidFound) && (credentialSeen))
-                loopState = allDone;
-            }
-          }
-          else
-          {
-            uint16_t thingLen = (((uint16_t) * (payloadPtr + 2)) << 8) | *(payloadPtr + 3);
-            payloadPtr += 4 + thingLen;
-            if (payloadPtr >= payload + payloadLength)
-              loopState = terminatorFound;
-          }
-        }
-        break;
-      case terminatorFound:
-        {
-          if (payload != NULL)
-            delete[] payload;
-          return false;
-        }
-        break;
-      case allDone:
-        {
-          if (payload != NULL)
-            delete[] payload;
-          return true;
-        }
-        break;
-    }
-  }
+  // The message could not be indexed: stream it from the EEPROM
+  SFE_ST25DV64KC_NDEFReader reader(*this, _ccFileLen);
+  return reader.begin() && reader.find(SFE_ST25DV_NDEF_TNF_MEDIA, (const uint8_t *)SFE_ST25DV_WIFI_MIME_TYPE, strlen(SFE_ST25DV_WIFI_MIME_TYPE), recordNo) &&
+         decodeWiFiPayload(reader, ssid, maxSsidLen, passwd, maxPasswdLen);
 }
 
 /*
@@ -1391,7 +1024,7 @@ bool SFE_ST25DV64KC_NDEF::writeNDEFText(const uint8_t *theText, uint16_t textLen
   uint16_t fieldLength = payloadLength + 1 + ((payloadLength <= 0xFF) ? 1 : 4) + 1 + 1;
 
   // To save allocating memory twice, theText is copied directly to EEPROM without being copied into tagWrite first
-  uint8_t *tagWrite = new uint8_t[fieldLength + 3 - textLength]; // Always include 4 bytes for Payload Length
+  uint8_t *tagWrite = new uint8_t[fieldLength + 4 - textLength]; // Always include the T field and 3 bytes for the L field
 
   if (tagWrite == NULL)
   {
@@ -1440,9 +1073,9 @@ bool SFE_ST25DV64KC_NDEF::writeNDEFText(const uint8_t *theText, uint16_t textLen
   *tagPtr++ = (uint8_t)(languageLength & 0x3F); // Text Data Header. The UTF 8/16 bit is always clear
 
   if (languageCode != NULL)
-    strcpy((char *)tagPtr, languageCode); // Add the Language Code
+    memcpy(tagPtr, languageCode, languageLength); // Add the Language Code. No NULL: tagWrite only has room for the record
   else
-    strcpy((char *)tagPtr, SFE_ST25DV_NDEF_TEXT_DEF_LANG);
+    memcpy(tagPtr, SFE_ST25DV_NDEF_TEXT_DEF_LANG, languageLength);
   tagPtr += languageLength;
 
   uint16_t memLoc = _ccFileLen; // Write to this memory location
@@ -1574,269 +1207,255 @@ bool SFE_ST25DV64KC_NDEF::readNDEFText(char *theText, uint16_t maxTextLen, uint8
 // On return, *textLen contains the actual number of bytes read
 bool SFE_ST25DV64KC_NDEF::readNDEFText(uint8_t *theText, uint16_t *textLen, uint8_t recordNo, char *language, uint16_t maxLanguageLen)
 {
-  uint8_t tlv[4];
+  SFE_ST25DV64KC_NDEFIndex *index = getNDEFIndex();
+  if (index != NULL)
+  {
+    const uint8_t type[] = {SFE_ST25DV_NDEF_TEXT_RECORD};
+    const SFE_ST25DV64KC_NDEFIndex::Record *record = index->find(SFE_ST25DV_NDEF_TNF_WELL_KNOWN, type, sizeof(type), recordNo);
+    if (record == NULL)
+      return false;
+    SFE_ST25DV64KC_NDEFSegmentSource payload = index->getPayload(*record);
+    return decodeTextPayload(payload, theText, textLen, language, maxLanguageLen);
+  }
 
-  if (!readEEPROM(_ccFileLen, tlv, 4)) // Read the TLV T and L Fields
-    return false;                      // readEEPROM failed
+  // The message could not be indexed: stream it from the EEPROM
+  SFE_ST25DV64KC_NDEFReader reader(*this, _ccFileLen);
+  const uint8_t type[] = {SFE_ST25DV_NDEF_TEXT_RECORD};
+  return reader.begin() && reader.find(SFE_ST25DV_NDEF_TNF_WELL_KNOWN, type, sizeof(type), recordNo) && decodeTextPayload(reader, theText, textLen, language, maxLanguageLen);
+}
 
-  if (tlv[0] != SFE_ST25DV_TYPE5_NDEF_MESSAGE_TLV) // Check for 0x03
+void SFE_ST25DV64KC_NDEF::invalidateNDEFIndex()
+{
+  _ndefIndexBuilt = false;
+}
+
+void SFE_ST25DV64KC_NDEF::setNDEFIndexEnabled(bool enabled)
+{
+  _ndefIndexEnabled = enabled;
+  invalidateNDEFIndex();
+}
+
+// Reads the NDEF message into the index when user memory was written since it was built. An index without records
+// stands for a missing NDEF Message TLV, a message longer than the index leaves it invalid.
+// Returns false if user memory could not be read.
+bool SFE_ST25DV64KC_NDEF::loadNDEFIndex()
+{
+  if (_ndefIndexBuilt && (_ndefIndexWriteCount == getUserMemoryWriteCount()))
+    return true;
+
+  _ndefIndexBuilt = false;
+  _ndefHeaderLength = 0;
+  _ndefTerminated = false;
+  _ndefIndex.clear();
+
+  uint8_t tlv[4];
+  if (!readEEPROM(_ccFileLen, tlv, 4)) // Read the TLV T and L Fields
     return false;
 
-  uint16_t lengthField, eepromAddress;
+  _ndefIndexBuilt = true;
+  _ndefIndexWriteCount = getUserMemoryWriteCount();
 
+  if (tlv[0] != SFE_ST25DV_TYPE5_NDEF_MESSAGE_TLV) // No NDEF message
+  {
+    _ndefIndex.parse(0);
+    return true;
+  }
+
+  uint16_t lengthField;
+  uint8_t headerLength;
   if (tlv[1] == 0xFF) // Check for 3-byte length
   {
-    lengthField = ((uint16_t)tlv[2]) << 8; // 3-byte length
+    lengthField = ((uint16_t)tlv[2]) << 8;
     lengthField |= tlv[3];
-    eepromAddress = _ccFileLen + 4;
+    headerLength = 4;
   }
   else
   {
-    lengthField = tlv[1]; // 1-byte length
-    eepromAddress = _ccFileLen + 2;
+    lengthField = tlv[1];
+    headerLength = 2;
   }
 
-  enum
+  if (lengthField > SFE_ST25DV64KC_NDEFIndex::CAPACITY)
+    return true;
+
+  // The first message bytes came with the TLV header, read the rest in one go. With the terminator if it fits the
+  // buffer, writeNDEFMessage() compares against it.
+  uint8_t *message = _ndefIndex.buffer();
+  uint16_t stored = (lengthField < SFE_ST25DV64KC_NDEFIndex::CAPACITY) ? lengthField + 1 : lengthField;
+  uint16_t prefetched = 4 - headerLength;
+  if (prefetched > stored)
+    prefetched = stored;
+  memcpy(message, &tlv[headerLength], prefetched);
+
+  if (!readEEPROM(_ccFileLen + headerLength + prefetched, message + prefetched, stored - prefetched))
   {
-    readRecordHeader,
-    readTypeLength,
-    readPayloadLength,
-    readIDLength,
-    readType,
-    matchFoundCheckRecordNo,
-    readAndIgnoreID,
-    readAndIgnorePayload,
-    readPayload,
-    checkEntry,
-    terminatorFound,
-    allDone
-  } loopState = readRecordHeader; // TO DO: handle chunks!
-
-  bool shortRecord;
-  bool hasIDLength;
-  uint8_t typeLength;
-  uint8_t idLength;
-  uint32_t payloadLength;
-  uint8_t thisRecord = 0;
-  uint8_t *payload = NULL;
-  uint8_t tnf;
-
-  while (1)
+    _ndefIndexBuilt = false;
+    return false;
+  }
+
+  _ndefHeaderLength = headerLength;
+  _ndefLength = lengthField;
+  _ndefTerminated = (stored > lengthField) && (message[lengthField] == SFE_ST25DV_TYPE5_TERMINATOR_TLV);
+  _ndefIndex.parse(lengthField);
+  return true;
+}
+
+// Returns the index of the NDEF message, see loadNDEFIndex().
+// Returns NULL if the index is disabled or the message could not be read or indexed.
+SFE_ST25DV64KC_NDEFIndex *SFE_ST25DV64KC_NDEF::getNDEFIndex()
+{
+  if (!_ndefIndexEnabled || !loadNDEFIndex())
+    return NULL;
+
+  return _ndefIndex.isValid() ? &_ndefIndex : NULL;
+}
+
+bool SFE_ST25DV64KC_NDEF::decodeURIPayload(SFE_ST25DV64KC_NDEFPayloadSource &payload, char *theURI, uint16_t maxURILen)
+{
+  uint8_t prefixCode;
+  if (!payload.read(&prefixCode, 1) || (prefixCode > SFE_ST25DV_NDEF_URI_ID_CODE_URN_NFC)) // Check for a valid prefix code
+    return false;
+
+  const char *prefix = getURIPrefix(prefixCode);
+  uint16_t prefixLen = strlen(prefix);
+  uint32_t theTextLen = payload.getRemaining();
+  if ((prefixLen + theTextLen) >= maxURILen) // Is there enough room to hold the prefix, the URI and the NULL?
+    return false;
+
+  strcpy(theURI, prefix); // Copy the prefix
+  if (!payload.read((uint8_t *)&theURI[prefixLen], theTextLen)) // Copy the URI
+    return false;
+  theURI[prefixLen + theTextLen] = 0; // NULL-terminate the text
+  return true;
+}
+
+bool SFE_ST25DV64KC_NDEF::decodeWiFiPayload(SFE_ST25DV64KC_NDEFPayloadSource &payload, char *ssid, uint16_t maxSsidLen, char *passwd, uint16_t maxPasswdLen)
+{
+  bool ssidFound = false;
+  bool passwdFound = false;
+  bool credentialSeen = false;
+
+  // Walk the attributes: 2-byte ID, 2-byte length, data
+  uint8_t attribute[4];
+  while (payload.read(attribute, 4))
   {
-    switch (loopState)
+    // Check for Credential. Its attributes follow
+    if ((attribute[0] == SFE_ST25DV_WIFI_CREDENTIAL[0]) && (attribute[1] == SFE_ST25DV_WIFI_CREDENTIAL[1]))
     {
-      case readRecordHeader:
-        {
-          uint8_t header[1];
-          if (!readEEPROM(eepromAddress, header, 1)) // Read the header
-          {
-            if (payload != NULL)
-              delete[] payload;
-            return false;
-          }
-          eepromAddress++;                                                      // Point to the Type Length
-          shortRecord = (header[0] & SFE_ST25DV_NDEF_SR) == SFE_ST25DV_NDEF_SR; // Is this a short record?
-          hasIDLength = (header[0] & SFE_ST25DV_NDEF_IL) == SFE_ST25DV_NDEF_IL; // Is there an ID length?
-          tnf = header[0] & 0x7;                                                // Extract the TNF
-          // Check for a terminator
-          // Also sanity check that eepromAddress is within bounds
-          if ((tnf == SFE_ST25DV_TYPE5_TERMINATOR_TLV) || (eepromAddress > (_ccFileLen + 4 + lengthField)))
-            loopState = terminatorFound;
-          else
-            loopState = readTypeLength;
-        }
-        break;
-      case readTypeLength:
-        {
-          uint8_t typeLen[1];
-          if (!readEEPROM(eepromAddress, typeLen, 1)) // Read the Type Length
-          {
-            if (payload != NULL)
-              delete[] payload;
-            return false;
-          }
-          typeLength = typeLen[0];
-          eepromAddress++; // Point to the Payload Length
-          loopState = readPayloadLength;
-        }
-        break;
-      case readPayloadLength:
-        {
-          uint8_t payloadLenBytes[4];
-          if (shortRecord)
-          {
-            if (!readEEPROM(eepromAddress, payloadLenBytes, 1)) // Read the Payload Length
-            {
-              if (payload != NULL)
-                delete[] payload;
-              return false;
-            }
-            eepromAddress++; // Point to the ID Length
-            payloadLength = payloadLenBytes[0];
-          }
-          else
-          {
-            if (!readEEPROM(eepromAddress, payloadLenBytes, 4)) // Read the Payload Length
-            {
-              if (payload != NULL)
-                delete[] payload;
-              return false;
-            }
-            eepromAddress += 4; // Point to the ID Length
-            payloadLength = ((uint32_t)payloadLenBytes[0]) << 24;
-            payloadLength |= ((uint32_t)payloadLenBytes[1]) << 16;
-            payloadLength |= ((uint32_t)payloadLenBytes[2]) << 8;
-            payloadLength |= payloadLenBytes[3];
-          }
-          loopState = readIDLength;
-        }
-        break;
-      case readIDLength:
-        {
-          if (hasIDLength)
-          {
-            uint8_t idLen[1];
-            if (!readEEPROM(eepromAddress, idLen, 1)) // Read the ID Length
-            {
-              if (payload != NULL)
-                delete[] payload;
-              return false;
-            }
-            idLength = idLen[0];
-            eepromAddress++; // Point to the Type
-          }
-          else
-            idLength = 0;
-          if (typeLength == 0) // If typeLength is zero, this cannot be a Text Record
-            loopState = readAndIgnoreID;
-          else
-            loopState = readType;
-        }
-        break;
-      case readType:
-        {
-          uint8_t theType[typeLength + 1];                     // Add 1 extra for a NULL
-          if (!readEEPROM(eepromAddress, theType, typeLength)) // Read the Type
-          {
-            if (payload != NULL)
-              delete[] payload;
-            return false;
-          }
-          theType[typeLength] = 0;                                                                    // Null-terminate the Type
-          eepromAddress += typeLength;                                                                // Point to the ID
-          if ((theType[0] == SFE_ST25DV_NDEF_TEXT_RECORD) && (tnf == SFE_ST25DV_NDEF_TNF_WELL_KNOWN)) // Check for a Type match
-            loopState = matchFoundCheckRecordNo;
-          else
-            loopState = readAndIgnoreID;
-        }
-        break;
-      case readAndIgnoreID:
-        {
-          if (hasIDLength && (idLength > 0))
-          {
-            eepromAddress += idLength; // Skip over the ID Length
-          }
-          loopState = readAndIgnorePayload;
-        }
-        break;
-      case readAndIgnorePayload:
-        {
-          if (payloadLength > 0)
-          {
-            eepromAddress += payloadLength; // Skip over the Payload. No need to read it.
-          }
-          loopState = readRecordHeader; // Move on to the next record
-        }
-        break;
-      case matchFoundCheckRecordNo:
-        {
-          if (hasIDLength && (idLength > 0))
-          {
-            eepromAddress += idLength; // Skip over the ID Length. Point to the payload
-          }
-          thisRecord++; // Increment the record number
-          if (thisRecord == recordNo)
-            loopState = readPayload;
-          else
-            loopState = readAndIgnorePayload;
-        }
-        break;
-      case readPayload:
-        {
-          if (payload != NULL) // Delete any existing payload
-            delete[] payload;
-          payload = new uint8_t[payloadLength]; // Create storage for the payload
-          if (payload == NULL)
-          {
-#ifdef DEBUG
-            SAFE_CALLBACK(_errorCallback, SF_ST25DV64KC_ERROR::OUT_OF_MEMORY);
-#endif
-            return false; // Memory allocation failed
-          }
-
-          if (!readEEPROM(eepromAddress, payload, payloadLength)) // Read the Payload
-          {
-            if (payload != NULL)
-              delete[] payload;
-            return false;
-          }
-          eepromAddress += payloadLength;
-          loopState = checkEntry;
-        }
-        break;
-      case checkEntry:
-        {
-          if ((*payload) >> 7) // If the UTF-16 bit is set
-          {
-            loopState = terminatorFound; // Bail...
-          }
-          else
-          {
-            uint16_t languageLength = (*payload) & 0x3F;
-            if ((languageLength > 0) && (language != NULL) && (maxLanguageLen > 0))
-            {
-              if (languageLength <= (maxLanguageLen - 1))
-              {
-                memcpy(language, payload + 1, languageLength);
-                language[languageLength] = 0; // NULL-terminate the language
-              }
-              else
-              {
-                *language = 0; // Not enough room to store language. Set language to NULL
-              }
-            }
-            uint16_t theTextLen = payloadLength - (1 + languageLength);
-            if (theTextLen <= ((*textLen) - 1))
-            {
-              memcpy(theText, payload + 1 + languageLength, theTextLen);
-              theText[theTextLen] = 0; // NULL-terminate the text
-              *textLen = theTextLen;
-              loopState = allDone;
-            }
-            else
-            {
-              *textLen = 0;                // Indicate no text was read
-              loopState = terminatorFound; // Not enough room to store theText. Bail...
-            }
-          }
-        }
-        break;
-      case terminatorFound:
-        {
-          if (payload != NULL)
-            delete[] payload;
-          return false;
-        }
-        break;
-      case allDone:
-        {
-          if (payload != NULL)
-            delete[] payload;
-          return true;
-        }
-        break;
+      credentialSeen = true;
+      continue;
+    }
+
+    uint16_t thingLen = (((uint16_t)attribute[2]) << 8) | attribute[3];
+
+    // Check for the SSID
+    if ((attribute[0] == SFE_ST25DV_WIFI_SSID[0]) && (attribute[1] == SFE_ST25DV_WIFI_SSID[1]))
+    {
+      if ((thingLen >= maxSsidLen) || !payload.read((uint8_t *)ssid, thingLen))
+        return false;
+      ssid[thingLen] = 0; // NULL_terminate the SSID
+      ssidFound = true;
+    }
+    // Check for the Password
+    else if ((attribute[0] == SFE_ST25DV_WIFI_NETWORK_KEY[0]) && (attribute[1] == SFE_ST25DV_WIFI_NETWORK_KEY[1]))
+    {
+      if ((thingLen >= maxPasswdLen) || !payload.read((uint8_t *)passwd, thingLen))
+        return false;
+      passwd[thingLen] = 0; // NULL_terminate the Password
+      passwdFound = true;
+    }
+    else if (!payload.read(NULL, thingLen)) // Skip anything else
+      return false;
+
+    if (ssidFound && passwdFound && credentialSeen)
+      return true;
+  }
+
+  return false;
+}
+
+bool SFE_ST25DV64KC_NDEF::decodeTextPayload(SFE_ST25DV64KC_NDEFPayloadSource &payload, uint8_t *theText, uint16_t *textLen, char *language, uint16_t maxLanguageLen)
+{
+  uint8_t status;
+  if (!payload.read(&status, 1) || (status >> 7)) // If the UTF-16 bit is set
+    return false;
+
+  uint16_t languageLength = status & 0x3F;
+  if (languageLength > payload.getRemaining())
+    return false;
+
+  if ((languageLength > 0) && (language != NULL) && (maxLanguageLen > 0))
+  {
+    if (languageLength <= (maxLanguageLen - 1))
+    {
+      if (!payload.read((uint8_t *)language, languageLength))
+        return false;
+      language[languageLength] = 0; // NULL-terminate the language
     }
+    else
+    {
+      *language = 0; // Not enough room to store language. Set language to NULL
+      payload.read(NULL, languageLength);
+    }
+  }
+  else
+    payload.read(NULL, languageLength);
+
+  uint32_t theTextLen = payload.getRemaining();
+  if (theTextLen >= *textLen) // Not enough room to store theText and the NULL
+  {
+    *textLen = 0; // Indicate no text was read
+    return false;
+  }
+
+  if (!payload.read(theText, theTextLen))
+    return false;
+  theText[theTextLen] = 0; // NULL-terminate the text
+  *textLen = theTextLen;
+  return true;
+}
+
+// Read the payload of any NDEF Record with the given TNF and type
+bool SFE_ST25DV64KC_NDEF::readNDEFRecord(uint8_t tnf, const uint8_t *type, uint8_t typeLength, uint8_t *payload, uint16_t *payloadLength, uint8_t recordNo)
+{
+  SFE_ST25DV64KC_NDEFIndex *index = getNDEFIndex();
+  if (index != NULL)
+  {
+    const SFE_ST25DV64KC_NDEFIndex::Record *record = index->find(tnf, type, typeLength, recordNo);
+    if ((record == NULL) || (record->payloadLength > *payloadLength))
+      return false;
+
+    // Chunks are reassembled into payload
+    SFE_ST25DV64KC_NDEFSegmentSource source = index->getPayload(*record);
+    if (!source.read(payload, record->payloadLength))
+      return false;
+    *payloadLength = record->payloadLength;
+    return true;
   }
+
+  // The message could not be indexed: stream it from the EEPROM
+  SFE_ST25DV64KC_NDEFReader reader(*this, _ccFileLen);
+  if (!reader.begin() || !reader.find(tnf, type, typeLength, recordNo) || (reader.getLength() > *payloadLength))
+    return false;
+  if (!reader.read(payload, reader.getLength()))
+    return false;
+  *payloadLength = reader.getLength();
+  return true;
+}
+
+// Hand the payload of any NDEF Record with the given TNF and type to callback, chunk by chunk
+bool SFE_ST25DV64KC_NDEF::readNDEFRecordChunks(uint8_t tnf, const uint8_t *type, uint8_t typeLength, SFE_ST25DV64KC_NDEFChunkCallback callback, void *context, uint8_t recordNo)
+{
+  SFE_ST25DV64KC_NDEFIndex *index = getNDEFIndex();
+  if (index != NULL)
+  {
+    const SFE_ST25DV64KC_NDEFIndex::Record *record = index->find(tnf, type, typeLength, recordNo);
+    return (record != NULL) && index->forEachChunk(*record, callback, context);
+  }
+
+  // The message could not be indexed: push it from the EEPROM, SFE_ST25DV64KC_NDEFReader::CHUNK_SIZE bytes at a time
+  SFE_ST25DV64KC_NDEFReader reader(*this, _ccFileLen);
+  return reader.begin() && reader.find(tnf, type, typeLength, recordNo) && reader.forEachChunk(callback, context);
 }
 
 bool SFE_ST25DV64KC_NDEF::setLockCCFile(bool value)
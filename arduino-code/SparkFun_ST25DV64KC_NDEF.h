@@ -22,6 +22,9 @@
 #include "SparkFun_ST25DV64KC_Arduino_Library.h"
 #include "SparkFun_ST25DV64KC_IO.h"
 #include "SparkFun_ST25DV64KC_Arduino_Library_Constants.h"
+#include "SparkFun_ST25DV64KC_NDEFIndex.h"
+#include "SparkFun_ST25DV64KC_NDEFComposer.h"
+#include "SparkFun_ST25DV64KC_NDEFReader.h"
 
 #define CC_FILE_SIZE 4
 
@@ -33,6 +36,29 @@ private:
 #else
   uint16_t _ccFileLen = 8; // Record the length of the CC File - default to 8 bytes for the ST25DV64K
 #endif
+
+  // RAM copy of the NDEF message the readers are served from, see getNDEFIndex()
+  SFE_ST25DV64KC_NDEFIndex _ndefIndex;
+  bool _ndefIndexEnabled = true;
+  bool _ndefIndexBuilt = false;
+  uint32_t _ndefIndexWriteCount = 0; // getUserMemoryWriteCount() when it was built
+
+  // TLV header in front of the message _ndefIndex holds, 0 if it holds no copy of the user memory at _ccFileLen
+  uint8_t _ndefHeaderLength = 0;
+  uint16_t _ndefLength = 0;     // TLV L field
+  bool _ndefTerminated = false; // the Terminator TLV follows the message
+
+  bool loadNDEFIndex();
+  SFE_ST25DV64KC_NDEFIndex *getNDEFIndex();
+
+  // Returns true if user memory holds bytes at [from, to), as far as the copy in _ndefIndex tells
+  bool matchesNDEFIndex(uint16_t from, uint16_t to, const uint8_t *bytes);
+
+  // Copy the content of a record's payload into the callers' buffers
+  bool decodeURIPayload(SFE_ST25DV64KC_NDEFPayloadSource &payload, char *theURI, uint16_t maxURILen);
+  bool decodeWiFiPayload(SFE_ST25DV64KC_NDEFPayloadSource &payload, char *ssid, uint16_t maxSsidLen, char *passwd, uint16_t maxPasswdLen);
+  bool decodeTextPayload(SFE_ST25DV64KC_NDEFPayloadSource &payload, uint8_t *theText, uint16_t *textLen, char *language, uint16_t maxLanguageLen);
+
 public:
   // Default constructor.
   SFE_ST25DV64KC_NDEF(){};
@@ -52,9 +78,37 @@ public:
   bool setLockCCFile(bool value);
 
   // Update _ccFileLen
-  void setCCFileLen(uint16_t newLen) { _ccFileLen = newLen; }
+  void setCCFileLen(uint16_t newLen) { _ccFileLen = newLen; invalidateNDEFIndex(); }
   uint16_t getCCFileLen() { return _ccFileLen; }
 
+  // The readNDEF* functions read the NDEF message (up to SFE_ST25DV64KC_NDEFIndex::CAPACITY bytes) once and
+  // answer from RAM until writeEEPROM() is called, writeNDEFMessage() keeps the copy up to date. Call
+  // invalidateNDEFIndex() after the message was written through RF.
+  void invalidateNDEFIndex();
+  // Disabled, the readers walk the message in the EEPROM on every call
+  void setNDEFIndexEnabled(bool enabled);
+
+  struct NDEFWriteReport
+  {
+    uint16_t bytes;         // written
+    uint16_t ranges;        // row aligned writes
+    uint16_t rowsWritten;   // EEPROM rows programmed
+    uint16_t rowsUnchanged; // rows of the message which already held the new content
+  };
+
+  // Finish a composed NDEF message and write it to user memory
+  // Only the rows whose content changed are written, compared against the NDEF index's RAM copy of the message
+  // (read from user memory the first time). Nothing is written if the message is already there. Messages not
+  // at _ccFileLen or longer than the index are written in full.
+  // If address is not NULL, start writing at *address, otherwise start at _ccFileLen
+  // On success *address points to the terminator, like after the last writeNDEF* call of a message
+  // report (optional) receives what was written
+  // Returns true if successful, otherwise false
+  bool writeNDEFMessage(SFE_ST25DV64KC_NDEFComposer &composer, uint16_t *address = NULL, NDEFWriteReport *report = NULL);
+
+  // Returns true if user memory already holds the composed message, i.e. writeNDEFMessage() would write nothing
+  bool isNDEFMessageWritten(SFE_ST25DV64KC_NDEFComposer &composer, uint16_t *address = NULL);
+
   // Write an NDEF URI Record to user memory
   // If address is not NULL, start writing at *address, otherwise start at _ccFileLen
   // MB = Message Begin, ME = Message End
@@ -112,6 +166,18 @@ public:
   bool writeNDEFText(const char *theText, uint16_t *address, bool MB = true, bool ME = true, const char *languageCode = NULL);
   bool writeNDEFText(const uint8_t *theText, uint16_t textLength, uint16_t *address, bool MB = true, bool ME = true, const char *languageCode = NULL);
 
+  // Read the payload of any NDEF Record with the given TNF and type, e.g. an NFC Forum External Type record
+  // Default is to read the first matching record (recordNo = 1). Increase recordNo to read later entries
+  // The chunks of a chunked record are reassembled
+  // *payloadLength should be set to the maximum number of bytes which payload can hold
+  // On return, *payloadLength contains the actual number of bytes read
+  // Returns true if successful, otherwise false
+  bool readNDEFRecord(uint8_t tnf, const uint8_t *type, uint8_t typeLength, uint8_t *payload, uint16_t *payloadLength, uint8_t recordNo = 1);
+  // As readNDEFRecord, but the payload is handed to callback chunk by chunk instead of being copied
+  // A message too large for the NDEF index is streamed: the chunks are then at most SFE_ST25DV64KC_NDEFReader::CHUNK_SIZE bytes
+  // Returns false if there is no such record or callback stopped early
+  bool readNDEFRecordChunks(uint8_t tnf, const uint8_t *type, uint8_t typeLength, SFE_ST25DV64KC_NDEFChunkCallback callback, void *context, uint8_t recordNo = 1);
+
   // Read an NDEF UTF-8 Text Record from memory
   // Default is to read the first Text record (recordNo = 1). Increase recordNo to read later entries
   // maxTextLen is the maximum number of chars which theText can hold
@@ -0,0 +1,167 @@
+/*
+  This is a library written for the ST25DV64KC Dynamic RFID Tag.
+  SparkFun sells these at its website:
+  https://www.sparkfun.com/products/
+
+  Do you like this library? Help support open source hardware. Buy a board!
+
+  This file implements the NDEF composer.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SparkFun_ST25DV64KC_NDEFComposer.h"
+#include "SparkFun_ST25DV64KC_Arduino_Library_Constants.h"
+
+SFE_ST25DV64KC_NDEFComposer::SFE_ST25DV64KC_NDEFComposer(uint8_t *buffer, uint16_t capacity)
+    : buffer(buffer), capacity(capacity)
+{
+  clear();
+}
+
+void SFE_ST25DV64KC_NDEFComposer::clear()
+{
+  used = TLV_HEADER_LENGTH;
+  start = 0;
+  lastRecord = 0;
+  recordCount = 0;
+  overflow = capacity < TLV_HEADER_LENGTH;
+  finished = false;
+}
+
+uint32_t SFE_ST25DV64KC_NDEFComposer::recordLength(uint8_t typeLength, uint8_t idLength, uint32_t payloadLength)
+{
+  // Record Header, Type Length, Payload Length, ID Length, Type, ID and Payload
+  return 1 + 1 + ((payloadLength <= 0xFF) ? 1 : 4) + ((idLength > 0) ? 1 : 0) + typeLength + idLength + payloadLength;
+}
+
+uint8_t *SFE_ST25DV64KC_NDEFComposer::beginRecord(uint8_t tnf, const uint8_t *type, uint8_t typeLength, uint32_t payloadLength, const uint8_t *id, uint8_t idLength)
+{
+  if (overflow || finished)
+    return NULL;
+
+  if (id == NULL)
+    idLength = 0;
+  bool shortRecord = payloadLength <= 0xFF;
+  uint32_t length = recordLength(typeLength, idLength, payloadLength);
+  if (used + length > capacity)
+  {
+    overflow = true;
+    return NULL;
+  }
+
+  lastRecord = used;
+  uint8_t *tagPtr = &buffer[used];
+  *tagPtr++ = (shortRecord ? SFE_ST25DV_NDEF_SR : 0) | ((idLength > 0) ? SFE_ST25DV_NDEF_IL : 0) | (tnf & 0x7); // NDEF Record Header
+  *tagPtr++ = typeLength;                                                                                      // NDEF Type Length
+  if (shortRecord)
+  {
+    *tagPtr++ = payloadLength; // NDEF Payload Length (1-Byte)
+  }
+  else
+  {
+    *tagPtr++ = payloadLength >> 24; // NDEF Payload Length (4-Byte)
+    *tagPtr++ = (payloadLength >> 16) & 0xFF;
+    *tagPtr++ = (payloadLength >> 8) & 0xFF;
+    *tagPtr++ = payloadLength & 0xFF;
+  }
+  if (idLength > 0)
+    *tagPtr++ = idLength; // NDEF ID Length
+  memcpy(tagPtr, type, typeLength); // NDEF Record Type
+  tagPtr += typeLength;
+  if (idLength > 0)
+  {
+    memcpy(tagPtr, id, idLength); // NDEF ID
+    tagPtr += idLength;
+  }
+
+  used += length;
+  recordCount++;
+  return tagPtr;
+}
+
+bool SFE_ST25DV64KC_NDEFComposer::addRecord(uint8_t tnf, const uint8_t *type, uint8_t typeLength, const uint8_t *payload, uint32_t payloadLength, const uint8_t *id, uint8_t idLength)
+{
+  uint8_t *tagPtr = beginRecord(tnf, type, typeLength, payloadLength, id, idLength);
+  if (tagPtr == NULL)
+    return false;
+
+  if (payloadLength > 0)
+    memcpy(tagPtr, payload, payloadLength);
+  return true;
+}
+
+bool SFE_ST25DV64KC_NDEFComposer::addExternal(const char *type, const uint8_t *payload, uint32_t payloadLength)
+{
+  return addRecord(SFE_ST25DV_NDEF_TNF_EXTERNAL, (const uint8_t *)type, strlen(type), payload, payloadLength);
+}
+
+bool SFE_ST25DV64KC_NDEFComposer::addURI(const char *uri, uint8_t idCode)
+{
+  const uint8_t type[] = {SFE_ST25DV_NDEF_URI_RECORD};
+  uint16_t uriLength = strlen(uri);
+  uint8_t *payload = beginRecord(SFE_ST25DV_NDEF_TNF_WELL_KNOWN, type, sizeof(type), uriLength + 1);
+  if (payload == NULL)
+    return false;
+
+  *payload++ = idCode;            // NDEF URI Prefix Code
+  memcpy(payload, uri, uriLength); // Add the URI
+  return true;
+}
+
+bool SFE_ST25DV64KC_NDEFComposer::addText(const char *theText, const char *languageCode)
+{
+  return addText((const uint8_t *)theText, (uint16_t)strlen(theText), languageCode);
+}
+
+bool SFE_ST25DV64KC_NDEFComposer::addText(const uint8_t *theText, uint16_t textLength, const char *languageCode)
+{
+  if (languageCode == NULL)
+    languageCode = SFE_ST25DV_NDEF_TEXT_DEF_LANG;
+  uint8_t languageLength = strlen(languageCode) & 0x3F; // 6-bit only!
+
+  const uint8_t type[] = {SFE_ST25DV_NDEF_TEXT_RECORD};
+  uint8_t *payload = beginRecord(SFE_ST25DV_NDEF_TNF_WELL_KNOWN, type, sizeof(type), (uint32_t)textLength + languageLength + 1);
+  if (payload == NULL)
+    return false;
+
+  *payload++ = languageLength; // Text Data Header: UTF-8, Language Code Length
+  memcpy(payload, languageCode, languageLength);
+  memcpy(payload + languageLength, theText, textLength);
+  return true;
+}
+
+bool SFE_ST25DV64KC_NDEFComposer::finish()
+{
+  if (finished)
+    return true;
+  if (overflow || (recordCount == 0) || (used + 1 > capacity))
+    return false;
+
+  buffer[TLV_HEADER_LENGTH] |= SFE_ST25DV_NDEF_MB;
+  buffer[lastRecord] |= SFE_ST25DV_NDEF_ME;
+
+  uint16_t fieldLength = used - TLV_HEADER_LENGTH;
+  if (fieldLength > 0xFE) // Is the total L greater than 0xFE?
+  {
+    start = 0;
+    buffer[1] = 0xFF; // Type5 Tag TLV-Format: L (Length field) (3-Byte Format)
+    buffer[2] = fieldLength >> 8;
+    buffer[3] = fieldLength & 0xFF;
+  }
+  else
+  {
+    start = 2;
+    buffer[3] = fieldLength; // Type5 Tag TLV-Format: L (Length field) (1-Byte Format)
+  }
+  buffer[start] = SFE_ST25DV_TYPE5_NDEF_MESSAGE_TLV; // Type5 Tag TLV-Format: T (Type field)
+
+  buffer[used++] = SFE_ST25DV_TYPE5_TERMINATOR_TLV;
+  finished = true;
+  return true;
+}
@@ -0,0 +1,76 @@
+/*
+  This is a library written for the ST25DV64KC Dynamic RFID Tag.
+  SparkFun sells these at its website:
+  https://www.sparkfun.com/products/
+
+  Do you like this library? Help support open source hardware. Buy a board!
+
+  This file declares the NDEF composer which lays out a complete NDEF Message TLV - T and L fields, records and
+  terminator - in a caller provided buffer, so that it can be written to user memory in one go.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SPARKFUN_ST25DV64KC_NDEF_COMPOSER_
+#define _SPARKFUN_ST25DV64KC_NDEF_COMPOSER_
+
+#include <Arduino.h>
+
+class SFE_ST25DV64KC_NDEFComposer
+{
+public:
+  // T field and the 3-byte L field; the records are composed behind it
+  static const uint8_t TLV_HEADER_LENGTH = 4;
+
+  SFE_ST25DV64KC_NDEFComposer(uint8_t *buffer, uint16_t capacity);
+
+  void clear();
+
+  // Append a record. The MB and ME flags are set by finish().
+  // Return false if the record does not fit, the message can not be finished then.
+  // Any record: short or long depending on payloadLength, id (optional) adds the ID Length and ID fields
+  bool addRecord(uint8_t tnf, const uint8_t *type, uint8_t typeLength, const uint8_t *payload, uint32_t payloadLength, const uint8_t *id = NULL, uint8_t idLength = 0);
+  // NFC Forum External Type record, type is "domain:type", e.g. "lukso.io:addr"
+  bool addExternal(const char *type, const uint8_t *payload, uint32_t payloadLength);
+  bool addURI(const char *uri, uint8_t idCode);
+  bool addText(const char *theText, const char *languageCode = NULL);
+  bool addText(const uint8_t *theText, uint16_t textLength, const char *languageCode = NULL);
+
+  // Sets MB and ME, fills in the T and L fields and appends the terminator.
+  // Returns false if there are no records or one of them did not fit.
+  bool finish();
+
+  // Bytes a record takes in the message
+  static uint32_t recordLength(uint8_t typeLength, uint8_t idLength, uint32_t payloadLength);
+
+  // The finished NDEF Message TLV including the terminator
+  inline const uint8_t *getMessage()
+  {
+    return &buffer[start];
+  }
+
+  inline uint16_t getLength()
+  {
+    return used - start;
+  }
+
+private:
+  uint8_t *buffer;
+  uint16_t capacity;
+  uint16_t used;
+  uint16_t start;      // of the TLV, depends on the size of the L field
+  uint16_t lastRecord; // header of the last record
+  uint8_t recordCount;
+  bool overflow;
+  bool finished;
+
+  // Appends the record fields up to the payload and returns where the payloadLength bytes of payload go
+  uint8_t *beginRecord(uint8_t tnf, const uint8_t *type, uint8_t typeLength, uint32_t payloadLength, const uint8_t *id = NULL, uint8_t idLength = 0);
+};
+
+#endif
@@ -0,0 +1,147 @@
+/*
+  This is a library written for the ST25DV64KC Dynamic RFID Tag.
+  SparkFun sells these at its website:
+  https://www.sparkfun.com/products/
+
+  Do you like this library? Help support open source hardware. Buy a board!
+
+  This file implements the NDEF index.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SparkFun_ST25DV64KC_NDEFIndex.h"
+#include "SparkFun_ST25DV64KC_Arduino_Library_Constants.h"
+
+SFE_ST25DV64KC_NDEFIndex::SFE_ST25DV64KC_NDEFIndex()
+{
+  clear();
+}
+
+void SFE_ST25DV64KC_NDEFIndex::clear()
+{
+  messageLength = 0;
+  recordCount = 0;
+  segmentCount = 0;
+  valid = false;
+}
+
+bool SFE_ST25DV64KC_NDEFIndex::parse(uint16_t length)
+{
+  clear();
+  if (length > CAPACITY)
+    return false;
+
+  uint16_t offset = 0;
+  bool chunked = false; // the last record expects more chunks
+  while (offset < length)
+  {
+    uint8_t header = message[offset++];
+    bool shortRecord = (header & SFE_ST25DV_NDEF_SR) == SFE_ST25DV_NDEF_SR;
+    bool hasIDLength = (header & SFE_ST25DV_NDEF_IL) == SFE_ST25DV_NDEF_IL;
+
+    // Type Length, Payload Length and ID Length
+    uint8_t fieldsLength = 1 + (shortRecord ? 1 : 4) + (hasIDLength ? 1 : 0);
+    if (offset + fieldsLength > length)
+      return false;
+
+    uint8_t typeLength = message[offset++];
+    uint32_t payloadLength;
+    if (shortRecord)
+      payloadLength = message[offset++];
+    else
+    {
+      payloadLength = ((uint32_t)message[offset]) << 24;
+      payloadLength |= ((uint32_t)message[offset + 1]) << 16;
+      payloadLength |= ((uint32_t)message[offset + 2]) << 8;
+      payloadLength |= message[offset + 3];
+      offset += 4;
+    }
+    uint8_t idLength = hasIDLength ? message[offset++] : 0;
+
+    // The chunk has to end within the message
+    uint16_t typeOffset = offset;
+    uint32_t end = (uint32_t)offset + typeLength + idLength + payloadLength;
+    if ((end > length) || (segmentCount == MAX_CHUNKS))
+      return false;
+
+    if (chunked)
+    {
+      // Middle and terminating chunks carry neither type nor ID
+      if (((header & 0x7) != SFE_ST25DV_NDEF_TNF_UNCHANGED) || (typeLength != 0) || (idLength != 0))
+        return false;
+      Record &record = records[recordCount - 1];
+      record.header |= header & SFE_ST25DV_NDEF_ME;
+      record.payloadLength += payloadLength;
+      record.segmentCount++;
+    }
+    else
+    {
+      if ((recordCount == MAX_RECORDS) || ((header & 0x7) == SFE_ST25DV_NDEF_TNF_UNCHANGED))
+        return false;
+      Record &record = records[recordCount++];
+      record.header = header;
+      record.typeLength = typeLength;
+      record.idLength = idLength;
+      record.typeOffset = typeOffset;
+      record.payloadLength = payloadLength;
+      record.firstSegment = segmentCount;
+      record.segmentCount = 1;
+    }
+
+    segments[segmentCount].offset = typeOffset + typeLength + idLength;
+    segments[segmentCount].length = payloadLength;
+    segmentCount++;
+    offset = end;
+
+    chunked = (header & SFE_ST25DV_NDEF_CF) == SFE_ST25DV_NDEF_CF;
+    if (!chunked && (header & SFE_ST25DV_NDEF_ME))
+      break;
+  }
+
+  if (chunked) // The terminating chunk is missing
+    return false;
+
+  messageLength = length;
+  valid = true;
+  return true;
+}
+
+bool SFE_ST25DV64KC_NDEFIndex::forEachChunk(const Record &record, SFE_ST25DV64KC_NDEFChunkCallback callback, void *context)
+{
+  uint32_t offset = 0;
+  for (uint8_t i = 0; i < record.segmentCount; i++)
+  {
+    const SFE_ST25DV64KC_NDEFSegment &segment = segments[record.firstSegment + i];
+    if (!callback(&message[segment.offset], segment.length, offset, context))
+      return false;
+    offset += segment.length;
+  }
+  return true;
+}
+
+const SFE_ST25DV64KC_NDEFIndex::Record *SFE_ST25DV64KC_NDEFIndex::find(uint8_t tnf, const uint8_t *type, uint8_t typeLength, uint8_t recordNo)
+{
+  if (!valid)
+    return nullptr;
+
+  uint8_t thisRecord = 0;
+  for (uint8_t i = 0; i < recordCount; i++)
+  {
+    const Record &record = records[i];
+    if ((record.header & 0x7) != tnf || record.typeLength != typeLength)
+      continue;
+    if (memcmp(&message[record.typeOffset], type, typeLength) != 0)
+      continue;
+
+    thisRecord++;
+    if (thisRecord == recordNo)
+      return &record;
+  }
+  return nullptr;
+}
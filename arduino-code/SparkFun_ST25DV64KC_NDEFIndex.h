@@ -0,0 +1,96 @@
+/*
+  This is a library written for the ST25DV64KC Dynamic RFID Tag.
+  SparkFun sells these at its website:
+  https://www.sparkfun.com/products/
+
+  Do you like this library? Help support open source hardware. Buy a board!
+
+  This file declares the NDEF index: a RAM copy of the NDEF message with the record boundaries parsed once, so
+  that the readNDEF* functions find their record without walking the EEPROM.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SPARKFUN_ST25DV64KC_NDEF_INDEX_
+#define _SPARKFUN_ST25DV64KC_NDEF_INDEX_
+
+#include <Arduino.h>
+#include "SparkFun_ST25DV64KC_NDEFPayload.h"
+
+class SFE_ST25DV64KC_NDEFIndex
+{
+public:
+  // Longest NDEF message (TLV V field) held in RAM, longer ones are read from the EEPROM record by record
+  static const uint16_t CAPACITY = 256;
+  static const uint8_t MAX_RECORDS = 8;
+  static const uint8_t MAX_CHUNKS = 16;
+
+  // A chunked record is indexed as one record, its payload as one segment per chunk
+  struct Record
+  {
+    uint8_t header; // MB, CF, SR, IL and TNF of the first chunk, ME of the last one
+    uint8_t typeLength;
+    uint8_t idLength;
+    uint16_t typeOffset;    // into the message, the ID follows the type
+    uint16_t payloadLength; // of all chunks
+    uint8_t firstSegment;
+    uint8_t segmentCount;
+  };
+
+  SFE_ST25DV64KC_NDEFIndex();
+
+  void clear();
+
+  inline bool isValid()
+  {
+    return valid;
+  }
+
+  // Fill the first length bytes with the NDEF message, then call parse()
+  inline uint8_t *buffer()
+  {
+    return message;
+  }
+
+  // Splits the message into records. Returns false if it is malformed or has more than MAX_RECORDS records or
+  // MAX_CHUNKS chunks.
+  bool parse(uint16_t length);
+
+  inline uint8_t getRecordCount()
+  {
+    return recordCount;
+  }
+
+  inline const Record &getRecord(uint8_t index)
+  {
+    return records[index];
+  }
+
+  // Sequential access to the payload, across the chunks of a chunked record
+  inline SFE_ST25DV64KC_NDEFSegmentSource getPayload(const Record &record)
+  {
+    return SFE_ST25DV64KC_NDEFSegmentSource(message, &segments[record.firstSegment], record.segmentCount);
+  }
+
+  // Hands the payload to callback chunk by chunk. Returns false if callback stopped early.
+  bool forEachChunk(const Record &record, SFE_ST25DV64KC_NDEFChunkCallback callback, void *context);
+
+  // Returns the recordNo'th (1 based) record with this TNF and type, nullptr if there is none
+  const Record *find(uint8_t tnf, const uint8_t *type, uint8_t typeLength, uint8_t recordNo);
+
+private:
+  uint8_t message[CAPACITY];
+  uint16_t messageLength;
+  Record records[MAX_RECORDS];
+  uint8_t recordCount;
+  SFE_ST25DV64KC_NDEFSegment segments[MAX_CHUNKS];
+  uint8_t segmentCount;
+  bool valid;
+};
+
+#endif
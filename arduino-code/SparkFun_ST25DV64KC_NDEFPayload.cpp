@@ -0,0 +1,51 @@
+/*
+  This is a library written for the ST25DV64KC Dynamic RFID Tag.
+  SparkFun sells these at its website:
+  https://www.sparkfun.com/products/
+
+  Do you like this library? Help support open source hardware. Buy a board!
+
+  This file implements the NDEF payload sources.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SparkFun_ST25DV64KC_NDEFPayload.h"
+
+SFE_ST25DV64KC_NDEFSegmentSource::SFE_ST25DV64KC_NDEFSegmentSource(const uint8_t *base, const SFE_ST25DV64KC_NDEFSegment *segments, uint8_t segmentCount)
+    : base(base), segments(segments), segmentCount(segmentCount), segment(0), segmentOffset(0)
+{
+  for (uint8_t i = 0; i < segmentCount; i++)
+    length += segments[i].length;
+}
+
+bool SFE_ST25DV64KC_NDEFSegmentSource::read(uint8_t *buffer, uint32_t count)
+{
+  if (count > getRemaining())
+    return false;
+
+  position += count;
+  while (count > 0)
+  {
+    uint16_t available = segments[segment].length - segmentOffset;
+    uint16_t take = (count < available) ? count : available;
+    if (buffer != NULL)
+    {
+      memcpy(buffer, &base[segments[segment].offset + segmentOffset], take);
+      buffer += take;
+    }
+    count -= take;
+    segmentOffset += take;
+    if (segmentOffset == segments[segment].length)
+    {
+      segment++;
+      segmentOffset = 0;
+    }
+  }
+  return true;
+}
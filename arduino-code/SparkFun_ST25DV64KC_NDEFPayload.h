@@ -0,0 +1,75 @@
+/*
+  This is a library written for the ST25DV64KC Dynamic RFID Tag.
+  SparkFun sells these at its website:
+  https://www.sparkfun.com/products/
+
+  Do you like this library? Help support open source hardware. Buy a board!
+
+  This file declares sequential access to the payload of an NDEF record. A chunked record (CF flag) spreads its
+  payload over several chunks; the readers see it as one run of bytes.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SPARKFUN_ST25DV64KC_NDEF_PAYLOAD_
+#define _SPARKFUN_ST25DV64KC_NDEF_PAYLOAD_
+
+#include <Arduino.h>
+
+// Receives a record's payload piece by piece: offset is the position of data within the payload.
+// Return false to stop.
+typedef bool (*SFE_ST25DV64KC_NDEFChunkCallback)(const uint8_t *data, uint16_t length, uint32_t offset, void *context);
+
+// Part of a payload held in memory: one per chunk
+struct SFE_ST25DV64KC_NDEFSegment
+{
+  uint16_t offset;
+  uint16_t length;
+};
+
+class SFE_ST25DV64KC_NDEFPayloadSource
+{
+public:
+  virtual ~SFE_ST25DV64KC_NDEFPayloadSource(){};
+
+  // Copies the next length bytes into buffer, or skips them if buffer is NULL.
+  // Returns false if fewer bytes are left or they could not be read.
+  virtual bool read(uint8_t *buffer, uint32_t length) = 0;
+
+  inline uint32_t getLength()
+  {
+    return length;
+  }
+
+  inline uint32_t getRemaining()
+  {
+    return length - position;
+  }
+
+protected:
+  uint32_t length = 0;
+  uint32_t position = 0;
+};
+
+// Payload held in memory as one or more segments of base
+class SFE_ST25DV64KC_NDEFSegmentSource : public SFE_ST25DV64KC_NDEFPayloadSource
+{
+public:
+  SFE_ST25DV64KC_NDEFSegmentSource(const uint8_t *base, const SFE_ST25DV64KC_NDEFSegment *segments, uint8_t segmentCount);
+
+  bool read(uint8_t *buffer, uint32_t length) override;
+
+private:
+  const uint8_t *base;
+  const SFE_ST25DV64KC_NDEFSegment *segments;
+  uint8_t segmentCount;
+  uint8_t segment;        // current one
+  uint16_t segmentOffset; // within it
+};
+
+#endif
@@ -0,0 +1,259 @@
+/*
+  This is a library written for the ST25DV64KC Dynamic RFID Tag.
+  SparkFun sells these at its website:
+  https://www.sparkfun.com/products/
+
+  Do you like this library? Help support open source hardware. Buy a board!
+
+  This file implements the NDEF reader.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SparkFun_ST25DV64KC_NDEFReader.h"
+#include "SparkFun_ST25DV64KC_Arduino_Library_Constants.h"
+
+SFE_ST25DV64KC_NDEFReader::SFE_ST25DV64KC_NDEFReader(SFE_ST25DV64KC &tag, uint16_t address)
+    : tag(tag), tlvAddress(address), end(0), recordOpen(false), lastRecord(true), chunkAddress(0), chunkRemaining(0),
+      moreChunks(false), typeBuffered(false), typeOffset(0)
+{
+  memset(&record, 0, sizeof(record));
+}
+
+bool SFE_ST25DV64KC_NDEFReader::begin()
+{
+  uint8_t tlv[4];
+  if (!tag.readEEPROM(tlvAddress, tlv, 4)) // Read the TLV T and L Fields
+    return false;
+
+  if (tlv[0] != SFE_ST25DV_TYPE5_NDEF_MESSAGE_TLV) // Check for 0x03
+    return false;
+
+  if (tlv[1] == 0xFF) // Check for 3-byte length
+  {
+    chunkAddress = tlvAddress + 4;
+    end = chunkAddress + ((((uint16_t)tlv[2]) << 8) | tlv[3]);
+  }
+  else
+  {
+    chunkAddress = tlvAddress + 2;
+    end = chunkAddress + tlv[1];
+  }
+
+  recordOpen = false;
+  lastRecord = false;
+  chunkRemaining = 0;
+  moreChunks = false;
+  length = 0;
+  position = 0;
+  return true;
+}
+
+bool SFE_ST25DV64KC_NDEFReader::readChunkHeader(uint16_t address, ChunkHeader &chunk, bool withType)
+{
+  if (address >= end)
+    return false;
+
+  // One read for the header fields and, if it fits, the type
+  uint16_t readLength = withType ? HEADER_READ_LENGTH : 7;
+  if (address + readLength > end)
+    readLength = end - address;
+  if (!tag.readEEPROM(address, buffer, readLength))
+    return false;
+
+  chunk.header = buffer[0];
+  bool shortRecord = (chunk.header & SFE_ST25DV_NDEF_SR) == SFE_ST25DV_NDEF_SR;
+  bool hasIDLength = (chunk.header & SFE_ST25DV_NDEF_IL) == SFE_ST25DV_NDEF_IL;
+  chunk.headerLength = 2 + (shortRecord ? 1 : 4) + (hasIDLength ? 1 : 0);
+  if (chunk.headerLength > readLength)
+    return false;
+
+  chunk.typeLength = buffer[1];
+  if (shortRecord)
+    chunk.payloadLength = buffer[2];
+  else
+  {
+    chunk.payloadLength = ((uint32_t)buffer[2]) << 24;
+    chunk.payloadLength |= ((uint32_t)buffer[3]) << 16;
+    chunk.payloadLength |= ((uint32_t)buffer[4]) << 8;
+    chunk.payloadLength |= buffer[5];
+  }
+  chunk.idLength = hasIDLength ? buffer[chunk.headerLength - 1] : 0;
+
+  // The chunk has to end within the message
+  uint32_t chunkLength = (uint32_t)chunk.headerLength + chunk.typeLength + chunk.idLength + chunk.payloadLength;
+  if (chunkLength > end - address)
+    return false;
+
+  typeBuffered = withType && (chunk.headerLength + chunk.typeLength <= readLength);
+  typeOffset = chunk.headerLength;
+  return true;
+}
+
+bool SFE_ST25DV64KC_NDEFReader::nextChunk(ChunkHeader &chunk)
+{
+  if (!moreChunks || !readChunkHeader(chunkAddress, chunk, false))
+    return false;
+
+  // Middle and terminating chunks carry neither type nor ID
+  if (((chunk.header & 0x7) != SFE_ST25DV_NDEF_TNF_UNCHANGED) || (chunk.typeLength != 0) || (chunk.idLength != 0))
+    return false;
+
+  chunkAddress += chunk.headerLength;
+  chunkRemaining = chunk.payloadLength;
+  moreChunks = (chunk.header & SFE_ST25DV_NDEF_CF) == SFE_ST25DV_NDEF_CF;
+  lastRecord = !moreChunks && (chunk.header & SFE_ST25DV_NDEF_ME);
+  return true;
+}
+
+bool SFE_ST25DV64KC_NDEFReader::next()
+{
+  if (recordOpen)
+  {
+    // Skip the rest of the payload, then any empty chunks left
+    if (!read(NULL, getRemaining()))
+      return false;
+    ChunkHeader chunk;
+    while (moreChunks)
+    {
+      if (!nextChunk(chunk))
+        return false;
+      chunkAddress += chunkRemaining;
+    }
+    recordOpen = false;
+  }
+
+  if (lastRecord || (chunkAddress >= end))
+    return false;
+
+  ChunkHeader chunk;
+  if (!readChunkHeader(chunkAddress, chunk, true) || ((chunk.header & 0x7) == SFE_ST25DV_NDEF_TNF_UNCHANGED))
+    return false;
+
+  record.header = chunk.header;
+  record.typeLength = chunk.typeLength;
+  record.idLength = chunk.idLength;
+  record.typeAddress = chunkAddress + chunk.headerLength;
+  record.payloadLength = chunk.payloadLength;
+
+  chunkAddress = record.typeAddress + chunk.typeLength + chunk.idLength;
+  chunkRemaining = chunk.payloadLength;
+  moreChunks = (chunk.header & SFE_ST25DV_NDEF_CF) == SFE_ST25DV_NDEF_CF;
+  lastRecord = !moreChunks && (chunk.header & SFE_ST25DV_NDEF_ME);
+
+  if (moreChunks)
+  {
+    // Add up the payload of the following chunks, then rewind to the first one. Their headers overwrite the type
+    // in buffer
+    uint16_t payloadAddress = chunkAddress;
+    uint32_t firstLength = chunkRemaining;
+    while (moreChunks)
+    {
+      chunkAddress += chunkRemaining;
+      if (!nextChunk(chunk))
+        return false;
+      record.payloadLength += chunk.payloadLength;
+    }
+    chunkAddress = payloadAddress;
+    chunkRemaining = firstLength;
+    moreChunks = true;
+    lastRecord = false;
+  }
+
+  length = record.payloadLength;
+  position = 0;
+  recordOpen = true;
+  return true;
+}
+
+bool SFE_ST25DV64KC_NDEFReader::isType(uint8_t tnf, const uint8_t *type, uint8_t typeLength)
+{
+  if (!recordOpen || ((record.header & 0x7) != tnf) || (record.typeLength != typeLength))
+    return false;
+
+  if (typeBuffered)
+    return memcmp(&buffer[typeOffset], type, typeLength) == 0;
+
+  // Compare the type piece by piece
+  for (uint8_t done = 0; done < typeLength;)
+  {
+    uint8_t take = ((typeLength - done) < CHUNK_SIZE) ? (typeLength - done) : CHUNK_SIZE;
+    if (!tag.readEEPROM(record.typeAddress + done, buffer, take) || (memcmp(buffer, &type[done], take) != 0))
+      return false;
+    done += take;
+  }
+  return true;
+}
+
+bool SFE_ST25DV64KC_NDEFReader::find(uint8_t tnf, const uint8_t *type, uint8_t typeLength, uint8_t recordNo)
+{
+  uint8_t thisRecord = 0;
+  while (next())
+  {
+    if (isType(tnf, type, typeLength))
+    {
+      thisRecord++;
+      if (thisRecord == recordNo)
+        return true;
+    }
+  }
+  return false;
+}
+
+bool SFE_ST25DV64KC_NDEFReader::read(uint8_t *destination, uint32_t count)
+{
+  if (!recordOpen || (count > getRemaining()))
+    return false;
+
+  position += count;
+  while (count > 0)
+  {
+    if (chunkRemaining == 0)
+    {
+      ChunkHeader chunk;
+      if (!nextChunk(chunk))
+        return false;
+      continue;
+    }
+
+    uint16_t take = (count < chunkRemaining) ? count : chunkRemaining;
+    if (destination != NULL)
+    {
+      if (!tag.readEEPROM(chunkAddress, destination, take))
+        return false;
+      destination += take;
+    }
+    chunkAddress += take;
+    chunkRemaining -= take;
+    count -= take;
+  }
+  return true;
+}
+
+bool SFE_ST25DV64KC_NDEFReader::forEachChunk(SFE_ST25DV64KC_NDEFChunkCallback callback, void *context)
+{
+  typeBuffered = false; // buffer is reused for the payload
+
+  while (getRemaining() > 0)
+  {
+    // Pieces end at chunk boundaries: the next chunk header is read into buffer
+    if (chunkRemaining == 0)
+    {
+      ChunkHeader chunk;
+      if (!nextChunk(chunk))
+        return false;
+      continue;
+    }
+
+    uint32_t offset = position;
+    uint16_t take = (chunkRemaining < CHUNK_SIZE) ? chunkRemaining : CHUNK_SIZE;
+    if (!read(buffer, take) || !callback(buffer, take, offset, context))
+      return false;
+  }
+  return true;
+}
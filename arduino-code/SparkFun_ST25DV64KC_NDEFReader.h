@@ -0,0 +1,103 @@
+/*
+  This is a library written for the ST25DV64KC Dynamic RFID Tag.
+  SparkFun sells these at its website:
+  https://www.sparkfun.com/products/
+
+  Do you like this library? Help support open source hardware. Buy a board!
+
+  This file declares the NDEF reader: it walks the records of the NDEF message in the EEPROM and delivers their
+  payload straight from the I2C reads, either into the caller's buffer (pull) or to a callback in pieces of
+  CHUNK_SIZE bytes (push). The RAM it needs does not depend on the size of the records or of the message.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SPARKFUN_ST25DV64KC_NDEF_READER_
+#define _SPARKFUN_ST25DV64KC_NDEF_READER_
+
+#include <Arduino.h>
+#include "SparkFun_ST25DV64KC_Arduino_Library.h"
+#include "SparkFun_ST25DV64KC_NDEFPayload.h"
+
+class SFE_ST25DV64KC_NDEFReader : public SFE_ST25DV64KC_NDEFPayloadSource
+{
+public:
+  // Largest pushed payload piece, and the reader's only buffer
+  static const uint8_t CHUNK_SIZE = 32;
+  // Read per record header: the longest header of a short record and a short type such as 'T' or 'U'. Longer
+  // types are read when they are compared
+  static const uint8_t HEADER_READ_LENGTH = 8;
+
+  // A chunked record is seen as one record
+  struct Record
+  {
+    uint8_t header; // MB, CF, SR, IL and TNF of the first chunk
+    uint8_t typeLength;
+    uint8_t idLength;
+    uint16_t typeAddress;   // in the EEPROM, the ID follows the type
+    uint32_t payloadLength; // of all chunks
+  };
+
+  // address is that of the NDEF Message TLV, i.e. the CC File length
+  SFE_ST25DV64KC_NDEFReader(SFE_ST25DV64KC &tag, uint16_t address);
+
+  // Reads the TLV header. Returns false if there is no NDEF message
+  bool begin();
+
+  // Moves to the next record, skipping what is left of the current one. Returns false at the end of the message
+  // or if it is malformed
+  bool next();
+
+  inline const Record &getRecord()
+  {
+    return record;
+  }
+
+  bool isType(uint8_t tnf, const uint8_t *type, uint8_t typeLength);
+
+  // Moves to the recordNo'th (1 based) record with this TNF and type, counting from the next record
+  bool find(uint8_t tnf, const uint8_t *type, uint8_t typeLength, uint8_t recordNo = 1);
+
+  // Pull: copies the next length bytes of the current record's payload from the EEPROM into buffer, or skips them
+  // if buffer is NULL
+  bool read(uint8_t *buffer, uint32_t length) override;
+
+  // Push: hands the rest of the current record's payload to callback, up to CHUNK_SIZE bytes at a time.
+  // Returns false if it could not be read or callback stopped early.
+  bool forEachChunk(SFE_ST25DV64KC_NDEFChunkCallback callback, void *context);
+
+private:
+  struct ChunkHeader
+  {
+    uint8_t header;
+    uint8_t headerLength; // Record Header, Type Length, Payload Length and ID Length
+    uint8_t typeLength;
+    uint8_t idLength;
+    uint32_t payloadLength;
+  };
+
+  // Reads the chunk header at address, with as much of the type as HEADER_READ_LENGTH allows when withType is set
+  bool readChunkHeader(uint16_t address, ChunkHeader &chunk, bool withType);
+  // Moves past the next chunk of the current record, which has to be a continuation chunk
+  bool nextChunk(ChunkHeader &chunk);
+
+  SFE_ST25DV64KC &tag;
+  uint16_t tlvAddress;
+  uint32_t end; // of the message
+  Record record;
+  bool recordOpen;         // next() found a record
+  bool lastRecord;         // it carries ME
+  uint16_t chunkAddress;   // of the payload byte read next
+  uint32_t chunkRemaining; // in the current chunk
+  bool moreChunks;         // the current chunk has CF set
+  bool typeBuffered;       // buffer holds the type of the current record
+  uint8_t typeOffset;      // within buffer
+  uint8_t buffer[CHUNK_SIZE];
+};
+
+#endif
@@ -0,0 +1,198 @@
+/*
+  This is a library written for the ST25DV64KC Dynamic RFID Tag.
+  SparkFun sells these at its website:
+  https://www.sparkfun.com/products/
+
+  Do you like this library? Help support open source hardware. Buy a board!
+
+  This file implements the register transaction.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SparkFun_ST25DV64KC_RegisterTransaction.h"
+
+SFE_ST25DV64KC_RegisterTransaction::SFE_ST25DV64KC_RegisterTransaction()
+{
+  clear();
+}
+
+void SFE_ST25DV64KC_RegisterTransaction::clear()
+{
+  updateCount = 0;
+  memset(images, 0, sizeof(images));
+  images[0].addressType = SF_ST25DV64KC_ADDRESS::SYSTEM;
+  images[1].addressType = SF_ST25DV64KC_ADDRESS::DATA;
+}
+
+bool SFE_ST25DV64KC_RegisterTransaction::updateBits(SF_ST25DV64KC_ADDRESS addressType, uint16_t registerAddress, uint8_t bitMask, bool set)
+{
+  return queue(addressType, registerAddress, bitMask, set ? bitMask : 0);
+}
+
+bool SFE_ST25DV64KC_RegisterTransaction::setValue(SF_ST25DV64KC_ADDRESS addressType, uint16_t registerAddress, uint8_t value)
+{
+  return queue(addressType, registerAddress, 0xFF, value);
+}
+
+bool SFE_ST25DV64KC_RegisterTransaction::queue(SF_ST25DV64KC_ADDRESS addressType, uint16_t registerAddress, uint8_t mask, uint8_t value)
+{
+  for (uint8_t i = 0; i < updateCount; i++)
+  {
+    if (updates[i].addressType == addressType && updates[i].registerAddress == registerAddress)
+    {
+      updates[i].value = (updates[i].value & ~mask) | (value & mask);
+      updates[i].mask |= mask;
+      return true;
+    }
+  }
+
+  if (updateCount == MAX_UPDATES)
+    return false;
+
+  updates[updateCount].addressType = addressType;
+  updates[updateCount].registerAddress = registerAddress;
+  updates[updateCount].mask = mask;
+  updates[updateCount].value = value & mask;
+  updateCount++;
+  return true;
+}
+
+bool SFE_ST25DV64KC_RegisterTransaction::execute(SFE_ST2525DV64KC_IO &io, Report *report)
+{
+  Report result = {};
+  result.updates = updateCount;
+
+  uint32_t start = micros();
+
+  // Dynamic registers first: LOCK_CFG, in the system image, has to be the last write
+  bool success = executeImage(io, images[1], false, result);
+  // Every system configuration register below LOCK_CFG is writable, so gaps are rewritten with the value read
+  success = success && executeImage(io, images[0], true, result);
+
+  result.busMicros = micros() - start;
+
+  if (report != nullptr)
+    *report = result;
+
+  updateCount = 0;
+  return success;
+}
+
+bool SFE_ST25DV64KC_RegisterTransaction::executeImage(SFE_ST2525DV64KC_IO &io, Image &image, bool bridgeGaps, Report &report)
+{
+  // Range covered by the updates for this device address
+  uint16_t first = 0xFFFF;
+  uint16_t last = 0;
+  bool partial = false;
+  for (uint8_t i = 0; i < updateCount; i++)
+  {
+    if (updates[i].addressType != image.addressType)
+      continue;
+    if (updates[i].registerAddress < first)
+      first = updates[i].registerAddress;
+    if (updates[i].registerAddress > last)
+      last = updates[i].registerAddress;
+    partial |= updates[i].mask != 0xFF;
+  }
+
+  image.known = 0;
+  if (first > last)
+    return true;
+  if (last - first + 1 > MAX_RANGE)
+    return false;
+
+  image.base = first;
+  image.length = last - first + 1;
+
+  // One burst read gives the current value of every register in the range; without it only whole register writes are possible
+  bool read = partial || bridgeGaps;
+  if (read)
+  {
+    if (!io.readMultipleBytes(image.addressType, image.base, image.values, image.length))
+      return false;
+    report.reads++;
+    image.known = (image.length == 32) ? 0xFFFFFFFF : ((1UL << image.length) - 1);
+  }
+
+  uint32_t dirty = 0;
+  for (uint8_t i = 0; i < updateCount; i++)
+  {
+    if (updates[i].addressType != image.addressType)
+      continue;
+    uint8_t index = updates[i].registerAddress - image.base;
+    uint8_t value = (image.values[index] & ~updates[i].mask) | updates[i].value;
+    if (!read || value != image.values[index])
+      dirty |= 1UL << index;
+    image.values[index] = value;
+  }
+
+  // LOCK_CFG is written on its own, last
+  bool lockConfiguration = false;
+  if (image.addressType == SF_ST25DV64KC_ADDRESS::SYSTEM && REG_LOCK_CFG >= image.base && REG_LOCK_CFG - image.base < image.length)
+  {
+    lockConfiguration = dirty & (1UL << (REG_LOCK_CFG - image.base));
+    dirty &= ~(1UL << (REG_LOCK_CFG - image.base));
+  }
+
+  // Write the dirty registers in runs: contiguous ones, or everything in between when gaps can be bridged
+  for (uint8_t index = 0; index < image.length;)
+  {
+    if (!(dirty & (1UL << index)))
+    {
+      index++;
+      continue;
+    }
+
+    uint8_t end = index;
+    for (uint8_t next = index + 1; next < image.length; next++)
+    {
+      if (dirty & (1UL << next))
+        end = next;
+      else if (!bridgeGaps || image.base + next >= REG_LOCK_CFG)
+        break;
+    }
+
+    if (!writeRun(io, image, index, end, report))
+      return false;
+    index = end + 1;
+  }
+
+  if (lockConfiguration)
+    return writeRun(io, image, REG_LOCK_CFG - image.base, REG_LOCK_CFG - image.base, report);
+
+  return true;
+}
+
+bool SFE_ST25DV64KC_RegisterTransaction::writeRun(SFE_ST2525DV64KC_IO &io, Image &image, uint8_t first, uint8_t last, Report &report)
+{
+  uint8_t length = last - first + 1;
+  if (!io.writeMultipleBytes(image.addressType, image.base + first, &image.values[first], length))
+    return false;
+
+  report.writes++;
+  report.bytes += length;
+  for (uint8_t index = first; index <= last; index++)
+    image.known |= 1UL << index;
+  return true;
+}
+
+bool SFE_ST25DV64KC_RegisterTransaction::getCommittedValue(SF_ST25DV64KC_ADDRESS addressType, uint16_t registerAddress, uint8_t *value)
+{
+  for (uint8_t i = 0; i < 2; i++)
+  {
+    Image &image = images[i];
+    if (image.addressType != addressType || registerAddress < image.base || registerAddress - image.base >= image.length)
+      continue;
+    if (!(image.known & (1UL << (registerAddress - image.base))))
+      return false;
+    *value = image.values[registerAddress - image.base];
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,87 @@
+/*
+  This is a library written for the ST25DV64KC Dynamic RFID Tag.
+  SparkFun sells these at its website:
+  https://www.sparkfun.com/products/
+
+  Do you like this library? Help support open source hardware. Buy a board!
+
+  This file declares the register transaction which collects register updates and commits them with as few
+  I2C transfers as possible: one burst read per device address, contiguous writes merged into bursts and
+  LOCK_CFG written last.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SPARKFUN_ST25DV64KC_REGISTER_TRANSACTION_
+#define _SPARKFUN_ST25DV64KC_REGISTER_TRANSACTION_
+
+#include <Arduino.h>
+#include "SparkFun_ST25DV64KC_IO.h"
+
+class SFE_ST25DV64KC_RegisterTransaction
+{
+public:
+  static const uint8_t MAX_UPDATES = 16;
+  // Largest register range per device address (system configuration is 0x00 - 0x0F, dynamic registers 0x2000 - 0x2007)
+  static const uint8_t MAX_RANGE = 32;
+
+  struct Report
+  {
+    uint8_t updates;    // registers queued
+    uint8_t reads;      // burst reads
+    uint8_t writes;     // burst writes
+    uint16_t bytes;     // register bytes written
+    uint32_t busMicros; // time spent in the transfers, including waiting for write cycles to finish
+  };
+
+  SFE_ST25DV64KC_RegisterTransaction();
+
+  void clear();
+
+  // Queues setting (set = true) or clearing the bits of bitMask. Updates of the same register are combined.
+  // Returns false if the transaction is full.
+  bool updateBits(SF_ST25DV64KC_ADDRESS addressType, uint16_t registerAddress, uint8_t bitMask, bool set);
+
+  // Queues writing the whole register
+  bool setValue(SF_ST25DV64KC_ADDRESS addressType, uint16_t registerAddress, uint8_t value);
+
+  // System configuration writes need an open I2C security session (see SFE_ST25DV64KC::openI2CSession)
+  bool execute(SFE_ST2525DV64KC_IO &io, Report *report = nullptr);
+
+  // After execute(): the value a register holds now, if the transaction read or wrote it
+  bool getCommittedValue(SF_ST25DV64KC_ADDRESS addressType, uint16_t registerAddress, uint8_t *value);
+
+private:
+  struct Update
+  {
+    SF_ST25DV64KC_ADDRESS addressType;
+    uint16_t registerAddress;
+    uint8_t mask;
+    uint8_t value;
+  };
+
+  // Register image of one device address, covering the queued registers
+  struct Image
+  {
+    SF_ST25DV64KC_ADDRESS addressType;
+    uint16_t base;
+    uint8_t length;
+    uint32_t known; // bit per register: read or written by the transaction
+    uint8_t values[MAX_RANGE];
+  };
+
+  Update updates[MAX_UPDATES];
+  uint8_t updateCount;
+  Image images[2];
+
+  bool queue(SF_ST25DV64KC_ADDRESS addressType, uint16_t registerAddress, uint8_t mask, uint8_t value);
+  bool executeImage(SFE_ST2525DV64KC_IO &io, Image &image, bool bridgeGaps, Report &report);
+  bool writeRun(SFE_ST2525DV64KC_IO &io, Image &image, uint8_t first, uint8_t last, Report &report);
+};
+
+#endif
@@ -0,0 +1,98 @@
+/*
+  This is a library written for the ST25DV64KC Dynamic RFID Tag.
+  SparkFun sells these at its website:
+  https://www.sparkfun.com/products/
+
+  Do you like this library? Help support open source hardware. Buy a board!
+
+  This file implements the I2C trace.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SparkFun_ST25DV64KC_Trace.h"
+
+void SFE_ST25DV64KC_Trace::begin()
+{
+#ifdef SFE_ST25DV64KC_TRACE_DWT
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+uint32_t SFE_ST25DV64KC_Trace::cyclesPerMicrosecond()
+{
+#ifdef SFE_ST25DV64KC_TRACE_DWT
+  return SystemCoreClock / 1000000;
+#else
+  return 1;
+#endif
+}
+
+void SFE_ST25DV64KC_Trace::record(uint8_t flags, uint16_t registerAddress, uint16_t length, uint8_t attempt, uint32_t start)
+{
+  uint32_t durationMicros = (flags & TRACE_ASYNC) ? micros() - start : (now() - start) / cyclesPerMicrosecond();
+  uint32_t startMicros = micros() - durationMicros;
+
+#ifdef SFE_ST25DV64KC_TRACE_DWT
+  // Asynchronous transfers complete in interrupt context
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+#endif
+
+  Entry &entry = _entries[_recorded & (SFE_ST25DV64KC_TRACE_LENGTH - 1)];
+  entry.startMicros = startMicros;
+  entry.durationMicros = durationMicros;
+  entry.registerAddress = registerAddress;
+  entry.length = length;
+  entry.flags = flags;
+  entry.attempt = attempt;
+  _recorded++;
+
+  if (flags & TRACE_NACK)
+    _counters.nacks++;
+  else if (flags & TRACE_WRITE)
+  {
+    _counters.writes++;
+    _counters.bytesWritten += length;
+  }
+  else
+  {
+    _counters.reads++;
+    _counters.bytesRead += length;
+  }
+
+  if (flags & TRACE_WRITE)
+    _counters.writeMicros += durationMicros;
+  else
+    _counters.readMicros += durationMicros;
+
+#ifdef SFE_ST25DV64KC_TRACE_DWT
+  __set_PRIMASK(primask);
+#endif
+}
+
+uint8_t SFE_ST25DV64KC_Trace::copyEntries(Entry *entries, uint8_t maxEntries, uint8_t skipNewest)
+{
+  uint32_t available = _recorded < SFE_ST25DV64KC_TRACE_LENGTH ? _recorded : SFE_ST25DV64KC_TRACE_LENGTH;
+  if (skipNewest >= available)
+    return 0;
+  available -= skipNewest;
+  uint8_t count = available < maxEntries ? available : maxEntries;
+
+  for (uint8_t i = 0; i < count; i++)
+    entries[i] = _entries[(_recorded - skipNewest - count + i) & (SFE_ST25DV64KC_TRACE_LENGTH - 1)];
+
+  return count;
+}
+
+void SFE_ST25DV64KC_Trace::reset()
+{
+  _recorded = 0;
+  _counters = {};
+}
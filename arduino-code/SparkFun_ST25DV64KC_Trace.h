@@ -0,0 +1,118 @@
+/*
+  This is a library written for the ST25DV64KC Dynamic RFID Tag.
+  SparkFun sells these at its website:
+  https://www.sparkfun.com/products/
+
+  Do you like this library? Help support open source hardware. Buy a board!
+
+  This file declares the I2C trace: aggregated transfer counters and a ring buffer of the most recent transfers,
+  timed with the DWT cycle counter on Cortex-M (micros() elsewhere). Times are kept in microseconds, converted
+  at the core clock the transfer ran at, which changes with the clock operating point. The cycle counter stops
+  while the core sleeps, so asynchronous transfers, which it may sleep through, are timed with micros().
+  Recording a transfer costs a few stores, so it is always compiled in.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SPARKFUN_ST25DV64KC_TRACE_
+#define _SPARKFUN_ST25DV64KC_TRACE_
+
+#include <Arduino.h>
+
+// Ring buffer entries, a power of two
+#ifndef SFE_ST25DV64KC_TRACE_LENGTH
+#define SFE_ST25DV64KC_TRACE_LENGTH 32
+#endif
+
+#if defined(DWT) && defined(CoreDebug) && defined(DWT_CTRL_CYCCNTENA_Msk)
+#define SFE_ST25DV64KC_TRACE_DWT
+#endif
+
+class SFE_ST25DV64KC_Trace
+{
+public:
+  enum Flags : uint8_t
+  {
+    TRACE_WRITE = 0x01,  // otherwise a read
+    TRACE_SYSTEM = 0x02, // system configuration device address, otherwise user memory / dynamic registers / mailbox
+    TRACE_NACK = 0x04,   // the transfer failed
+    TRACE_ASYNC = 0x08,  // asynchronous mailbox transfer
+  };
+
+  struct Entry
+  {
+    uint32_t startMicros; // micros() when the transfer started
+    uint32_t durationMicros;
+    uint16_t registerAddress;
+    uint16_t length;
+    uint8_t flags;
+    uint8_t attempt; // 0 for the first try, n for the n-th retry
+  };
+
+  struct Counters
+  {
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t bytesRead;
+    uint32_t bytesWritten;
+    uint32_t nacks;
+    uint32_t retries;
+    uint32_t readMicros;
+    uint32_t writeMicros;
+  };
+
+  // Starts the cycle counter
+  void begin();
+
+  static inline uint32_t now()
+  {
+#ifdef SFE_ST25DV64KC_TRACE_DWT
+    return DWT->CYCCNT;
+#else
+    return micros();
+#endif
+  }
+
+  // Cycle counter ticks per microsecond at the current core clock
+  static uint32_t cyclesPerMicrosecond();
+
+  // Records a finished transfer started at start, a now() value or a micros() one for TRACE_ASYNC transfers.
+  // Safe to call from interrupt context.
+  void record(uint8_t flags, uint16_t registerAddress, uint16_t length, uint8_t attempt, uint32_t start);
+
+  inline void countRetry()
+  {
+    _counters.retries++;
+  }
+
+  inline const Counters &getCounters()
+  {
+    return _counters;
+  }
+
+  // Transfers recorded since the last reset, the ring holds the last SFE_ST25DV64KC_TRACE_LENGTH of them
+  inline uint32_t getRecorded()
+  {
+    return _recorded;
+  }
+
+  // Copies up to maxEntries of the most recent entries, oldest first, leaving out the skipNewest newest ones.
+  // Returns the number copied.
+  uint8_t copyEntries(Entry *entries, uint8_t maxEntries, uint8_t skipNewest = 0);
+
+  void reset();
+
+private:
+  static_assert((SFE_ST25DV64KC_TRACE_LENGTH & (SFE_ST25DV64KC_TRACE_LENGTH - 1)) == 0, "SFE_ST25DV64KC_TRACE_LENGTH must be a power of two");
+
+  Entry _entries[SFE_ST25DV64KC_TRACE_LENGTH] = {};
+  uint32_t _recorded = 0;
+  Counters _counters = {};
+};
+
+#endif
@@ -19,6 +19,7 @@ bool Wallet::initWithStringifiedPrivateKey(const char *privateKeyAsString)
   Serial1.println("Initializing keys with stringified private key...");
 
   hex2bin(privateKeyAsString, privKey);
+  wipeRandomState();
   initialized = uECC_compute_public_key(privKey, pubKey) != 0;
   if (!initialized)
   {
@@ -38,7 +39,7 @@ bool Wallet::initWithStringifiedPrivateKey(const char *privateKeyAsString)
   return true;
 }
 
-Wallet::Wallet() : initialized(false), luksoAddress(""), privKey(), pubKey()
+Wallet::Wallet() : initialized(false), privKey(), pubKey(), luksoAddress(""), luksoAddressBytes()
 {
   uECC_set_rng(&trueRandomNumberGenerator);
 }
@@ -55,6 +56,7 @@ bool Wallet::createKeys()
   Serial1.println("Creating keys...");
 #endif
 
+  wipeRandomState();
   if (uECC_make_key(pubKey, privKey) == 0)
   {
 #ifdef DEBUG
@@ -197,13 +199,14 @@ bool Wallet::signUnhashedMessage(const char* message, uint8_t hashedMessage[KECC
 void Wallet::calculateLuksoAddress()
 {
   luksoAddress = keccak256((void *)pubKey, PUBLIC_KEY_LENGTH).substr(24);
-  const char *checksumReference = keccak256((void *)luksoAddress.c_str(), 40).c_str();
+  const std::string checksumReference = keccak256((void *)luksoAddress.c_str(), 40);
   for (uint8_t i = 0; i < 40; i++)
   {
     if (checksumReference[i] > '7' && luksoAddress[i] >= 'a')
       luksoAddress[i] = luksoAddress[i] - ('a' - 'A');
   }
   luksoAddress = ("0x" + luksoAddress);
+  hex2bin(luksoAddress.c_str() + 2, luksoAddressBytes);
 }
 
 bool Wallet::isInitialized()
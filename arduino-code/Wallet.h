@@ -21,6 +21,16 @@ class Wallet
       return luksoAddress.c_str();
     }
 
+    inline const uint8_t *getLuksoAddressBytes()
+    {
+      return luksoAddressBytes;
+    }
+
+    inline const uint8_t *getPublicKey()
+    {
+      return pubKey;
+    }
+
   private:
     bool initialized;
 
@@ -35,4 +45,5 @@ class Wallet
     uint8_t privKey[PRIVATE_KEY_LENGTH];
     uint8_t pubKey[PUBLIC_KEY_LENGTH];
     std::string luksoAddress;
+    uint8_t luksoAddressBytes[LUKSO_ADDRESS_LENGTH];
 };
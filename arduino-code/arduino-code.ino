@@ -4,9 +4,15 @@
 #include "NFCTag.h"
 #include "crypto-util.h"
 #include "uECC.h"
+#include "EntropyPool.h"
+#include "KeccakDRBG.h"
+#include "ClockGovernor.h"
+#include "IdleScheduler.h"
+#include "JobScheduler.h"
 
 #define GPO_PIN PA1
 #define VCC_ST25_I2C PB4
+#define RANDOM_SAMPLE_POLLS 100000 // A word takes well under 100 polls
 
 extern "C" void SystemClock_Config(void);
 extern "C" void HAL_RNG_MspInit(RNG_HandleTypeDef *hrng);
@@ -14,32 +20,201 @@ extern "C" void HAL_RNG_MspDeInit(RNG_HandleTypeDef *hrng);
 
 RNG_HandleTypeDef hrng;
 
+static bool waitForRandomSample();
+EntropyPool entropyPool(&waitForRandomSample);
+static volatile bool randomFillRunning = false;
+
+static bool readSupply(bool *fieldOn, bool *harvesting);
+JobScheduler jobs(&readSupply);
+
+// Asks the RNG for the next word, which arrives in HAL_RNG_ReadyDataCallback
+static void startRandomFill()
+{
+  if (randomFillRunning || entropyPool.isFull() || entropyPool.hasFailed())
+    return;
+  randomFillRunning = true;
+  if (HAL_RNG_GenerateRandomNumber_IT(&hrng) != HAL_OK)
+    randomFillRunning = false;
+}
+
+extern "C" void HAL_RNG_ReadyDataCallback(RNG_HandleTypeDef *hrng, uint32_t random32bit)
+{
+  randomFillRunning = false;
+  // Refilling is a job: it pauses after this word once the supply is no longer stable. The supply is the one
+  // loop() last sampled through jobs.run(), at most JobScheduler::SAMPLE_INTERVAL_MICROS old while the pool fills
+  if (entropyPool.addSample(random32bit) && jobs.isSupplyStable())
+    startRandomFill();
+}
+
+extern "C" void HAL_RNG_ErrorCallback(RNG_HandleTypeDef *hrng)
+{
+  randomFillRunning = false; // Seed or clock error, serviceEntropyPool() reinitializes the RNG
+}
+
+extern "C" void RNG_IRQHandler(void)
+{
+  HAL_RNG_IRQHandler(&hrng);
+}
+
+// The pool ran dry while signing. Rather than waiting for the RNG interrupt word by word, the RNG is serviced here by
+// polling its interrupt handler
+static bool waitForRandomSample()
+{
+  uint32_t before = entropyPool.getSampleCount();
+  HAL_NVIC_DisableIRQ(RNG_IRQn);
+  startRandomFill();
+  for (uint32_t polls = 0; randomFillRunning && entropyPool.getSampleCount() == before && polls < RANDOM_SAMPLE_POLLS; polls++)
+    HAL_RNG_IRQHandler(&hrng);
+  HAL_NVIC_EnableIRQ(RNG_IRQn);
+  return entropyPool.getSampleCount() != before;
+}
+
+// Restarts the RNG after an error or a failed health test and keeps the pool filling
+static void serviceEntropyPool()
+{
+  if (entropyPool.hasFailed() || HAL_RNG_GetState(&hrng) == HAL_RNG_STATE_ERROR)
+  {
+#ifdef DEBUG
+    Serial1.printf("Random number generator failed (repetition %u, proportion %u). Restarting...\n", entropyPool.getRepetitionFailures(), entropyPool.getProportionFailures());
+#endif
+    HAL_NVIC_DisableIRQ(RNG_IRQn);
+    HAL_RNG_DeInit(&hrng);
+    randomFillRunning = false;
+    entropyPool.reset();
+    HAL_RNG_Init(&hrng);
+    HAL_NVIC_EnableIRQ(RNG_IRQn);
+  }
+  startRandomFill();
+}
+
+static JobScheduler::StepResult refillEntropyPool(void *context)
+{
+  serviceEntropyPool();
+  return entropyPool.isFull() && !entropyPool.hasFailed() ? JobScheduler::STEP_DONE : JobScheduler::STEP_MORE;
+}
+
+static bool readEntropyPool(uint8_t *dest, unsigned size)
+{
+  return entropyPool.read(dest, size);
+}
+
+KeccakDRBG drbg(&readEntropyPool);
+
+// uECC's RNG. The DRBG touches the entropy pool only to reseed
 int trueRandomNumberGenerator(uint8_t *dest, unsigned size)
 {
-  uint32_t aRandom32bit;
-  for (unsigned i = 0; i < size; i += 4)
+  return drbg.generate(dest, size) ? 1 : 0;
+}
+
+void wipeRandomState()
+{
+  drbg.wipe();
+}
+
+static uint32_t msiRange(uint8_t megahertz)
+{
+  return megahertz == 48 ? RCC_MSIRANGE_11 : megahertz == 24 ? RCC_MSIRANGE_9 : RCC_MSIRANGE_7;
+}
+
+// Voltage range up before the clock, down after it. The PLL needs MSI at 8 MHz as its input, so it is only
+// switched on from the idle point
+static bool switchClock(ClockGovernor::OperatingPoint point)
+{
+  const ClockGovernor::OperatingPointInfo &info = ClockGovernor::operatingPoints[point];
+  RCC_OscInitTypeDef RCC_OscInitStruct = {0};
+  RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
+  RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+  RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
+  RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
+  RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
+
+  if (info.voltageRange == 1 && HAL_PWREx_ControlVoltageScaling(PWR_REGULATOR_VOLTAGE_SCALE1) != HAL_OK)
+    return false;
+
+  if (point == ClockGovernor::PLL_80MHZ)
   {
-    while (HAL_RNG_GenerateRandomNumber(&hrng, &aRandom32bit) != HAL_OK)
-      delay(1);
-    for (uint8_t j = 0; j < 4 && i + j < size; j++)
+    RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+    RCC_OscInitStruct.PLL.PLLState = RCC_PLL_ON;
+    RCC_OscInitStruct.PLL.PLLSource = RCC_PLLSOURCE_MSI;
+    RCC_OscInitStruct.PLL.PLLM = 1;
+    RCC_OscInitStruct.PLL.PLLN = 20; // 8 MHz * 20 / 2
+    RCC_OscInitStruct.PLL.PLLP = RCC_PLLP_DIV7;
+    RCC_OscInitStruct.PLL.PLLQ = RCC_PLLQ_DIV4;
+    RCC_OscInitStruct.PLL.PLLR = RCC_PLLR_DIV2;
+    if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
+      return false;
+    RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
+    if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, info.flashLatency) != HAL_OK)
+      return false;
+  }
+  else
+  {
+    bool fromPLL = __HAL_RCC_GET_SYSCLK_SOURCE() == RCC_SYSCLKSOURCE_STATUS_PLLCLK;
+    if (!fromPLL)
+    {
+      // HAL_RCC_OscConfig adjusts the flash latency when it changes the range of MSI running SYSCLK
+      RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_MSI;
+      RCC_OscInitStruct.MSIState = RCC_MSI_ON;
+      RCC_OscInitStruct.MSICalibrationValue = RCC_MSICALIBRATION_DEFAULT;
+      RCC_OscInitStruct.MSIClockRange = msiRange(info.megahertz);
+      RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
+      if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
+        return false;
+    }
+    RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_MSI;
+    if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, info.flashLatency) != HAL_OK)
+      return false;
+    if (fromPLL)
     {
-      *dest = (uint8_t)(aRandom32bit >> (j * 8));
-      ++dest;
+      RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+      RCC_OscInitStruct.PLL.PLLState = RCC_PLL_OFF;
+      HAL_RCC_OscConfig(&RCC_OscInitStruct);
     }
   }
 
-  return 1;
+  if (info.voltageRange == 2 && HAL_PWREx_ControlVoltageScaling(PWR_REGULATOR_VOLTAGE_SCALE2) != HAL_OK)
+    return false;
+  return true;
+}
+
+// Called with interrupts disabled: the interrupt that ends the wait is taken only after the clocks are back
+static void enterIdle(IdleScheduler::Mode mode)
+{
+  if (mode == IdleScheduler::SLEEP)
+  {
+    // SysTick keeps running, deferred jobs are looked at again within a millisecond
+    HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+    return;
+  }
+
+  HAL_SuspendTick();
+  HAL_PWREx_EnterSTOP2Mode(PWR_STOPENTRY_WFI);
+  // The MCU wakes up on MSI in the range it had, the idle operating point. HSI16 for I2C1 and USART1 and the
+  // voltage range are set up again
+  SystemClock_Config();
+  HAL_ResumeTick();
 }
 
+ClockGovernor governor(&switchClock);
+IdleScheduler idleScheduler(&enterIdle);
 Wallet wallet;
-NFCTag nfcTag(wallet);
+NFCTag nfcTag(wallet, nullptr, &governor, &jobs);
 HardwareSerial Serial1(PA10, PA9);
 
-// Interrupt Service Routine
+static bool readSupply(bool *fieldOn, bool *harvesting)
+{
+  return nfcTag.readSupply(fieldOn, harvesting);
+}
+
+static volatile bool messagePending = false;
+// The message is read MESSAGE_SETTLE_MILLIS after the GPO fired
+static bool messageSettling = false;
+static uint32_t messageArrivedAt = 0;
+
+// Interrupt Service Routine. Wakes the MCU, the message is handled in loop()
 void handleMessage()
 {
-  delay(250);
-  nfcTag.handleMessage();
+  messagePending = true;
 }
 
 void setup()
@@ -63,6 +238,19 @@ void setup()
       delay(1); // Infinite loop
     }
   }
+  HAL_NVIC_SetPriority(RNG_IRQn, 15, 0); // Lowest, filling the pool is never urgent
+  HAL_NVIC_EnableIRQ(RNG_IRQn);
+  jobs.setJob(JobScheduler::ENTROPY_REFILL, &refillEntropyPool, nullptr);
+  startRandomFill();
+  if (!drbg.reseed())
+  {
+#ifdef DEBUG
+    Serial1.println("Booting failed. Could not seed random number generator. Freezing...");
+#endif
+    while (true){
+      delay(1); // Infinite loop
+    }
+  }
 
   if (!wallet.init())
   {
@@ -94,28 +282,58 @@ void setup()
 
 void loop()
 {
-  delay(1);
+  if (messagePending)
+  {
+    messagePending = false;
+    messageSettling = true;
+    messageArrivedAt = millis();
+  }
+  if (messageSettling && millis() - messageArrivedAt >= MESSAGE_SETTLE_MILLIS)
+  {
+    messageSettling = false;
+    nfcTag.handleMessage();
+  }
+  nfcTag.completeTransfers();
+  if (!entropyPool.isFull() || entropyPool.hasFailed())
+    jobs.request(JobScheduler::ENTROPY_REFILL);
+  // The jobs read the supply over I2C and would wait for the reply transfer. They run once its completion
+  // interrupt has woken the MCU
+  if (!nfcTag.isTransferPending())
+    jobs.run();
+
+#ifdef DEBUG
+  // USART1 runs from HSI16, which STOP2 stops. Flushed here: the TX interrupt that empties the buffer cannot run
+  // once interrupts are disabled
+  Serial1.flush();
+#endif
+  noInterrupts();
+  idleScheduler.idle(messagePending, messageSettling || randomFillRunning || jobs.hasWork() || nfcTag.isTransferPending());
+  interrupts();
 }
 
 void SystemClock_Config(void)
 {
   RCC_OscInitTypeDef RCC_OscInitStruct = {0};
   RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
+  RCC_PeriphCLKInitTypeDef PeriphClkInit = {0};
 
-  /** Configure the main internal regulator output voltage
+  /** Configure the main internal regulator output voltage. Range 2 at the idle operating point of the
+   *  ClockGovernor, which raises it for signing
    */
-  if (HAL_PWREx_ControlVoltageScaling(PWR_REGULATOR_VOLTAGE_SCALE1) != HAL_OK)
+  if (HAL_PWREx_ControlVoltageScaling(PWR_REGULATOR_VOLTAGE_SCALE2) != HAL_OK)
   {
     Error_Handler();
   }
 
   /** Initializes the RCC Oscillators according to the specified parameters
-     in the RCC_OscInitTypeDef structure.
+     in the RCC_OscInitTypeDef structure. HSI16 clocks I2C1 and USART1, independent of SYSCLK
   */
-  RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_MSI;
+  RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_MSI | RCC_OSCILLATORTYPE_HSI;
   RCC_OscInitStruct.MSIState = RCC_MSI_ON;
   RCC_OscInitStruct.MSICalibrationValue = 0;
   RCC_OscInitStruct.MSIClockRange = RCC_MSIRANGE_7;
+  RCC_OscInitStruct.HSIState = RCC_HSI_ON;
+  RCC_OscInitStruct.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
   RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
   if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
   {
@@ -130,7 +348,15 @@ void SystemClock_Config(void)
   RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
   RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
 
-  if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_0) != HAL_OK)
+  if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_1) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  PeriphClkInit.PeriphClockSelection = RCC_PERIPHCLK_I2C1 | RCC_PERIPHCLK_USART1;
+  PeriphClkInit.I2c1ClockSelection = RCC_I2C1CLKSOURCE_HSI;
+  PeriphClkInit.Usart1ClockSelection = RCC_USART1CLKSOURCE_HSI;
+  if (HAL_RCCEx_PeriphCLKConfig(&PeriphClkInit) != HAL_OK)
   {
     Error_Handler();
   }
@@ -8,14 +8,32 @@
 
 #define DEBUG
 
+// Transfer the mailbox reply through DMA (STM32 HAL) instead of blocking Wire writes
+// #define I2C_DMA
+
+// Sign at each clock operating point in turn instead of as the energy headroom allows, so DIAGNOSTICS reports the
+// time to signature at every point
+// #define CLOCK_GOVERNOR_SWEEP
+
+#define FIRMWARE_VERSION_MAJOR 1
+#define FIRMWARE_VERSION_MINOR 1
+#define FIRMWARE_VERSION_PATCH 0
+
 #define PRIVATE_KEY_LENGTH 32
 #define PUBLIC_KEY_LENGTH 64
 #define SIGNATURE_LENGTH 65
 #define LUKSO_ADDRESS_LENGTH 20
 #define LUKSO_ADDRESS_AS_STRING_LENGTH 42
+#define DEVICE_UID_LENGTH 8
 
 #define MAILBOX_LENGTH 256
+#define ARENA_SCRATCH_LENGTH 64 // SIGN's hash copy, DIAGNOSTICS trace entries a few at a time
+#define ARENA_LENGTH (MAILBOX_LENGTH + ARENA_SCRATCH_LENGTH)
+#define SIGN_BATCH_LIMIT 1
+#define KEY_SLOT_COUNT 1
+#define CURVE_ID_SECP256K1 0x01
 #define PASSWORD_LENGTH 8
+#define MESSAGE_SETTLE_MILLIS 250 // from the GPO to reading the mailbox, the MCU sleeps meanwhile
 
 #define EEPROM_KEYS_INITIALIZED_MAGIC_VALUE 0xaa
 #define EEPROM_KEYS_INITIALIZED_ADDRESS 0
@@ -25,6 +43,18 @@
 #define EEPROM_NFC_TAG_INITIALIZED_MAGIC_VALUE 0xaa
 #define EEPROM_NFC_TAG_INITIALIZED_ADDRESS 97
 
+#define EEPROM_CONTRACT_ADDRESS_SET_MAGIC_VALUE 0xaa
+#define EEPROM_CONTRACT_ADDRESS_SET_ADDRESS 98
+#define EEPROM_CONTRACT_ADDRESS_ADDRESS 99
+
+// URI record and two Text records with a LUKSO address each, as composed by NFCTag::updateNDEFRecords
+#define NDEF_MESSAGE_LENGTH 160
+
+// Store the wallet and contract addresses as 20 byte NFC Forum External Type records instead of 42 char Text records.
+// The phone app has to read these types.
+// #define NDEF_EXTERNAL_TYPE_RECORDS
+#define NDEF_EXTERNAL_TYPE_ADDRESS "lukso.io:addr"
+#define NDEF_EXTERNAL_TYPE_CONTRACT "lukso.io:contract"
 #define NDEF_URI_PREFIX_LENGTH 7
 #define NDEF_URI_POSTFIX_LENGTH 1
 #define NDEF_TEXT_PREFIX_LENGTH 7
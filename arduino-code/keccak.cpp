@@ -15,11 +15,13 @@ Keccak::Keccak(Bits bits)
 {
     reset();
 }
-/// restart
+/// restart, wiping the data added so far
 void Keccak::reset()
 {
     for (size_t i = 0; i < StateSize; i++)
         m_hash[i] = 0;
+    for (size_t i = 0; i < MaxBlockSize; i++)
+        m_buffer[i] = 0;
     m_numBytes = 0;
     m_bufferSize = 0;
 }
@@ -269,6 +271,15 @@ std::string Keccak::getHash()
     }
     return result;
 }
+/// return latest hash as bits / 8 raw bytes
+void Keccak::getHash(uint8_t *digest)
+{
+    // process remaining bytes
+    processBuffer();
+    unsigned int digestLength = m_bits / 8;
+    for (unsigned int i = 0; i < digestLength; i++)
+        digest[i] = (uint8_t)(m_hash[i / 8] >> (8 * (i % 8)));
+}
 /// compute Keccak hash of a memory block
 std::string Keccak::operator()(const void *data, size_t numBytes)
 {
@@ -50,7 +50,9 @@ public:
     void add(const void *data, size_t numBytes);
     /// return latest hash as hex characters
     std::string getHash();
-    /// restart
+    /// return latest hash as bits / 8 raw bytes
+    void getHash(uint8_t *digest);
+    /// restart, wiping the data added so far
     void reset();
 
 private:
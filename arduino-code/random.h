@@ -1,3 +1,5 @@
 #pragma once
 
 int trueRandomNumberGenerator(uint8_t *dest, unsigned size);
+// Called when the wallet key changes: what trueRandomNumberGenerator hands out afterwards starts from fresh entropy
+void wipeRandomState();
@@ -0,0 +1,46 @@
+#include "DeferredBus.h"
+
+DeferredBus::DeferredBus()
+    : asyncTransfers(0), pending(false), write(false), address(0), memAddress(0), buffer(nullptr), length(0), callback(nullptr), context(nullptr)
+{
+}
+
+bool DeferredBus::memReadAsync(uint8_t newAddress, uint16_t newMemAddress, uint8_t *newBuffer, uint16_t newLength, SFE_ST25DV64KC_TransferCallback newCallback, void *newContext)
+{
+  if (pending)
+    return false;
+  pending = true;
+  write = false;
+  address = newAddress;
+  memAddress = newMemAddress;
+  buffer = newBuffer;
+  length = newLength;
+  callback = newCallback;
+  context = newContext;
+  asyncTransfers++;
+  return true;
+}
+
+bool DeferredBus::memWriteAsync(uint8_t newAddress, uint16_t newMemAddress, const uint8_t *newBuffer, uint16_t newLength, SFE_ST25DV64KC_TransferCallback newCallback, void *newContext)
+{
+  if (!memReadAsync(newAddress, newMemAddress, const_cast<uint8_t *>(newBuffer), newLength, newCallback, newContext))
+    return false;
+  write = true;
+  return true;
+}
+
+bool DeferredBus::isBusy()
+{
+  return pending;
+}
+
+void DeferredBus::poll()
+{
+  if (!pending)
+    return;
+
+  bool success = write ? memWrite(address, memAddress, buffer, length) : memRead(address, memAddress, buffer, length);
+  pending = false;
+  if (callback != nullptr)
+    callback(success, context);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../arduino-code/SparkFun_ST25DV64KC_Bus.h"
+
+// Wire bus whose asynchronous transfers only happen on poll(), like a DMA transfer finishing after the caller
+// moved on. Lets the host build exercise the asynchronous paths of the IO layer and NFCTag.
+class DeferredBus : public SFE_ST25DV64KC_WireBus
+{
+public:
+  DeferredBus();
+
+  bool memReadAsync(uint8_t address, uint16_t memAddress, uint8_t *buffer, uint16_t length, SFE_ST25DV64KC_TransferCallback callback, void *context) override;
+  bool memWriteAsync(uint8_t address, uint16_t memAddress, const uint8_t *buffer, uint16_t length, SFE_ST25DV64KC_TransferCallback callback, void *context) override;
+  bool isBusy() override;
+  void poll() override;
+
+  uint32_t asyncTransfers;
+
+private:
+  bool pending;
+  bool write;
+  uint8_t address;
+  uint16_t memAddress;
+  uint8_t *buffer;
+  uint16_t length;
+  SFE_ST25DV64KC_TransferCallback callback;
+  void *context;
+};
@@ -0,0 +1,82 @@
+#include "HostHarness.h"
+#include "../arduino-code/NFCTag.h"
+#include "../arduino-code/random.h"
+#include <Wire.h>
+#include <EEPROM.h>
+
+namespace host
+{
+  ST25DV64KCModel model;
+  DeferredBus bus;
+
+  static uint32_t randomState = 1;
+  static bool gpoPending = false;
+
+  static void onGpo(void *)
+  {
+    gpoPending = true;
+  }
+
+  void seedRandom(uint32_t seed)
+  {
+    randomState = seed != 0 ? seed : 1;
+  }
+
+  uint32_t nextRandom()
+  {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+  }
+
+  bool boot(Wallet &wallet, NFCTag &nfcTag)
+  {
+    model.factoryReset();
+    model.setGpoCallback(&onGpo, nullptr);
+    Wire.attach(&model);
+    bus.setPort(Wire);
+    EEPROM.clear();
+
+    if (!wallet.init() || !nfcTag.init())
+      return false;
+
+    model.setRFField(true);
+    return true;
+  }
+
+  bool beginTag(SFE_ST25DV64KC &tag)
+  {
+    model.factoryReset();
+    model.setGpoCallback(nullptr, nullptr);
+    Wire.attach(&model);
+    return tag.begin(Wire);
+  }
+
+  bool exchange(NFCTag &nfcTag, const uint8_t *request, uint16_t requestLength, uint8_t *reply, uint16_t *replyLength)
+  {
+    gpoPending = false;
+    if (!model.rfPutMessage(request, requestLength) || !gpoPending)
+      return false;
+
+    nfcTag.handleMessage();
+    while (nfcTag.isTransferPending())
+    {
+      bus.poll();
+      nfcTag.completeTransfers();
+    }
+    return model.rfGetMessage(reply, replyLength);
+  }
+}
+
+int trueRandomNumberGenerator(uint8_t *dest, unsigned size)
+{
+  for (unsigned i = 0; i < size; i++)
+    dest[i] = (uint8_t)host::nextRandom();
+  return 1;
+}
+
+void wipeRandomState()
+{
+  // The host stand-in is a plain seeded sequence, reproducible on purpose
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include "ST25DV64KCModel.h"
+#include "DeferredBus.h"
+
+// Shared setup for the host programs: a model on the Wire bus, a seeded random number generator standing in for
+// the STM32 RNG, and request/reply exchanges through the mailbox as the phone would do them.
+class Wallet;
+class NFCTag;
+class SFE_ST25DV64KC;
+
+namespace host
+{
+  extern ST25DV64KCModel model;
+  // Pass to the NFCTag constructor so replies go through the asynchronous path
+  extern DeferredBus bus;
+
+  void seedRandom(uint32_t seed);
+  uint32_t nextRandom();
+
+  // Factory resets model and µC eeprom, then boots wallet and tag like setup() does
+  bool boot(Wallet &wallet, NFCTag &nfcTag);
+
+  // Factory resets model and begins the driver on it directly, for programs without the firmware
+  bool beginTag(SFE_ST25DV64KC &tag);
+
+  // Puts the request into the mailbox, runs the handler the GPO interrupt would trigger, completes the reply
+  // transfer as the bus interrupt would while the main loop sleeps and takes the reply.
+  // The MESSAGE_SETTLE_MILLIS the main loop sleeps before reading the mailbox are not part of the exchange.
+  bool exchange(NFCTag &nfcTag, const uint8_t *request, uint16_t requestLength, uint8_t *reply, uint16_t *replyLength);
+}
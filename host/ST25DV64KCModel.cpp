@@ -0,0 +1,491 @@
+#include "ST25DV64KCModel.h"
+#include "HostClock.h"
+#include <Arduino.h>
+#include <string.h>
+
+// Register map, see SparkFun_ST25DV64KC_Arduino_Library_Constants.h
+static const uint16_t REG_GPO1 = 0x00;
+static const uint16_t REG_EH_MODE = 0x02;
+static const uint16_t REG_ENDA1 = 0x05;
+static const uint16_t REG_ENDA2 = 0x07;
+static const uint16_t REG_ENDA3 = 0x09;
+static const uint16_t REG_I2CSS = 0x0b;
+static const uint16_t REG_FTM = 0x0d;
+static const uint16_t REG_READ_ONLY_BASE = 0x14;
+static const uint16_t REG_I2C_PASSWD_BASE = 0x0900;
+
+static const uint16_t DYN_REG_GPO_CTRL_DYN = 0x2000;
+static const uint16_t DYN_REG_EH_CTRL_DYN = 0x2002;
+static const uint16_t DYN_REG_RF_MNGT_DYN = 0x2003;
+static const uint16_t DYN_REG_I2C_SSO_DYN = 0x2004;
+static const uint16_t DYN_REG_IT_STS_DYN = 0x2005;
+static const uint16_t DYN_REG_MB_CTRL_DYN = 0x2006;
+static const uint16_t DYN_REG_MB_LEN_DYN = 0x2007;
+static const uint16_t MAILBOX_BASE = 0x2008;
+
+static const uint8_t MB_EN = 1 << 0;
+static const uint8_t HOST_PUT_MSG = 1 << 1;
+static const uint8_t RF_PUT_MSG = 1 << 2;
+static const uint8_t HOST_CURRENT_MSG = 1 << 6;
+static const uint8_t RF_CURRENT_MSG = 1 << 7;
+
+static const uint8_t EH_EN = 1 << 0;
+static const uint8_t EH_ON = 1 << 1;
+static const uint8_t FIELD_ON = 1 << 2;
+static const uint8_t VCC_ON = 1 << 3;
+
+static const uint8_t GPO_EN = 1 << 0;
+static const uint8_t GPO1_RF_PUT_MSG_EN = 1 << 5;
+static const uint8_t IT_STS_RF_PUT_MSG = 1 << 5;
+
+static const uint8_t PASSWORD_PRESENT = 0x09;
+static const uint8_t PASSWORD_WRITE = 0x07;
+
+ST25DV64KCModel::ST25DV64KCModel() : gpoCallback(nullptr), gpoContext(nullptr)
+{
+  factoryReset();
+}
+
+void ST25DV64KCModel::factoryReset()
+{
+  static const uint8_t defaults[sizeof(systemRegisters)] = {
+      0x88, 0x00, 0x01, 0x00, 0x03, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x1B, 0x00, // 0x00-0x0F
+      0x00, 0x00, 0xFF, 0x00, 0xFF, 0x07, 0x03, 0x51,                                                 // 0x10-0x17
+      0x4C, 0x92, 0x5A, 0x38, 0x26, 0x02, 0x02, 0xE0,                                                 // UID, LSB first
+      0x11, 0x00, 0x00, 0x00};                                                                        // IC_REV
+  memcpy(systemRegisters, defaults, sizeof(systemRegisters));
+  memset(password, 0, sizeof(password));
+  memset(userMemory, 0, sizeof(userMemory));
+  random = timing.seed;
+  resetStatistics();
+  powerCycle();
+}
+
+void ST25DV64KCModel::powerCycle()
+{
+  gpoCtrlDyn = systemRegisters[REG_GPO1] & GPO_EN;
+  ehCtrlDyn = (systemRegisters[REG_EH_MODE] & 0x01) ? 0 : EH_EN;
+  ehCtrlDyn |= VCC_ON;
+  rfMngtDyn = 0;
+  sessionOpen = false;
+  itStsDyn = 0;
+  mbCtrlDyn = 0;
+  mailboxLength = 0;
+  pointer = 0;
+  programming = false;
+}
+
+void ST25DV64KCModel::resetStatistics()
+{
+  memset(&statistics, 0, sizeof(statistics));
+}
+
+void ST25DV64KCModel::setGpoCallback(void (*callback)(void *context), void *context)
+{
+  gpoCallback = callback;
+  gpoContext = context;
+}
+
+bool ST25DV64KCModel::isI2CSessionOpen()
+{
+  return sessionOpen;
+}
+
+uint8_t ST25DV64KCModel::getSystemRegister(uint16_t reg)
+{
+  return reg < sizeof(systemRegisters) ? systemRegisters[reg] : 0;
+}
+
+bool ST25DV64KCModel::isBusy()
+{
+  // busyUntil alone would read as busy again once micros() is 2^31 past it
+  if (programming && (int32_t)(busyUntil - (uint32_t)micros()) <= 0)
+    programming = false;
+  return programming;
+}
+
+bool ST25DV64KCModel::injectNack()
+{
+  if (timing.nackProbabilityPerMille == 0)
+    return false;
+  random ^= random << 13;
+  random ^= random >> 17;
+  random ^= random << 5;
+  return (random % 1000) < timing.nackProbabilityPerMille;
+}
+
+void ST25DV64KCModel::startProgramming(uint32_t programMicros)
+{
+  busyUntil = (uint32_t)micros() + programMicros;
+  programming = true;
+}
+
+void ST25DV64KCModel::advanceBus(size_t bytes)
+{
+  // start + (device select + bytes) * (8 bits + ack) + stop
+  uint64_t bits = 2 + (bytes + 1) * 9;
+  hostClockAdvance((bits * 1000000 + timing.busClockHz - 1) / timing.busClockHz);
+}
+
+uint8_t ST25DV64KCModel::i2cWrite(uint8_t address, const uint8_t *data, size_t length)
+{
+  if (address != DATA_ADDRESS && address != SYSTEM_ADDRESS)
+  {
+    advanceBus(0);
+    return 2;
+  }
+
+  if (isBusy())
+  {
+    advanceBus(0);
+    statistics.busyNacks++;
+    return 2;
+  }
+
+  if (injectNack())
+  {
+    advanceBus(0);
+    statistics.injectedNacks++;
+    return 2;
+  }
+
+  uint32_t start = micros();
+  advanceBus(length);
+
+  bool acked = true;
+  if (length >= 2)
+  {
+    pointer = ((uint16_t)data[0] << 8) | data[1];
+    if (length > 2)
+      acked = address == DATA_ADDRESS ? writeData(data + 2, length - 2) : writeSystem(data + 2, length - 2);
+  }
+
+  if (length > 2)
+  {
+    statistics.writeTransactions++;
+    statistics.bytesWritten += length - 2;
+    statistics.writeMicros += (uint32_t)micros() - start;
+  }
+  else if (length == 2)
+  {
+    statistics.readMicros += (uint32_t)micros() - start;
+  }
+  else
+  {
+    statistics.probeMicros += (uint32_t)micros() - start;
+  }
+
+  if (!acked)
+  {
+    statistics.dataNacks++;
+    return 3;
+  }
+  return 0;
+}
+
+size_t ST25DV64KCModel::i2cRead(uint8_t address, uint8_t *data, size_t length)
+{
+  if (address != DATA_ADDRESS && address != SYSTEM_ADDRESS)
+  {
+    advanceBus(0);
+    return 0;
+  }
+
+  if (isBusy())
+  {
+    advanceBus(0);
+    statistics.busyNacks++;
+    return 0;
+  }
+
+  if (injectNack())
+  {
+    advanceBus(0);
+    statistics.injectedNacks++;
+    return 0;
+  }
+
+  uint32_t start = micros();
+  advanceBus(length);
+
+  if (address == SYSTEM_ADDRESS)
+  {
+    if (pointer >= REG_I2C_PASSWD_BASE)
+      return 0; // the password can't be read back
+    for (size_t i = 0; i < length; i++)
+    {
+      uint16_t reg = pointer + i;
+      data[i] = reg < sizeof(systemRegisters) ? systemRegisters[reg] : 0xFF;
+    }
+  }
+  else
+  {
+    for (size_t i = 0; i < length; i++)
+      data[i] = readDataByte(pointer + i);
+
+    // The RF message is released once the host has read its last byte
+    uint16_t end = pointer + length;
+    if ((mbCtrlDyn & RF_PUT_MSG) && pointer < MAILBOX_BASE + mailboxLength && end >= MAILBOX_BASE + mailboxLength)
+    {
+      mbCtrlDyn &= ~(RF_PUT_MSG | RF_CURRENT_MSG);
+      mailboxLength = 0;
+    }
+  }
+
+  pointer += length;
+  statistics.readTransactions++;
+  statistics.bytesRead += length;
+  statistics.readMicros += (uint32_t)micros() - start;
+  return length;
+}
+
+uint8_t ST25DV64KCModel::readDataByte(uint16_t address)
+{
+  if (address < USER_MEMORY_LENGTH)
+    return userMemory[address];
+
+  switch (address)
+  {
+  case DYN_REG_GPO_CTRL_DYN:
+    return gpoCtrlDyn;
+  case DYN_REG_EH_CTRL_DYN:
+    return ehCtrlDyn;
+  case DYN_REG_RF_MNGT_DYN:
+    return rfMngtDyn;
+  case DYN_REG_I2C_SSO_DYN:
+    return sessionOpen ? 0x01 : 0x00;
+  case DYN_REG_IT_STS_DYN:
+  {
+    uint8_t status = itStsDyn;
+    itStsDyn = 0; // cleared on read
+    return status;
+  }
+  case DYN_REG_MB_CTRL_DYN:
+    return mbCtrlDyn;
+  case DYN_REG_MB_LEN_DYN:
+    return mailboxLength == 0 ? 0 : mailboxLength - 1;
+  default:
+    break;
+  }
+
+  if (address >= MAILBOX_BASE && address < MAILBOX_BASE + MAILBOX_LENGTH)
+    return mailbox[address - MAILBOX_BASE];
+
+  return 0xFF;
+}
+
+bool ST25DV64KCModel::writeData(const uint8_t *data, size_t length)
+{
+  if (pointer < USER_MEMORY_LENGTH)
+    return writeUserMemory(pointer, data, length);
+
+  if (pointer >= MAILBOX_BASE)
+  {
+    if (!(mbCtrlDyn & MB_EN) || (mbCtrlDyn & (RF_PUT_MSG | HOST_PUT_MSG)) || pointer != MAILBOX_BASE || length > MAILBOX_LENGTH)
+      return false;
+    memcpy(mailbox, data, length);
+    mailboxLength = length;
+    mbCtrlDyn |= HOST_PUT_MSG | HOST_CURRENT_MSG;
+    return true;
+  }
+
+  for (size_t i = 0; i < length; i++)
+  {
+    if (!writeDynamicRegister(pointer + i, data[i]))
+      return false;
+  }
+  return true;
+}
+
+bool ST25DV64KCModel::writeDynamicRegister(uint16_t reg, uint8_t value)
+{
+  switch (reg)
+  {
+  case DYN_REG_GPO_CTRL_DYN:
+    gpoCtrlDyn = value & GPO_EN;
+    return true;
+  case DYN_REG_EH_CTRL_DYN:
+    ehCtrlDyn = (ehCtrlDyn & ~EH_EN) | (value & EH_EN);
+    if ((ehCtrlDyn & EH_EN) && (ehCtrlDyn & FIELD_ON))
+      ehCtrlDyn |= EH_ON;
+    else
+      ehCtrlDyn &= ~EH_ON;
+    return true;
+  case DYN_REG_RF_MNGT_DYN:
+    rfMngtDyn = value & 0x03;
+    return true;
+  case DYN_REG_MB_CTRL_DYN:
+    if (!(systemRegisters[REG_FTM] & 0x01))
+      return false; // fast transfer mode must be enabled first
+    if (value & MB_EN)
+    {
+      mbCtrlDyn |= MB_EN;
+    }
+    else
+    {
+      mbCtrlDyn = 0; // disabling the mailbox empties it
+      mailboxLength = 0;
+    }
+    return true;
+  default:
+    return false; // read only
+  }
+}
+
+bool ST25DV64KCModel::writeSystem(const uint8_t *data, size_t length)
+{
+  if (pointer == REG_I2C_PASSWD_BASE)
+    return presentPassword(data, length);
+
+  if (!sessionOpen)
+    return false;
+
+  for (size_t i = 0; i < length; i++)
+  {
+    uint16_t reg = pointer + i;
+    if (reg >= REG_READ_ONLY_BASE)
+      return false;
+    systemRegisters[reg] = data[i];
+    if (reg == REG_GPO1)
+      gpoCtrlDyn = data[i] & GPO_EN; // the dynamic copy follows the static enable
+    if (reg == REG_FTM && !(data[i] & 0x01))
+    {
+      mbCtrlDyn = 0;
+      mailboxLength = 0;
+    }
+  }
+
+  statistics.registerProgramCycles++;
+  startProgramming(timing.registerProgramMicros);
+  return true;
+}
+
+bool ST25DV64KCModel::presentPassword(const uint8_t *data, size_t length)
+{
+  if (length != 17 || memcmp(data, data + 9, 8) != 0)
+    return false;
+
+  // Password bytes are sent MSB first
+  uint8_t received[8];
+  for (uint8_t i = 0; i < 8; i++)
+    received[i] = data[7 - i];
+
+  if (data[8] == PASSWORD_PRESENT)
+  {
+    sessionOpen = memcmp(received, password, sizeof(password)) == 0;
+    return true;
+  }
+
+  if (data[8] == PASSWORD_WRITE && sessionOpen)
+  {
+    memcpy(password, received, sizeof(password));
+    statistics.registerProgramCycles++;
+    startProgramming(timing.registerProgramMicros);
+    return true;
+  }
+
+  return false;
+}
+
+uint8_t ST25DV64KCModel::userArea(uint16_t address)
+{
+  // Area n ends at ENDAn * 32 + 31
+  if (address <= systemRegisters[REG_ENDA1] * 32 + 31)
+    return 1;
+  if (address <= systemRegisters[REG_ENDA2] * 32 + 31)
+    return 2;
+  if (address <= systemRegisters[REG_ENDA3] * 32 + 31)
+    return 3;
+  return 4;
+}
+
+bool ST25DV64KCModel::userAreaWriteProtected(uint16_t address)
+{
+  uint8_t area = userArea(address);
+  return !sessionOpen && (systemRegisters[REG_I2CSS] & (1 << ((area - 1) * 2)));
+}
+
+bool ST25DV64KCModel::writeUserMemory(uint16_t address, const uint8_t *data, size_t length)
+{
+  if (address + length > USER_MEMORY_LENGTH || length > 256)
+    return false;
+
+  for (size_t i = 0; i < length; i++)
+  {
+    if (userAreaWriteProtected(address + i))
+      return false;
+  }
+
+  memcpy(&userMemory[address], data, length);
+
+  uint32_t rows = (address + length - 1) / EEPROM_ROW_LENGTH - address / EEPROM_ROW_LENGTH + 1;
+  statistics.eepromProgramCycles += rows;
+  startProgramming(rows * timing.eepromRowProgramMicros);
+  return true;
+}
+
+void ST25DV64KCModel::setRFField(bool on)
+{
+  if (on)
+  {
+    ehCtrlDyn |= FIELD_ON;
+    if (ehCtrlDyn & EH_EN)
+      ehCtrlDyn |= EH_ON;
+  }
+  else
+  {
+    ehCtrlDyn &= ~(FIELD_ON | EH_ON);
+  }
+}
+
+bool ST25DV64KCModel::rfPutMessage(const uint8_t *data, uint16_t length)
+{
+  if (!(ehCtrlDyn & FIELD_ON) || !(mbCtrlDyn & MB_EN) || (mbCtrlDyn & (RF_PUT_MSG | HOST_PUT_MSG)))
+    return false;
+  if (length == 0 || length > MAILBOX_LENGTH)
+    return false;
+
+  memcpy(mailbox, data, length);
+  mailboxLength = length;
+  mbCtrlDyn |= RF_PUT_MSG | RF_CURRENT_MSG;
+  raiseInterrupt(IT_STS_RF_PUT_MSG, GPO1_RF_PUT_MSG_EN);
+  return true;
+}
+
+bool ST25DV64KCModel::hasHostMessage()
+{
+  return (mbCtrlDyn & HOST_PUT_MSG) != 0;
+}
+
+bool ST25DV64KCModel::rfGetMessage(uint8_t *data, uint16_t *length)
+{
+  if (!(ehCtrlDyn & FIELD_ON) || !(mbCtrlDyn & HOST_PUT_MSG))
+    return false;
+
+  memcpy(data, mailbox, mailboxLength);
+  *length = mailboxLength;
+  mbCtrlDyn &= ~(HOST_PUT_MSG | HOST_CURRENT_MSG);
+  mailboxLength = 0;
+  return true;
+}
+
+void ST25DV64KCModel::readUserMemory(uint16_t address, uint8_t *data, uint16_t length)
+{
+  for (uint16_t i = 0; i < length; i++)
+    data[i] = (uint16_t)(address + i) < USER_MEMORY_LENGTH ? userMemory[address + i] : 0xFF;
+}
+
+void ST25DV64KCModel::rfWriteUserMemory(uint16_t address, const uint8_t *data, uint16_t length)
+{
+  for (uint16_t i = 0; i < length && (uint16_t)(address + i) < USER_MEMORY_LENGTH; i++)
+    userMemory[address + i] = data[i];
+}
+
+void ST25DV64KCModel::raiseInterrupt(uint8_t status, uint8_t gpoEnableBit)
+{
+  if (!(systemRegisters[REG_GPO1] & gpoEnableBit))
+    return;
+  itStsDyn |= status;
+  if ((gpoCtrlDyn & GPO_EN) && gpoCallback != nullptr)
+    gpoCallback(gpoContext);
+}
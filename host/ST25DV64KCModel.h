@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Software model of the ST25DV64KC as seen from the I2C bus, plus a minimal RF side to play the phone.
+//
+// Covered: system configuration registers (with I2C security session), dynamic registers, the 8 KB user
+// eeprom with I2CSS area protection, the fast transfer mailbox, GPO interrupts on RF_PUT_MSG and eeprom
+// programming time during which the device NACKs its device select code. Bus time is modeled from the bus
+// clock and advances the host clock, so delays and transfers cost virtual time but no real time.
+class ST25DV64KCModel
+{
+public:
+  static const uint8_t DATA_ADDRESS = 0x53;
+  static const uint8_t SYSTEM_ADDRESS = 0x57;
+  static const uint16_t USER_MEMORY_LENGTH = 0x2000;
+  static const uint16_t MAILBOX_LENGTH = 256;
+  static const uint16_t EEPROM_ROW_LENGTH = 16;
+
+  struct Timing
+  {
+    uint32_t busClockHz = 100000;            // Wire default clock
+    uint32_t eepromRowProgramMicros = 3500;  // per 16 byte row touched by one write, assumed typical (5 ms max)
+    uint32_t registerProgramMicros = 5000;   // per system configuration write
+    uint32_t nackProbabilityPerMille = 0;    // randomly NACK this share of device selects
+    uint32_t seed = 1;
+  };
+
+  struct Statistics
+  {
+    uint32_t readTransactions;
+    uint32_t writeTransactions;
+    uint32_t busyNacks;
+    uint32_t injectedNacks;
+    uint32_t dataNacks;
+    uint32_t bytesRead;
+    uint32_t bytesWritten;
+    uint32_t eepromProgramCycles;
+    uint32_t registerProgramCycles;
+    uint64_t readMicros;  // read transactions including the pointer writes setting them up
+    uint64_t probeMicros; // device selects without data (ACK polling, presence checks)
+    uint64_t writeMicros; // write transactions carrying data
+  };
+
+  Timing timing;
+  Statistics statistics;
+
+  ST25DV64KCModel();
+
+  // Factory state: erased user memory, default registers, zero I2C password
+  void factoryReset();
+  // Power cycle: dynamic registers are reloaded, the security session is closed and the mailbox cleared
+  void powerCycle();
+  void resetStatistics();
+
+  // I2C side, used by the host TwoWire. i2cWrite returns the Wire endTransmission code (0 ACK, 2 address NACK,
+  // 3 data NACK), i2cRead the number of bytes read (0 on address NACK).
+  uint8_t i2cWrite(uint8_t address, const uint8_t *data, size_t length);
+  size_t i2cRead(uint8_t address, uint8_t *data, size_t length);
+
+  // RF side
+  void setRFField(bool on);
+  bool rfPutMessage(const uint8_t *data, uint16_t length);
+  bool rfGetMessage(uint8_t *data, uint16_t *length);
+  bool hasHostMessage();
+  void readUserMemory(uint16_t address, uint8_t *data, uint16_t length);
+  void rfWriteUserMemory(uint16_t address, const uint8_t *data, uint16_t length);
+
+  // Called when the GPO pin is pulled low
+  void setGpoCallback(void (*callback)(void *context), void *context);
+
+  bool isI2CSessionOpen();
+  uint8_t getSystemRegister(uint16_t reg);
+
+private:
+  uint8_t systemRegisters[0x24];
+  uint8_t password[8];
+  uint8_t userMemory[USER_MEMORY_LENGTH];
+
+  uint8_t gpoCtrlDyn;
+  uint8_t ehCtrlDyn;
+  uint8_t rfMngtDyn;
+  bool sessionOpen;
+  uint8_t itStsDyn;
+  uint8_t mbCtrlDyn;
+  uint8_t mailbox[MAILBOX_LENGTH];
+  uint16_t mailboxLength;
+
+  uint16_t pointer;
+  uint32_t busyUntil;
+  bool programming;
+  uint32_t random;
+
+  void (*gpoCallback)(void *context);
+  void *gpoContext;
+
+  bool isBusy();
+  bool injectNack();
+  void startProgramming(uint32_t micros);
+  void advanceBus(size_t bytes);
+  bool writeData(const uint8_t *data, size_t length);
+  bool writeSystem(const uint8_t *data, size_t length);
+  bool writeUserMemory(uint16_t address, const uint8_t *data, size_t length);
+  bool writeDynamicRegister(uint16_t reg, uint8_t value);
+  bool presentPassword(const uint8_t *data, size_t length);
+  uint8_t readDataByte(uint16_t address);
+  bool userAreaWriteProtected(uint16_t address);
+  uint8_t userArea(uint16_t address);
+  void raiseInterrupt(uint8_t status, uint8_t gpoEnableBit);
+};
@@ -0,0 +1,215 @@
+#include <Wire.h>
+#include "ST25DV64KCModel.h"
+
+TwoWire::TwoWire() : i2c({this, nullptr, nullptr, HAL_I2C_STATE_READY, HAL_I2C_ERROR_NONE, 0, 0, nullptr, 0}), model(nullptr), clockFrequency(100000), txAddress(0), txLength(0), rxLength(0), rxIndex(0)
+{
+}
+
+void TwoWire::attach(ST25DV64KCModel *newModel)
+{
+  model = newModel;
+  if (model != nullptr)
+    model->timing.busClockHz = clockFrequency;
+}
+
+void TwoWire::setSCL(uint32_t)
+{
+}
+
+void TwoWire::setSDA(uint32_t)
+{
+}
+
+void TwoWire::begin()
+{
+}
+
+void TwoWire::setClock(uint32_t frequency)
+{
+  clockFrequency = frequency;
+  if (model != nullptr)
+    model->timing.busClockHz = frequency;
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+  txAddress = address;
+  txLength = 0;
+}
+
+void TwoWire::beginTransmission(int address)
+{
+  beginTransmission((uint8_t)address);
+}
+
+uint8_t TwoWire::endTransmission(bool)
+{
+  if (model == nullptr)
+    return 2;
+  uint8_t status = model->i2cWrite(txAddress, txBuffer, txLength);
+  txLength = 0;
+  return status;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+  if (txLength >= sizeof(txBuffer))
+    return 0;
+  txBuffer[txLength++] = data;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t quantity)
+{
+  size_t written = 0;
+  while (written < quantity && write(data[written]))
+    written++;
+  return written;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity)
+{
+  return requestFrom((int)address, (int)quantity);
+}
+
+uint8_t TwoWire::requestFrom(int address, unsigned int quantity)
+{
+  return requestFrom(address, (int)quantity);
+}
+
+uint8_t TwoWire::requestFrom(int address, int quantity)
+{
+  rxIndex = 0;
+  rxLength = 0;
+  if (model == nullptr || quantity <= 0 || (size_t)quantity > sizeof(rxBuffer))
+    return 0;
+  rxLength = model->i2cRead((uint8_t)address, rxBuffer, quantity);
+  return (uint8_t)rxLength;
+}
+
+int TwoWire::available()
+{
+  return rxLength - rxIndex;
+}
+
+int TwoWire::read()
+{
+  if (rxIndex >= rxLength)
+    return -1;
+  return rxBuffer[rxIndex++];
+}
+
+size_t TwoWire::readBytes(uint8_t *buffer, size_t length)
+{
+  size_t count = 0;
+  while (count < length && rxIndex < rxLength)
+    buffer[count++] = rxBuffer[rxIndex++];
+  return count;
+}
+
+// Memory address write, repeated start and read, as the HAL does it
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t devAddress, uint16_t memAddress, uint16_t memAddSize, uint8_t *data, uint16_t size, uint32_t)
+{
+  TwoWire *wire = hi2c->wire;
+  uint8_t address = devAddress >> 1;
+  wire->beginTransmission(address);
+  if (memAddSize == I2C_MEMADD_SIZE_16BIT)
+    wire->write(memAddress >> 8);
+  wire->write(memAddress & 0xFF);
+  if (wire->endTransmission(false) != 0)
+    return HAL_ERROR;
+
+  wire->requestFrom((int)address, (int)size);
+  return wire->readBytes(data, size) == size ? HAL_OK : HAL_ERROR;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t devAddress, uint16_t memAddress, uint16_t memAddSize, uint8_t *data, uint16_t size, uint32_t)
+{
+  TwoWire *wire = hi2c->wire;
+  wire->beginTransmission((uint8_t)(devAddress >> 1));
+  if (memAddSize == I2C_MEMADD_SIZE_16BIT)
+    wire->write(memAddress >> 8);
+  wire->write(memAddress & 0xFF);
+  wire->write(data, size);
+  return wire->endTransmission() == 0 ? HAL_OK : HAL_ERROR;
+}
+
+HAL_StatusTypeDef HAL_I2C_IsDeviceReady(I2C_HandleTypeDef *hi2c, uint16_t devAddress, uint32_t, uint32_t)
+{
+  hi2c->wire->beginTransmission((uint8_t)(devAddress >> 1));
+  return hi2c->wire->endTransmission() == 0 ? HAL_OK : HAL_ERROR;
+}
+
+HAL_I2C_StateTypeDef HAL_I2C_GetState(I2C_HandleTypeDef *hi2c)
+{
+  return hi2c->State;
+}
+
+uint32_t HAL_I2C_GetError(I2C_HandleTypeDef *hi2c)
+{
+  return hi2c->ErrorCode;
+}
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *)
+{
+  return HAL_OK;
+}
+
+static HAL_StatusTypeDef startDMA(I2C_HandleTypeDef *hi2c, HAL_I2C_StateTypeDef state, uint16_t devAddress, uint16_t memAddress, uint16_t memAddSize, uint8_t *data, uint16_t size)
+{
+  if (hi2c->State != HAL_I2C_STATE_READY)
+    return HAL_BUSY;
+  if (memAddSize != I2C_MEMADD_SIZE_16BIT)
+    return HAL_ERROR;
+  hi2c->State = state;
+  hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+  hi2c->devAddress = devAddress;
+  hi2c->memAddress = memAddress;
+  hi2c->data = data;
+  hi2c->size = size;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef *hi2c, uint16_t devAddress, uint16_t memAddress, uint16_t memAddSize, uint8_t *data, uint16_t size)
+{
+  return startDMA(hi2c, HAL_I2C_STATE_BUSY_RX, devAddress, memAddress, memAddSize, data, size);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef *hi2c, uint16_t devAddress, uint16_t memAddress, uint16_t memAddSize, uint8_t *data, uint16_t size)
+{
+  return startDMA(hi2c, HAL_I2C_STATE_BUSY_TX, devAddress, memAddress, memAddSize, data, size);
+}
+
+// Weak as in the HAL, the DMA bus overrides them
+extern "C" __attribute__((weak)) void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *)
+{
+}
+
+extern "C" __attribute__((weak)) void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *)
+{
+}
+
+// Does the transfer. A NACK leaves the error in the handle without a completion callback, which on the STM32 goes
+// to HAL_I2C_ErrorCallback of the Wire library
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma)
+{
+  I2C_HandleTypeDef *hi2c = hdma->Parent;
+  if (hi2c == nullptr || (hi2c->State != HAL_I2C_STATE_BUSY_TX && hi2c->State != HAL_I2C_STATE_BUSY_RX))
+    return;
+
+  bool write = hi2c->State == HAL_I2C_STATE_BUSY_TX;
+  HAL_StatusTypeDef status = write ? HAL_I2C_Mem_Write(hi2c, hi2c->devAddress, hi2c->memAddress, I2C_MEMADD_SIZE_16BIT, hi2c->data, hi2c->size, 0)
+                                   : HAL_I2C_Mem_Read(hi2c, hi2c->devAddress, hi2c->memAddress, I2C_MEMADD_SIZE_16BIT, hi2c->data, hi2c->size, 0);
+  hi2c->State = HAL_I2C_STATE_READY;
+  if (status != HAL_OK)
+  {
+    hi2c->ErrorCode = HAL_I2C_ERROR_AF;
+    return;
+  }
+  if (write)
+    HAL_I2C_MemTxCpltCallback(hi2c);
+  else
+    HAL_I2C_MemRxCpltCallback(hi2c);
+}
+
+TwoWire Wire;
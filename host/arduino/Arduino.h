@@ -0,0 +1,41 @@
+// Minimal Arduino core for building the firmware on Linux.
+// Only what the firmware sources actually use is provided.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define PA1 1
+#define PB4 4
+#define PB6 6
+#define PB7 7
+#define PA9 9
+#define PA10 10
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define LOW 0x0
+#define HIGH 0x1
+#define FALLING 2
+
+// Time is a mix of real elapsed time (crypto, parsing) and virtual time (delays and modeled bus transfers),
+// so benchmarks on a workstation don't sleep while still accounting for the bus.
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint32_t pin, uint32_t mode);
+void digitalWrite(uint32_t pin, uint32_t value);
+int digitalRead(uint32_t pin);
+uint32_t digitalPinToInterrupt(uint32_t pin);
+void attachInterrupt(uint32_t interrupt, void (*callback)(void), uint32_t mode);
+
+#include "HardwareSerial.h"
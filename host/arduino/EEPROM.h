@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+#define HOST_EEPROM_LENGTH 1024
+
+// Emulated µC eeprom, erased to 0xFF like a freshly flashed STM32 data eeprom emulation
+class EEPROMClass
+{
+public:
+  EEPROMClass();
+
+  uint8_t read(int address);
+  void write(int address, uint8_t value);
+  void update(int address, uint8_t value);
+  uint16_t length();
+
+  // Host only: restore the erased state
+  void clear();
+
+  // Host only: flash page erases. STM32duino erases and programs the whole page on every write(), once per
+  // eeprom_buffer_flush()
+  uint32_t erases;
+
+private:
+  friend void eeprom_buffer_fill();
+  friend void eeprom_buffer_flush();
+
+  uint8_t data[HOST_EEPROM_LENGTH];
+};
+
+extern EEPROMClass EEPROM;
+
+// STM32duino's buffered access (stm32_eeprom.h): writes are staged in a RAM copy of the page and programmed together
+uint8_t eeprom_buffered_read_byte(const uint32_t pos);
+void eeprom_buffered_write_byte(uint32_t pos, uint8_t value);
+void eeprom_buffer_fill();
+void eeprom_buffer_flush();
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+// Serial port that forwards to stdout when echo is enabled (HOST_SERIAL_ECHO=1), silent otherwise
+class HardwareSerial
+{
+public:
+  HardwareSerial(uint32_t rx, uint32_t tx);
+
+  void begin(unsigned long baud);
+  void flush();
+
+  size_t print(const char *text);
+  size_t print(char c);
+  size_t print(int value);
+  size_t print(unsigned int value);
+  size_t print(long value);
+  size_t print(unsigned long value);
+  size_t println(const char *text);
+  size_t println(int value);
+  size_t println(unsigned int value);
+  size_t println(long value);
+  size_t println(unsigned long value);
+  size_t println();
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+private:
+  bool echo;
+};
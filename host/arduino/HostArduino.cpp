@@ -0,0 +1,218 @@
+#include "Arduino.h"
+#include "EEPROM.h"
+#include "HostClock.h"
+#include <chrono>
+#include <stdlib.h>
+
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+static uint64_t virtualMicros = 0;
+
+void hostClockAdvance(uint64_t us)
+{
+  virtualMicros += us;
+}
+
+uint64_t hostClockVirtualMicros()
+{
+  return virtualMicros;
+}
+
+static uint64_t hostMicros()
+{
+  uint64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+  return elapsed + virtualMicros;
+}
+
+unsigned long micros()
+{
+  return (unsigned long)(uint32_t)hostMicros();
+}
+
+unsigned long millis()
+{
+  return (unsigned long)(uint32_t)(hostMicros() / 1000);
+}
+
+void delay(unsigned long ms)
+{
+  hostClockAdvance((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  hostClockAdvance(us);
+}
+
+void pinMode(uint32_t, uint32_t)
+{
+}
+
+void digitalWrite(uint32_t, uint32_t)
+{
+}
+
+int digitalRead(uint32_t)
+{
+  return HIGH;
+}
+
+uint32_t digitalPinToInterrupt(uint32_t pin)
+{
+  return pin;
+}
+
+void attachInterrupt(uint32_t, void (*)(void), uint32_t)
+{
+}
+
+HardwareSerial::HardwareSerial(uint32_t, uint32_t)
+{
+  const char *value = getenv("HOST_SERIAL_ECHO");
+  echo = value != nullptr && value[0] == '1';
+}
+
+void HardwareSerial::begin(unsigned long)
+{
+}
+
+void HardwareSerial::flush()
+{
+  if (echo)
+    fflush(stdout);
+}
+
+size_t HardwareSerial::print(const char *text)
+{
+  if (!echo)
+    return 0;
+  fputs(text, stdout);
+  return strlen(text);
+}
+
+size_t HardwareSerial::print(char c)
+{
+  return echo ? (size_t)(putchar(c) != EOF) : 0;
+}
+
+size_t HardwareSerial::print(int value)
+{
+  return printf("%d", value);
+}
+
+size_t HardwareSerial::print(unsigned int value)
+{
+  return printf("%u", value);
+}
+
+size_t HardwareSerial::print(long value)
+{
+  return printf("%ld", value);
+}
+
+size_t HardwareSerial::print(unsigned long value)
+{
+  return printf("%lu", value);
+}
+
+size_t HardwareSerial::println(const char *text)
+{
+  return print(text) + println();
+}
+
+size_t HardwareSerial::println(int value)
+{
+  return print(value) + println();
+}
+
+size_t HardwareSerial::println(unsigned int value)
+{
+  return print(value) + println();
+}
+
+size_t HardwareSerial::println(long value)
+{
+  return print(value) + println();
+}
+
+size_t HardwareSerial::println(unsigned long value)
+{
+  return print(value) + println();
+}
+
+size_t HardwareSerial::println()
+{
+  return print('\n');
+}
+
+size_t HardwareSerial::printf(const char *format, ...)
+{
+  if (!echo)
+    return 0;
+  va_list args;
+  va_start(args, format);
+  int written = vprintf(format, args);
+  va_end(args);
+  return written < 0 ? 0 : written;
+}
+
+EEPROMClass::EEPROMClass()
+{
+  clear();
+}
+
+uint8_t EEPROMClass::read(int address)
+{
+  return (address >= 0 && address < HOST_EEPROM_LENGTH) ? data[address] : 0xFF;
+}
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+  if (address >= 0 && address < HOST_EEPROM_LENGTH)
+  {
+    data[address] = value;
+    erases++;
+  }
+}
+
+void EEPROMClass::update(int address, uint8_t value)
+{
+  write(address, value);
+}
+
+uint16_t EEPROMClass::length()
+{
+  return HOST_EEPROM_LENGTH;
+}
+
+void EEPROMClass::clear()
+{
+  memset(data, 0xFF, sizeof(data));
+  erases = 0;
+}
+
+EEPROMClass EEPROM;
+
+static uint8_t eepromBuffer[HOST_EEPROM_LENGTH];
+
+uint8_t eeprom_buffered_read_byte(const uint32_t pos)
+{
+  return pos < HOST_EEPROM_LENGTH ? eepromBuffer[pos] : 0xFF;
+}
+
+void eeprom_buffered_write_byte(uint32_t pos, uint8_t value)
+{
+  if (pos < HOST_EEPROM_LENGTH)
+    eepromBuffer[pos] = value;
+}
+
+void eeprom_buffer_fill()
+{
+  memcpy(eepromBuffer, EEPROM.data, HOST_EEPROM_LENGTH);
+}
+
+void eeprom_buffer_flush()
+{
+  memcpy(EEPROM.data, eepromBuffer, HOST_EEPROM_LENGTH);
+  EEPROM.erases++;
+}
+HardwareSerial Serial1(PA10, PA9);
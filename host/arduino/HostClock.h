@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+
+// Virtual time added on top of the real elapsed time returned by micros()/millis().
+// delay() and the bus model advance it instead of sleeping.
+void hostClockAdvance(uint64_t micros);
+uint64_t hostClockVirtualMicros();
@@ -0,0 +1,193 @@
+#pragma once
+
+#include "Arduino.h"
+
+class ST25DV64KCModel;
+class TwoWire;
+
+// The part of the STM32 HAL I2C driver and of the STM32duino i2c_t the firmware uses, so the
+// SFE_ST25DV64KC_WIRE_HAL_READ path is the one built and run here. HAL_I2C_Mem_Read goes through the TwoWire below.
+#define HAL_I2C_MODULE_ENABLED
+#define I2C_MEMADD_SIZE_8BIT 1
+#define I2C_MEMADD_SIZE_16BIT 2
+
+typedef enum
+{
+  HAL_OK,
+  HAL_ERROR,
+  HAL_BUSY,
+  HAL_TIMEOUT
+} HAL_StatusTypeDef;
+
+typedef enum
+{
+  HAL_I2C_STATE_RESET,
+  HAL_I2C_STATE_READY,
+  HAL_I2C_STATE_BUSY_TX,
+  HAL_I2C_STATE_BUSY_RX
+} HAL_I2C_StateTypeDef;
+
+#define HAL_I2C_ERROR_NONE 0x00
+#define HAL_I2C_ERROR_AF 0x04
+
+struct DMA_HandleTypeDef;
+
+struct I2C_HandleTypeDef
+{
+  TwoWire *wire;
+  DMA_HandleTypeDef *hdmatx;
+  DMA_HandleTypeDef *hdmarx;
+  HAL_I2C_StateTypeDef State;
+  uint32_t ErrorCode;
+
+  // Host only: the DMA transfer started, done by HAL_DMA_IRQHandler
+  uint16_t devAddress;
+  uint16_t memAddress;
+  uint8_t *data;
+  uint16_t size;
+};
+
+struct i2c_t
+{
+  I2C_HandleTypeDef handle;
+};
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t devAddress, uint16_t memAddress, uint16_t memAddSize, uint8_t *data, uint16_t size, uint32_t timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t devAddress, uint16_t memAddress, uint16_t memAddSize, uint8_t *data, uint16_t size, uint32_t timeout);
+HAL_StatusTypeDef HAL_I2C_IsDeviceReady(I2C_HandleTypeDef *hi2c, uint16_t devAddress, uint32_t trials, uint32_t timeout);
+HAL_I2C_StateTypeDef HAL_I2C_GetState(I2C_HandleTypeDef *hi2c);
+uint32_t HAL_I2C_GetError(I2C_HandleTypeDef *hi2c);
+
+// The part of the HAL DMA driver, NVIC and CMSIS the DMA bus (I2C_DMA) uses. A DMA transfer is only started by
+// HAL_I2C_Mem_*_DMA and done when the channel's interrupt handler is called, like one finishing while the core
+// sleeps. Memory addresses are 16 bit.
+#define HAL_DMA_MODULE_ENABLED
+
+struct DMA_Channel_TypeDef;
+#define DMA1_Channel6 ((DMA_Channel_TypeDef *)6)
+#define DMA1_Channel7 ((DMA_Channel_TypeDef *)7)
+#define DMA_REQUEST_3 3
+#define DMA_MEMORY_TO_PERIPH 0x10
+#define DMA_PERIPH_TO_MEMORY 0x00
+#define DMA_PINC_DISABLE 0x00
+#define DMA_MINC_ENABLE 0x80
+#define DMA_PDATAALIGN_BYTE 0x00
+#define DMA_MDATAALIGN_BYTE 0x00
+#define DMA_NORMAL 0x00
+#define DMA_PRIORITY_LOW 0x00
+
+struct DMA_InitTypeDef
+{
+  uint32_t Request;
+  uint32_t Direction;
+  uint32_t PeriphInc;
+  uint32_t MemInc;
+  uint32_t PeriphDataAlignment;
+  uint32_t MemDataAlignment;
+  uint32_t Mode;
+  uint32_t Priority;
+};
+
+struct DMA_HandleTypeDef
+{
+  DMA_Channel_TypeDef *Instance;
+  DMA_InitTypeDef Init;
+  I2C_HandleTypeDef *Parent;
+};
+
+#define __HAL_RCC_DMA1_CLK_ENABLE() \
+  do                                \
+  {                                 \
+  } while (0)
+#define __HAL_LINKDMA(handle, field, dma) \
+  do                                      \
+  {                                       \
+    (handle)->field = &(dma);             \
+    (dma).Parent = (handle);              \
+  } while (0)
+
+typedef enum
+{
+  DMA1_Channel6_IRQn = 16,
+  DMA1_Channel7_IRQn = 17
+} IRQn_Type;
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma);
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma);
+HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef *hi2c, uint16_t devAddress, uint16_t memAddress, uint16_t memAddSize, uint8_t *data, uint16_t size);
+HAL_StatusTypeDef HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef *hi2c, uint16_t devAddress, uint16_t memAddress, uint16_t memAddSize, uint8_t *data, uint16_t size);
+extern "C" void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c);
+extern "C" void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c);
+
+inline void HAL_NVIC_SetPriority(IRQn_Type, uint32_t, uint32_t)
+{
+}
+
+inline void HAL_NVIC_EnableIRQ(IRQn_Type)
+{
+}
+
+inline uint32_t __get_PRIMASK()
+{
+  return 0;
+}
+
+inline void __set_PRIMASK(uint32_t)
+{
+}
+
+inline void __disable_irq()
+{
+}
+
+// Same limits as the STM32duino Wire library: the TX buffer grows on demand up to WIRE_MAX_TX_BUFF_LENGTH
+#define BUFFER_LENGTH 32
+#define WIRE_MAX_TX_BUFF_LENGTH 1024
+
+// TwoWire backed by the software ST25DV64KC model (see ST25DV64KCModel.h)
+class TwoWire
+{
+public:
+  TwoWire();
+
+  void setSCL(uint32_t pin);
+  void setSDA(uint32_t pin);
+  void begin();
+  void setClock(uint32_t frequency);
+
+  void beginTransmission(uint8_t address);
+  void beginTransmission(int address);
+  uint8_t endTransmission(bool sendStop = true);
+
+  size_t write(uint8_t data);
+  size_t write(const uint8_t *data, size_t quantity);
+
+  uint8_t requestFrom(uint8_t address, uint8_t quantity);
+  uint8_t requestFrom(int address, int quantity);
+  uint8_t requestFrom(int address, unsigned int quantity);
+
+  int available();
+  int read();
+  size_t readBytes(uint8_t *buffer, size_t length);
+
+  i2c_t *getHandle()
+  {
+    return &i2c;
+  }
+
+  // Host only: attach the device model answering on this bus
+  void attach(ST25DV64KCModel *model);
+
+private:
+  i2c_t i2c;
+  ST25DV64KCModel *model;
+  uint32_t clockFrequency;
+  uint8_t txAddress;
+  uint8_t txBuffer[WIRE_MAX_TX_BUFF_LENGTH];
+  size_t txLength;
+  uint8_t rxBuffer[512];
+  size_t rxLength;
+  size_t rxIndex;
+};
+
+extern TwoWire Wire;
@@ -0,0 +1,205 @@
+// Driver for the fuzz harnesses where libFuzzer is not available: runs the inputs named on the command line,
+// otherwise --runs generated NDEF messages. The generator lays out mostly well-formed records of the types the
+// readers look for (some chunked, some with an ID, some long) and then damages part of them.
+//
+//   build/fuzz_ndef_<reader> [--runs N] [--seed S] [file...]
+//
+// A generated input that fails is saved as crash-input, to be replayed by naming it on the command line.
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "../../arduino-code/SparkFun_ST25DV64KC_Arduino_Library_Constants.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static uint32_t state = 1;
+
+static uint32_t randomBelow(uint32_t limit)
+{
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state % limit;
+}
+
+static void append(std::vector<uint8_t> &out, const void *data, size_t length)
+{
+  out.insert(out.end(), (const uint8_t *)data, (const uint8_t *)data + length);
+}
+
+static void appendRandom(std::vector<uint8_t> &out, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+    out.push_back(' ' + randomBelow(95));
+}
+
+static std::vector<uint8_t> payloadFor(uint8_t tnf, const char *type)
+{
+  std::vector<uint8_t> payload;
+  if (tnf == SFE_ST25DV_NDEF_TNF_WELL_KNOWN && type[0] == SFE_ST25DV_NDEF_URI_RECORD)
+  {
+    payload.push_back(randomBelow(40)); // some invalid prefix codes
+    appendRandom(payload, randomBelow(60));
+  }
+  else if (tnf == SFE_ST25DV_NDEF_TNF_WELL_KNOWN)
+  {
+    uint8_t languageLength = randomBelow(6);
+    payload.push_back((randomBelow(8) == 0 ? 0x80 : 0) | languageLength);
+    appendRandom(payload, languageLength + randomBelow(randomBelow(4) == 0 ? 300 : 40));
+  }
+  else if (tnf == SFE_ST25DV_NDEF_TNF_MEDIA)
+  {
+    const uint8_t *ids[] = {SFE_ST25DV_WIFI_CREDENTIAL, SFE_ST25DV_WIFI_SSID, SFE_ST25DV_WIFI_NETWORK_KEY, SFE_ST25DV_WIFI_AUTH_WPA2_PERSONAL};
+    for (uint8_t attribute = randomBelow(6); attribute > 0; attribute--)
+    {
+      const uint8_t *id = ids[randomBelow(4)];
+      uint16_t length = (id == SFE_ST25DV_WIFI_CREDENTIAL) ? 0 : randomBelow(40);
+      uint8_t header[4] = {id[0], id[1], (uint8_t)(length >> 8), (uint8_t)length};
+      append(payload, header, 4);
+      appendRandom(payload, length);
+    }
+  }
+  else
+    appendRandom(payload, randomBelow(randomBelow(4) == 0 ? 400 : 40));
+  return payload;
+}
+
+static void appendChunk(std::vector<uint8_t> &out, uint8_t header, const char *type, const uint8_t *payload, uint32_t payloadLength, bool withID)
+{
+  uint8_t typeLength = strlen(type);
+  if (payloadLength <= 0xFF && randomBelow(8) != 0)
+    header |= SFE_ST25DV_NDEF_SR;
+  if (withID)
+    header |= SFE_ST25DV_NDEF_IL;
+
+  out.push_back(header);
+  out.push_back(typeLength);
+  if (header & SFE_ST25DV_NDEF_SR)
+    out.push_back(payloadLength);
+  else
+  {
+    uint8_t length[4] = {(uint8_t)(payloadLength >> 24), (uint8_t)(payloadLength >> 16), (uint8_t)(payloadLength >> 8), (uint8_t)payloadLength};
+    append(out, length, 4);
+  }
+  if (withID)
+    out.push_back(2);
+  append(out, type, typeLength);
+  if (withID)
+    append(out, "id", 2);
+  append(out, payload, payloadLength);
+}
+
+static std::vector<uint8_t> generate()
+{
+  static const struct
+  {
+    uint8_t tnf;
+    const char *type;
+  } types[] = {
+      {SFE_ST25DV_NDEF_TNF_WELL_KNOWN, "U"},
+      {SFE_ST25DV_NDEF_TNF_WELL_KNOWN, "T"},
+      {SFE_ST25DV_NDEF_TNF_MEDIA, SFE_ST25DV_WIFI_MIME_TYPE},
+      {SFE_ST25DV_NDEF_TNF_EXTERNAL, "lukso.io:addr"},
+      {SFE_ST25DV_NDEF_TNF_EXTERNAL, "lukso.io:contract"},
+  };
+
+  std::vector<uint8_t> out;
+  uint8_t records = 1 + randomBelow(6);
+  for (uint8_t r = 0; r < records; r++)
+  {
+    const auto &type = types[randomBelow(5)];
+    std::vector<uint8_t> payload = payloadFor(type.tnf, type.type);
+    uint8_t flags = (r == 0 ? SFE_ST25DV_NDEF_MB : 0) | (r == records - 1 ? SFE_ST25DV_NDEF_ME : 0);
+    bool withID = randomBelow(8) == 0;
+
+    if (randomBelow(5) != 0 || payload.size() < 2)
+    {
+      appendChunk(out, flags | type.tnf, type.type, payload.data(), payload.size(), withID);
+      continue;
+    }
+
+    // Chunked: the first chunk has the type, the others TNF_UNCHANGED, the last one ME
+    uint8_t chunks = 2 + randomBelow(3);
+    size_t offset = 0;
+    for (uint8_t c = 0; c < chunks; c++)
+    {
+      size_t length = (c == chunks - 1) ? payload.size() - offset : randomBelow(payload.size() - offset + 1);
+      uint8_t header = (c == chunks - 1) ? (flags & SFE_ST25DV_NDEF_ME) : SFE_ST25DV_NDEF_CF;
+      if (c == 0)
+        appendChunk(out, header | (flags & SFE_ST25DV_NDEF_MB) | type.tnf, type.type, &payload[offset], length, withID);
+      else
+        appendChunk(out, header | SFE_ST25DV_NDEF_TNF_UNCHANGED, "", &payload[offset], length, false);
+      offset += length;
+    }
+  }
+
+  // Damage it: flip bytes, cut it short
+  for (uint8_t flips = randomBelow(3) == 0 ? 1 + randomBelow(4) : 0; flips > 0 && !out.empty(); flips--)
+    out[randomBelow(out.size())] ^= 1 << randomBelow(8);
+  if (randomBelow(8) == 0 && !out.empty())
+    out.resize(randomBelow(out.size()));
+  return out;
+}
+
+static std::vector<uint8_t> current;
+
+static void saveCurrent(int signal)
+{
+  FILE *f = fopen("crash-input", "wb");
+  if (f != nullptr)
+  {
+    fwrite(current.data(), 1, current.size(), f);
+    fclose(f);
+    fprintf(stderr, "input saved as crash-input (%u bytes)\n", (unsigned)current.size());
+  }
+  ::signal(signal, SIG_DFL);
+  raise(signal);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned runs = 10000;
+  std::vector<const char *> files;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+      runs = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+      state = strtoul(argv[++i], nullptr, 0) | 1;
+    else
+      files.push_back(argv[i]);
+  }
+
+  for (const char *file : files)
+  {
+    FILE *f = fopen(file, "rb");
+    if (f == nullptr)
+    {
+      perror(file);
+      return 1;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+      data.insert(data.end(), buffer, buffer + n);
+    fclose(f);
+    LLVMFuzzerTestOneInput(data.data(), data.size());
+  }
+  if (!files.empty())
+    return 0;
+
+  signal(SIGABRT, saveCurrent);
+  signal(SIGSEGV, saveCurrent);
+  for (unsigned run = 0; run < runs; run++)
+  {
+    current = generate();
+    LLVMFuzzerTestOneInput(current.data(), current.size());
+  }
+  printf("%s: %u generated inputs\n", argv[0], runs);
+  return 0;
+}
@@ -0,0 +1,48 @@
+#include "HostHarness.h"
+#include "NDEFFuzz.h"
+#include <string.h>
+
+namespace fuzz
+{
+  SFE_ST25DV64KC_NDEF st25;
+
+  bool load(const uint8_t *data, size_t size)
+  {
+    static bool begun = false;
+    if (!begun)
+    {
+      begun = host::beginTag(st25);
+      FUZZ_ASSERT(begun);
+    }
+
+    static uint8_t message[ST25DV64KCModel::USER_MEMORY_LENGTH];
+    uint16_t address = st25.getCCFileLen();
+    size_t maxSize = sizeof(message) - address - 5; // TLV header and terminator
+    if (size > maxSize)
+      size = maxSize;
+
+    uint16_t length = 0;
+    message[length++] = SFE_ST25DV_TYPE5_NDEF_MESSAGE_TLV;
+    if (size > 0xFE)
+    {
+      message[length++] = 0xFF;
+      message[length++] = size >> 8;
+      message[length++] = size & 0xFF;
+    }
+    else
+      message[length++] = size;
+    memcpy(&message[length], data, size);
+    length += size;
+    message[length++] = SFE_ST25DV_TYPE5_TERMINATOR_TLV;
+
+    // Written by the RF side, the driver learns about it like after a field session
+    host::model.rfWriteUserMemory(address, message, length);
+    st25.invalidateNDEFIndex();
+
+    SFE_ST25DV64KC_NDEFIndex index;
+    if (size > SFE_ST25DV64KC_NDEFIndex::CAPACITY)
+      return false;
+    memcpy(index.buffer(), data, size);
+    return index.parse(size);
+  }
+}
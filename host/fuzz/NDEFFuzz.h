@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../../arduino-code/SparkFun_ST25DV64KC_NDEF.h"
+
+// Shared by the NDEF fuzz harnesses: the input becomes the NDEF message in the user memory of the model and is read
+// back through the NDEF index and streamed from the EEPROM. Where the index accepts the message both have to agree.
+namespace fuzz
+{
+  extern SFE_ST25DV64KC_NDEF st25;
+
+  // Writes data as the V field of the NDEF Message TLV, followed by a terminator. Returns true if the NDEF index
+  // accepts it, i.e. if the indexed and the streamed readers have to agree on it.
+  bool load(const uint8_t *data, size_t size);
+}
+
+#define FUZZ_ASSERT(condition)                                                          \
+  do                                                                                    \
+  {                                                                                     \
+    if (!(condition))                                                                   \
+    {                                                                                   \
+      fprintf(stderr, "%s:%d: assertion failed: %s\n", __FILE__, __LINE__, #condition); \
+      abort();                                                                          \
+    }                                                                                   \
+  } while (0)
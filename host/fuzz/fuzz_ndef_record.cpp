@@ -0,0 +1,61 @@
+// libFuzzer harness for readNDEFRecord and readNDEFRecordChunks, with the types the firmware uses.
+//
+//   build/libfuzzer/fuzz_ndef_record [libFuzzer options] [corpus]   (make fuzz, clang)
+//   build/fuzz_ndef_record [--runs N] [--seed S] [file...]          (any compiler, see FuzzMain.cpp)
+
+#include "NDEFFuzz.h"
+#include <string.h>
+#include <vector>
+
+static bool collect(const uint8_t *data, uint16_t length, uint32_t offset, void *context)
+{
+  std::vector<uint8_t> *collected = (std::vector<uint8_t> *)context;
+  FUZZ_ASSERT(offset == collected->size());
+  collected->insert(collected->end(), data, data + length);
+  return true;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  static const struct
+  {
+    uint8_t tnf;
+    const char *type;
+  } types[] = {
+      {SFE_ST25DV_NDEF_TNF_EXTERNAL, "lukso.io:addr"},
+      {SFE_ST25DV_NDEF_TNF_EXTERNAL, "lukso.io:contract"},
+      {SFE_ST25DV_NDEF_TNF_WELL_KNOWN, "T"},
+      {SFE_ST25DV_NDEF_TNF_MEDIA, SFE_ST25DV_WIFI_MIME_TYPE},
+  };
+
+  bool wellFormed = fuzz::load(data, size);
+
+  for (const auto &type : types)
+  {
+    for (uint8_t recordNo = 1; recordNo <= 2; recordNo++)
+    {
+      uint8_t payload[2][600];
+      uint16_t payloadLength[2];
+      std::vector<uint8_t> chunks[2];
+      bool ok[2], chunksOk[2];
+      for (int streamed = 0; streamed < 2; streamed++)
+      {
+        fuzz::st25.setNDEFIndexEnabled(!streamed);
+        payloadLength[streamed] = sizeof(payload[0]);
+        ok[streamed] = fuzz::st25.readNDEFRecord(type.tnf, (const uint8_t *)type.type, strlen(type.type), payload[streamed], &payloadLength[streamed], recordNo);
+        chunksOk[streamed] = fuzz::st25.readNDEFRecordChunks(type.tnf, (const uint8_t *)type.type, strlen(type.type), collect, &chunks[streamed], recordNo);
+
+        // Copied or pushed, the payload is the same
+        if (ok[streamed])
+          FUZZ_ASSERT(chunksOk[streamed] && chunks[streamed] == std::vector<uint8_t>(payload[streamed], payload[streamed] + payloadLength[streamed]));
+      }
+      if (wellFormed)
+      {
+        FUZZ_ASSERT(ok[0] == ok[1] && chunksOk[0] == chunksOk[1] && chunks[0] == chunks[1]);
+        if (ok[0])
+          FUZZ_ASSERT(payloadLength[0] == payloadLength[1] && memcmp(payload[0], payload[1], payloadLength[0]) == 0);
+      }
+    }
+  }
+  return 0;
+}
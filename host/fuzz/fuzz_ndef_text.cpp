@@ -0,0 +1,37 @@
+// libFuzzer harness for readNDEFText.
+//
+//   build/libfuzzer/fuzz_ndef_text [libFuzzer options] [corpus]   (make fuzz, clang)
+//   build/fuzz_ndef_text [--runs N] [--seed S] [file...]          (any compiler, see FuzzMain.cpp)
+
+#include "NDEFFuzz.h"
+#include <string.h>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  bool wellFormed = fuzz::load(data, size);
+
+  for (uint8_t recordNo = 1; recordNo <= 3; recordNo++)
+  {
+    uint16_t maxLength = recordNo == 3 ? 4 : 300;
+    uint8_t text[2][300];
+    uint16_t textLength[2];
+    char language[2][6];
+    bool ok[2];
+    for (int streamed = 0; streamed < 2; streamed++)
+    {
+      fuzz::st25.setNDEFIndexEnabled(!streamed);
+      textLength[streamed] = maxLength;
+      language[streamed][0] = 0;
+      ok[streamed] = fuzz::st25.readNDEFText(text[streamed], &textLength[streamed], recordNo, language[streamed], sizeof(language[0]));
+      if (ok[streamed])
+        FUZZ_ASSERT(textLength[streamed] < maxLength && text[streamed][textLength[streamed]] == 0 && strlen(language[streamed]) < sizeof(language[0]));
+    }
+    if (wellFormed)
+    {
+      FUZZ_ASSERT(ok[0] == ok[1]);
+      if (ok[0])
+        FUZZ_ASSERT(textLength[0] == textLength[1] && memcmp(text[0], text[1], textLength[0]) == 0 && strcmp(language[0], language[1]) == 0);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,30 @@
+// libFuzzer harness for readNDEFURI.
+//
+//   build/libfuzzer/fuzz_ndef_uri [libFuzzer options] [corpus]   (make fuzz, clang)
+//   build/fuzz_ndef_uri [--runs N] [--seed S] [file...]          (any compiler, see FuzzMain.cpp)
+
+#include "NDEFFuzz.h"
+#include <string.h>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  bool wellFormed = fuzz::load(data, size);
+
+  for (uint8_t recordNo = 1; recordNo <= 3; recordNo++)
+  {
+    // Enough room for the longest prefix and some URI, then too little for most
+    uint16_t maxLength = recordNo == 3 ? 8 : 300;
+    char uri[2][300];
+    bool ok[2];
+    for (int streamed = 0; streamed < 2; streamed++)
+    {
+      fuzz::st25.setNDEFIndexEnabled(!streamed);
+      ok[streamed] = fuzz::st25.readNDEFURI(uri[streamed], maxLength, recordNo);
+      if (ok[streamed])
+        FUZZ_ASSERT(strlen(uri[streamed]) < maxLength);
+    }
+    if (wellFormed)
+      FUZZ_ASSERT(ok[0] == ok[1] && (!ok[0] || strcmp(uri[0], uri[1]) == 0));
+  }
+  return 0;
+}
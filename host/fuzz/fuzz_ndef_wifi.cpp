@@ -0,0 +1,29 @@
+// libFuzzer harness for readNDEFWiFi.
+//
+//   build/libfuzzer/fuzz_ndef_wifi [libFuzzer options] [corpus]   (make fuzz, clang)
+//   build/fuzz_ndef_wifi [--runs N] [--seed S] [file...]          (any compiler, see FuzzMain.cpp)
+
+#include "NDEFFuzz.h"
+#include <string.h>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  bool wellFormed = fuzz::load(data, size);
+
+  for (uint8_t recordNo = 1; recordNo <= 3; recordNo++)
+  {
+    uint16_t maxLength = recordNo == 3 ? 4 : 80;
+    char ssid[2][80], passwd[2][80];
+    bool ok[2];
+    for (int streamed = 0; streamed < 2; streamed++)
+    {
+      fuzz::st25.setNDEFIndexEnabled(!streamed);
+      ok[streamed] = fuzz::st25.readNDEFWiFi(ssid[streamed], maxLength, passwd[streamed], maxLength, recordNo);
+      if (ok[streamed])
+        FUZZ_ASSERT(strlen(ssid[streamed]) < maxLength && strlen(passwd[streamed]) < maxLength);
+    }
+    if (wellFormed)
+      FUZZ_ASSERT(ok[0] == ok[1] && (!ok[0] || (strcmp(ssid[0], ssid[1]) == 0 && strcmp(passwd[0], passwd[1]) == 0)));
+  }
+  return 0;
+}
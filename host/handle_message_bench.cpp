@@ -0,0 +1,790 @@
+// Regression checks and a throughput/latency benchmark for NFCTag::handleMessage against the ST25DV64KC model.
+//
+//   build/handle_message_bench [iterations]
+
+#include "HostHarness.h"
+#include "../arduino-code/NFCTag.h"
+#include "../arduino-code/uECC.h"
+#include "../arduino-code/IdleScheduler.h"
+#include "HostClock.h"
+#include <EEPROM.h>
+#ifdef NDEF_EXTERNAL_TYPE_RECORDS
+#include "../arduino-code/crypto-util.h" // hex2bin
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#include <vector>
+
+static ClockGovernor::OperatingPoint clockPoint = ClockGovernor::IDLE_POINT;
+static unsigned clockSwitches = 0;
+
+static bool switchClock(ClockGovernor::OperatingPoint point)
+{
+  // Switches only from and to the idle point
+  if (point != ClockGovernor::IDLE_POINT && clockPoint != ClockGovernor::IDLE_POINT)
+    return false;
+  clockPoint = point;
+  clockSwitches++;
+  return true;
+}
+
+static IdleScheduler::Mode idleMode = IdleScheduler::RUN;
+
+static void enterIdle(IdleScheduler::Mode mode)
+{
+  idleMode = mode;
+}
+
+static bool readSupply(bool *fieldOn, bool *harvesting);
+
+ClockGovernor governor(&switchClock);
+JobScheduler jobs(&readSupply);
+Wallet wallet;
+NFCTag nfcTag(wallet, &host::bus, &governor, &jobs);
+
+static bool readSupply(bool *fieldOn, bool *harvesting)
+{
+  return nfcTag.readSupply(fieldOn, harvesting);
+}
+
+static int failures = 0;
+
+#define CHECK(condition)                                              \
+  do                                                                  \
+  {                                                                   \
+    if (!(condition))                                                 \
+    {                                                                 \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                     \
+    }                                                                 \
+  } while (0)
+
+static uint8_t reply[MAILBOX_LENGTH];
+static uint16_t replyLength;
+
+// Followed by the jobs the main loop would run, e.g. the NDEF update of CONTRACT_ADDRESS
+static bool exchange(const uint8_t *request, uint16_t requestLength)
+{
+  replyLength = 0;
+  bool exchanged = host::exchange(nfcTag, request, requestLength, reply, &replyLength);
+  jobs.run();
+  return exchanged;
+}
+
+static void checkHello()
+{
+  uint8_t request[] = {NFCTag::HELLO};
+  CHECK(exchange(request, sizeof(request)));
+  CHECK(replyLength > 6 && reply[0] == NFCTag::HELLO);
+  CHECK(reply[1] == NFCTag::HELLO_TAG_FIRMWARE_VERSION && reply[2] == 3);
+  CHECK(reply[3] == FIRMWARE_VERSION_MAJOR && reply[4] == FIRMWARE_VERSION_MINOR && reply[5] == FIRMWARE_VERSION_PATCH);
+}
+
+static void checkGetIdentity(bool contractAddressSet, const uint8_t *contractAddress)
+{
+  uint8_t request[] = {NFCTag::GET_IDENTITY};
+  CHECK(exchange(request, sizeof(request)));
+  uint16_t expectedLength = 1 + PUBLIC_KEY_LENGTH + LUKSO_ADDRESS_LENGTH + DEVICE_UID_LENGTH + 1 + (contractAddressSet ? LUKSO_ADDRESS_LENGTH : 0);
+  CHECK(replyLength == expectedLength);
+  if (replyLength != expectedLength)
+    return;
+
+  const uint8_t *field = &reply[1];
+  CHECK(memcmp(field, wallet.getPublicKey(), PUBLIC_KEY_LENGTH) == 0);
+  field += PUBLIC_KEY_LENGTH;
+  CHECK(memcmp(field, wallet.getLuksoAddressBytes(), LUKSO_ADDRESS_LENGTH) == 0);
+  field += LUKSO_ADDRESS_LENGTH;
+  for (uint8_t i = 0; i < DEVICE_UID_LENGTH; i++)
+    CHECK(field[i] == host::model.getSystemRegister(0x18 + DEVICE_UID_LENGTH - 1 - i));
+  field += DEVICE_UID_LENGTH;
+  CHECK(*field++ == (contractAddressSet ? 1 : 0));
+  if (contractAddressSet)
+    CHECK(memcmp(field, contractAddress, LUKSO_ADDRESS_LENGTH) == 0);
+}
+
+static void checkAddressChecksum()
+{
+  // EIP-55: a letter is upper case when the matching nibble of keccak256(lower case address) is >= 8
+  std::string lower = wallet.getLuksoAddress() + 2;
+  for (char &c : lower)
+    c = tolower(c);
+  Keccak keccak;
+  std::string reference = keccak(lower.c_str(), lower.size());
+  const char *address = wallet.getLuksoAddress() + 2;
+  for (uint8_t i = 0; i < 40; i++)
+  {
+    if (address[i] >= '0' && address[i] <= '9')
+      continue;
+    CHECK((reference[i] > '7') == (address[i] >= 'A' && address[i] <= 'F'));
+  }
+}
+
+static void checkSign()
+{
+  uint8_t request[1 + KECCAK_HASH_LENGTH] = {NFCTag::SIGN};
+  for (uint8_t i = 0; i < KECCAK_HASH_LENGTH; i++)
+    request[1 + i] = (uint8_t)host::nextRandom();
+
+  CHECK(exchange(request, sizeof(request)));
+  CHECK(replyLength == 1 + SIGNATURE_LENGTH && reply[0] == NFCTag::SIGN);
+  CHECK(uECC_verify(wallet.getPublicKey(), &request[1], &reply[1]) == 1);
+}
+
+static void checkContractAddress()
+{
+  const char *address = "0x5fbdb2315678afecb367f032d93f642f64180aa3";
+  uint8_t request[1 + LUKSO_ADDRESS_AS_STRING_LENGTH] = {NFCTag::CONTRACT_ADDRESS};
+  memcpy(&request[1], address, LUKSO_ADDRESS_AS_STRING_LENGTH);
+
+  CHECK(exchange(request, sizeof(request)));
+  CHECK(replyLength == 1 && reply[0] == NFCTag::CONTRACT_ADDRESS);
+
+  uint8_t expected[LUKSO_ADDRESS_LENGTH];
+  for (uint8_t i = 0; i < LUKSO_ADDRESS_LENGTH; i++)
+  {
+    unsigned value;
+    sscanf(address + 2 + i * 2, "%2x", &value);
+    expected[i] = value;
+  }
+  checkGetIdentity(true, expected);
+
+  // Both addresses must be readable from the NDEF area by the phone
+  uint8_t userMemory[512];
+  host::model.readUserMemory(0, userMemory, sizeof(userMemory));
+  std::string ndef((const char *)userMemory, sizeof(userMemory));
+#ifdef NDEF_EXTERNAL_TYPE_RECORDS
+  CHECK(ndef.find(std::string(NDEF_EXTERNAL_TYPE_CONTRACT) + std::string((const char *)expected, LUKSO_ADDRESS_LENGTH)) != std::string::npos);
+  CHECK(ndef.find(std::string(NDEF_EXTERNAL_TYPE_ADDRESS) + std::string((const char *)wallet.getLuksoAddressBytes(), LUKSO_ADDRESS_LENGTH)) != std::string::npos);
+#else
+  CHECK(ndef.find(address) != std::string::npos);
+  CHECK(ndef.find(wallet.getLuksoAddress()) != std::string::npos);
+#endif
+  CHECK(ndef.find("phygital.tuszy.com") != std::string::npos);
+
+  request[2] = 'y';
+  CHECK(exchange(request, sizeof(request)));
+  CHECK(replyLength == 1 && reply[0] == NFCTag::INVALID_MESSAGE_FORMAT);
+
+  // Letters beyond f are not hex digits, the stored address stays as it was
+  memcpy(&request[1], address, LUKSO_ADDRESS_AS_STRING_LENGTH);
+  request[1 + 10] = 'Z';
+  CHECK(exchange(request, sizeof(request)));
+  CHECK(replyLength == 1 && reply[0] == NFCTag::INVALID_MESSAGE_FORMAT);
+  checkGetIdentity(true, expected);
+}
+
+static void checkErrors()
+{
+  uint8_t unknown[] = {0x7F, 0x00};
+  CHECK(exchange(unknown, sizeof(unknown)));
+  CHECK(replyLength == 1 && reply[0] == NFCTag::UNKOWN_MESSAGE);
+
+  uint8_t shortSign[] = {NFCTag::SIGN, 0x01, 0x02, 0x03};
+  CHECK(exchange(shortSign, sizeof(shortSign)));
+  CHECK(replyLength == 1 && reply[0] == NFCTag::INVALID_MESSAGE_LENGTH);
+
+  uint8_t longHello[] = {NFCTag::HELLO, 0x00};
+  CHECK(exchange(longHello, sizeof(longHello)));
+  CHECK(replyLength == 1 && reply[0] == NFCTag::INVALID_MESSAGE_LENGTH);
+}
+
+static void checkClockGovernor()
+{
+  // The first signature: EH_MODE only takes effect at the next power-up, so the EH output is still off and the
+  // burst runs at the fastest point
+  CHECK(governor.getStatistics(ClockGovernor::PLL_80MHZ).bursts == 1);
+  CHECK(clockSwitches == 2 && clockPoint == ClockGovernor::IDLE_POINT && governor.getCurrent() == ClockGovernor::IDLE_POINT);
+
+  // On harvested energy, with the initial burst estimate only the 24 MHz point stays within the EH current and
+  // what C1 can bridge
+  ClockGovernor initial;
+  CHECK(initial.choose(true) == ClockGovernor::MSI_24MHZ);
+  CHECK(initial.choose(false) == ClockGovernor::PLL_80MHZ);
+  initial.setCeiling(ClockGovernor::MSI_48MHZ);
+  CHECK(initial.choose(false) == ClockGovernor::MSI_48MHZ);
+  CHECK(initial.choose(true) == ClockGovernor::MSI_24MHZ);
+
+  // The estimate now comes from the measured burst
+  CHECK(governor.getBurstCycles() != ClockGovernor::INITIAL_BURST_CYCLES);
+}
+
+static void checkIdleScheduler()
+{
+  IdleScheduler scheduler(&enterIdle);
+  // A message that came in while loop() was busy is handled before waiting
+  CHECK(scheduler.idle(true, false) == IdleScheduler::RUN && idleMode == IdleScheduler::RUN);
+  // The RNG interrupt keeps the pool filling, it does not run in STOP2
+  CHECK(scheduler.idle(false, true) == IdleScheduler::SLEEP && idleMode == IdleScheduler::SLEEP);
+  CHECK(scheduler.idle(false, false) == IdleScheduler::STOP2 && idleMode == IdleScheduler::STOP2);
+  CHECK(scheduler.getEntries(IdleScheduler::RUN) == 1 && scheduler.getEntries(IdleScheduler::SLEEP) == 1 && scheduler.getEntries(IdleScheduler::STOP2) == 1);
+}
+
+// The main loop leaves the reply transfer to the bus and sleeps, the transfer's interrupt wakes it
+static void checkReplyTransfer()
+{
+  uint8_t request[] = {NFCTag::HELLO};
+  CHECK(host::model.rfPutMessage(request, sizeof(request)));
+  nfcTag.handleMessage();
+  CHECK(nfcTag.isTransferPending());
+  nfcTag.completeTransfers();
+  CHECK(nfcTag.isTransferPending());
+  IdleScheduler scheduler;
+  CHECK(scheduler.choose(false, nfcTag.isTransferPending()) == IdleScheduler::SLEEP);
+
+  host::bus.poll(); // the completion interrupt
+  CHECK(!nfcTag.isTransferPending());
+  CHECK(scheduler.choose(false, nfcTag.isTransferPending()) == IdleScheduler::STOP2);
+  CHECK(host::model.rfGetMessage(reply, &replyLength) && reply[0] == NFCTag::HELLO);
+}
+
+#ifdef SFE_ST25DV64KC_DMA_BUS_AVAILABLE
+extern "C" void DMA1_Channel6_IRQHandler(void);
+extern "C" void DMA1_Channel7_IRQHandler(void);
+
+static bool dmaDone;
+static bool dmaSuccess;
+
+static void onDMATransfer(bool success, void *)
+{
+  dmaDone = true;
+  dmaSuccess = success;
+}
+
+// The DMA bus against the host HAL: an asynchronous transfer stays on the bus until its channel's interrupt
+static void checkDMABus()
+{
+  static SFE_ST25DV64KC_DMABus dma(Wire);
+  CHECK(dma.begin());
+  CHECK(dma.probe((uint8_t)SF_ST25DV64KC_ADDRESS::SYSTEM));
+
+  const uint16_t address = 0x1000; // past the NDEF area
+  uint8_t data[16], readBack[sizeof(data)] = {};
+  for (uint8_t i = 0; i < sizeof(data); i++)
+    data[i] = i * 7;
+
+  dmaDone = false;
+  CHECK(dma.memWriteAsync((uint8_t)SF_ST25DV64KC_ADDRESS::DATA, address, data, sizeof(data), &onDMATransfer, nullptr));
+  CHECK(dma.isBusy() && !dmaDone);
+  CHECK(!dma.memReadAsync((uint8_t)SF_ST25DV64KC_ADDRESS::DATA, address, readBack, sizeof(readBack), &onDMATransfer, nullptr));
+  DMA1_Channel6_IRQHandler();
+  CHECK(!dma.isBusy() && dmaDone && dmaSuccess);
+
+  hostClockAdvance(10000); // EEPROM write cycle
+  dmaDone = false;
+  CHECK(dma.memReadAsync((uint8_t)SF_ST25DV64KC_ADDRESS::DATA, address, readBack, sizeof(readBack), &onDMATransfer, nullptr));
+  CHECK(dma.isBusy());
+  DMA1_Channel7_IRQHandler();
+  CHECK(!dma.isBusy() && dmaDone && dmaSuccess && memcmp(readBack, data, sizeof(data)) == 0);
+}
+#endif
+
+static uint32_t getUint32(const uint8_t *source)
+{
+  return ((uint32_t)source[0] << 24) | ((uint32_t)source[1] << 16) | ((uint32_t)source[2] << 8) | source[3];
+}
+
+static bool fakeFieldOn, fakeHarvesting, fakeReadable;
+static unsigned fakeSteps;
+
+static bool readFakeSupply(bool *fieldOn, bool *harvesting)
+{
+  *fieldOn = fakeFieldOn;
+  *harvesting = fakeHarvesting;
+  return fakeReadable;
+}
+
+static JobScheduler::StepResult fakeStep(void *)
+{
+  // Three steps to completion
+  return ++fakeSteps % 3 == 0 ? JobScheduler::STEP_DONE : JobScheduler::STEP_MORE;
+}
+
+static void checkJobScheduler()
+{
+  JobScheduler scheduler(&readFakeSupply);
+  scheduler.setJob(JobScheduler::NDEF_UPDATE, &fakeStep, nullptr);
+  const JobScheduler::Statistics &statistics = scheduler.getStatistics(JobScheduler::NDEF_UPDATE);
+  fakeSteps = 0;
+
+  // Not harvesting: the tag has another supply and jobs run right away
+  fakeReadable = true;
+  fakeFieldOn = false;
+  fakeHarvesting = false;
+  scheduler.request(JobScheduler::NDEF_UPDATE);
+  for (uint8_t i = 0; i < 3; i++)
+    scheduler.run();
+  CHECK(!scheduler.isPending(JobScheduler::NDEF_UPDATE) && statistics.completed == 1 && statistics.steps == 3);
+
+  // On harvested energy: deferred until the field has settled
+  fakeFieldOn = true;
+  fakeHarvesting = true;
+  scheduler.request(JobScheduler::NDEF_UPDATE);
+  hostClockAdvance(JobScheduler::SAMPLE_INTERVAL_MICROS);
+  scheduler.run();
+  hostClockAdvance(JobScheduler::SAMPLE_INTERVAL_MICROS);
+  scheduler.run();
+  CHECK(statistics.steps == 3 && statistics.deferred == 1 && !scheduler.isSupplyStable());
+  CHECK(scheduler.hasWork()); // the MCU only sleeps until the field has settled
+  hostClockAdvance(JobScheduler::FIELD_SETTLE_MICROS);
+  scheduler.run();
+  CHECK(statistics.steps == 4 && statistics.runs == 2 && scheduler.isSupplyStable());
+
+  // The field drops between two steps: aborted, resumed once it has settled again
+  fakeFieldOn = false;
+  hostClockAdvance(JobScheduler::SAMPLE_INTERVAL_MICROS);
+  scheduler.run();
+  CHECK(statistics.aborted == 1 && statistics.deferred == 2 && scheduler.isPending(JobScheduler::NDEF_UPDATE));
+  fakeFieldOn = true;
+  hostClockAdvance(JobScheduler::SAMPLE_INTERVAL_MICROS);
+  scheduler.run();
+  hostClockAdvance(JobScheduler::FIELD_SETTLE_MICROS);
+  scheduler.run();
+  scheduler.run(); // within the sample interval, the last sample holds
+  CHECK(!scheduler.isPending(JobScheduler::NDEF_UPDATE) && statistics.completed == 2 && statistics.runs == 3 && statistics.steps == 6);
+
+  // An unreadable status counts as unstable
+  fakeReadable = false;
+  scheduler.request(JobScheduler::NDEF_UPDATE);
+  hostClockAdvance(JobScheduler::SAMPLE_INTERVAL_MICROS);
+  scheduler.run();
+  CHECK(statistics.steps == 6 && statistics.deferred == 3 && !scheduler.isSupplyStable());
+  // Nothing to wait for, the MCU may stop until the next message
+  CHECK(scheduler.hasPendingJobs() && !scheduler.hasWork());
+
+  // The tag's own jobs: the NDEF update of CONTRACT_ADDRESS has run, the model's EH output is off
+  uint8_t request[] = {NFCTag::DIAGNOSTICS, NFCTag::DIAGNOSTICS_PAGE_JOBS};
+  CHECK(exchange(request, sizeof(request)));
+  CHECK(replyLength == 1 + JobScheduler::JOB_COUNT * (2 + 1 + 5 * 4) && reply[0] == NFCTag::DIAGNOSTICS);
+  const uint8_t *job = &reply[1 + JobScheduler::NDEF_UPDATE * (2 + 1 + 5 * 4)];
+  CHECK(job[0] == NFCTag::DIAGNOSTICS_TAG_JOB && job[2] == JobScheduler::NDEF_UPDATE);
+  CHECK(getUint32(job + 3) > 0 && getUint32(job + 7) == getUint32(job + 3) && getUint32(job + 11) == 0 && getUint32(job + 15) == 0);
+  CHECK(!jobs.hasPendingJobs());
+}
+
+static void checkDiagnostics()
+{
+  // Counters: every TLV present and consistent with the transfers seen by the model
+  uint8_t request[] = {NFCTag::DIAGNOSTICS};
+  CHECK(exchange(request, sizeof(request)));
+  CHECK(replyLength > 1 && reply[0] == NFCTag::DIAGNOSTICS);
+
+  unsigned messageTags = 0;
+  unsigned clockTags = 0;
+  uint32_t signatures = 0;
+  bool i2cSeen = false;
+  for (uint16_t offset = 1; offset + 2 <= replyLength;)
+  {
+    uint8_t tag = reply[offset];
+    uint8_t length = reply[offset + 1];
+    const uint8_t *value = &reply[offset + 2];
+    CHECK(offset + 2 + length <= replyLength);
+    if (tag == NFCTag::DIAGNOSTICS_TAG_I2C)
+    {
+      i2cSeen = length == 32;
+      CHECK(getUint32(value) > 0 && getUint32(value + 4) > 0); // reads, writes
+      CHECK(getUint32(value + 8) >= getUint32(value));         // at least one byte per read
+    }
+    if (tag == NFCTag::DIAGNOSTICS_TAG_MESSAGE)
+    {
+      CHECK(length == 17 && value[0] == messageTags);
+      messageTags++;
+    }
+    if (tag == NFCTag::DIAGNOSTICS_TAG_CLOCK)
+    {
+      CHECK(length == 13 && value[0] == ClockGovernor::operatingPoints[clockTags].megahertz);
+      signatures += getUint32(value + 1);
+      clockTags++;
+    }
+    offset += 2 + length;
+  }
+  CHECK(i2cSeen);
+  CHECK(messageTags == NFCTag::MESSAGE_HANDLER_COUNT);
+  // SIGN requests rejected before signing count as calls but not as bursts
+  CHECK(clockTags == ClockGovernor::OPERATING_POINT_COUNT && signatures > 0 && signatures <= nfcTag.getMessageStatistics(NFCTag::SIGN).calls);
+
+  // Trace: the last transfer before the reply is the read of this request from the mailbox
+  uint8_t traceRequest[] = {NFCTag::DIAGNOSTICS, NFCTag::DIAGNOSTICS_PAGE_TRACE};
+  CHECK(exchange(traceRequest, sizeof(traceRequest)));
+  CHECK(replyLength > 9 && reply[0] == NFCTag::DIAGNOSTICS && reply[1] == NFCTag::DIAGNOSTICS_TAG_TRACE);
+  if (replyLength <= 9)
+    return;
+  uint8_t entries = (reply[2] - 4) / 14;
+  CHECK(replyLength == 3 + reply[2] && entries > 0);
+  // More entries than fit into the arena scratch memory at once, still oldest first
+  CHECK(entries == (255 - 4) / 14);
+  for (uint8_t i = 1; i < entries; i++)
+    CHECK(getUint32(&reply[3 + 4 + i * 14]) >= getUint32(&reply[3 + 4 + (i - 1) * 14]));
+  const uint8_t *last = &reply[3 + 4 + (entries - 1) * 14];
+  CHECK(getUint32(last + 4) > 0); // the modeled bus time of the read
+  CHECK(last[8] == 0x20 && last[9] == 0x08); // mailbox
+  CHECK(last[10] == 0 && last[11] == 2);     // length
+  CHECK((last[12] & SFE_ST25DV64KC_Trace::TRACE_WRITE) == 0);
+
+  uint8_t longRequest[] = {NFCTag::DIAGNOSTICS, NFCTag::DIAGNOSTICS_PAGE_COUNTERS, 0x00};
+  CHECK(exchange(longRequest, sizeof(longRequest)) && reply[0] == NFCTag::INVALID_MESSAGE_LENGTH);
+  uint8_t badPage[] = {NFCTag::DIAGNOSTICS, 0x7F};
+  CHECK(exchange(badPage, sizeof(badPage)) && reply[0] == NFCTag::INVALID_MESSAGE_FORMAT);
+}
+
+// Bus usage of receiving a mailbox message: length query plus payload read versus the fused receive
+static void compareMailboxReceive(uint16_t length)
+{
+  SFE_ST25DV64KC st25;
+  CHECK(st25.begin(host::bus));
+
+  uint8_t request[MAILBOX_LENGTH];
+  for (uint16_t i = 0; i < length; i++)
+    request[i] = (uint8_t)host::nextRandom();
+  uint8_t received[MAILBOX_LENGTH];
+
+  CHECK(host::model.rfPutMessage(request, length));
+  host::model.resetStatistics();
+  uint16_t separateLength = st25.getMailboxMessageLength();
+  CHECK(separateLength == length && st25.readFromMailbox(received, separateLength));
+  CHECK(memcmp(received, request, length) == 0);
+  ST25DV64KCModel::Statistics separate = host::model.statistics;
+
+  CHECK(host::model.rfPutMessage(request, length));
+  host::model.resetStatistics();
+  uint16_t fusedLength = 0;
+  CHECK(st25.readMailboxMessage(received, sizeof(received), &fusedLength) && fusedLength == length);
+  CHECK(memcmp(received, request, length) == 0);
+  ST25DV64KCModel::Statistics fused = host::model.statistics;
+
+  printf("Mailbox receive, %3u bytes: %u reads, %5u us -> %u reads, %5u us\n", length, separate.readTransactions,
+         (unsigned)separate.readMicros, fused.readTransactions, (unsigned)fused.readMicros);
+}
+
+// Bus usage of reading the URI and both Text records: walking the EEPROM per call versus the NDEF index
+static void compareNDEFRead()
+{
+#ifdef NDEF_EXTERNAL_TYPE_RECORDS
+  return; // no Text records
+#endif
+  SFE_ST25DV64KC_NDEF st25;
+  CHECK(st25.begin(host::bus));
+
+  char uri[64], wallet[LUKSO_ADDRESS_AS_STRING_LENGTH + 1], contract[LUKSO_ADDRESS_AS_STRING_LENGTH + 1];
+  char indexedUri[64], indexedWallet[LUKSO_ADDRESS_AS_STRING_LENGTH + 1], indexedContract[LUKSO_ADDRESS_AS_STRING_LENGTH + 1];
+
+  st25.setNDEFIndexEnabled(false);
+  host::model.resetStatistics();
+  CHECK(st25.readNDEFURI(uri, sizeof(uri)));
+  CHECK(st25.readNDEFText(wallet, sizeof(wallet), 1));
+  CHECK(st25.readNDEFText(contract, sizeof(contract), 2));
+  ST25DV64KCModel::Statistics walked = host::model.statistics;
+
+  st25.setNDEFIndexEnabled(true);
+  host::model.resetStatistics();
+  CHECK(st25.readNDEFURI(indexedUri, sizeof(indexedUri)));
+  CHECK(st25.readNDEFText(indexedWallet, sizeof(indexedWallet), 1));
+  CHECK(st25.readNDEFText(indexedContract, sizeof(indexedContract), 2));
+  ST25DV64KCModel::Statistics indexed = host::model.statistics;
+
+  CHECK(strcmp(uri, "https://www.phygital.tuszy.com") == 0 && strcmp(uri, indexedUri) == 0);
+  CHECK(strcmp(wallet, indexedWallet) == 0 && strcmp(contract, indexedContract) == 0);
+  CHECK(!st25.readNDEFText(indexedContract, sizeof(indexedContract), 3));
+  CHECK(!st25.readNDEFText(indexedContract, LUKSO_ADDRESS_AS_STRING_LENGTH, 2)); // no room for the NULL
+
+  printf("NDEF read, URI + 2 Text records: %u reads, %5u us -> %u reads, %5u us\n", walked.readTransactions,
+         (unsigned)walked.readMicros, indexed.readTransactions, (unsigned)indexed.readMicros);
+}
+
+// Records with an ID and long records, laid out by the composer and parsed back by the index
+static void checkNDEFComposer()
+{
+  uint8_t payload[300];
+  for (uint16_t i = 0; i < sizeof(payload); i++)
+    payload[i] = (uint8_t)i;
+  const uint8_t id[] = {'i', 'd'};
+
+  uint8_t buffer[sizeof(payload) + 64];
+  SFE_ST25DV64KC_NDEFComposer composer(buffer, sizeof(buffer));
+  CHECK(composer.addExternal("lukso.io:addr", payload, LUKSO_ADDRESS_LENGTH));
+  CHECK(composer.addRecord(SFE_ST25DV_NDEF_TNF_MEDIA, (const uint8_t *)"a/b", 3, payload, 5, id, sizeof(id)));
+  CHECK(composer.finish());
+
+  const uint8_t *message = composer.getMessage();
+  CHECK(message[0] == SFE_ST25DV_TYPE5_NDEF_MESSAGE_TLV && message[1] == composer.getLength() - 3);
+  CHECK(message[composer.getLength() - 1] == SFE_ST25DV_TYPE5_TERMINATOR_TLV);
+
+  SFE_ST25DV64KC_NDEFIndex index;
+  memcpy(index.buffer(), message + 2, message[1]);
+  CHECK(index.parse(message[1]) && index.getRecordCount() == 2);
+  const SFE_ST25DV64KC_NDEFIndex::Record *record = index.find(SFE_ST25DV_NDEF_TNF_EXTERNAL, (const uint8_t *)"lukso.io:addr", 13, 1);
+  CHECK(record != nullptr && record->payloadLength == LUKSO_ADDRESS_LENGTH && (record->header & SFE_ST25DV_NDEF_MB));
+  record = index.find(SFE_ST25DV_NDEF_TNF_MEDIA, (const uint8_t *)"a/b", 3, 1);
+  CHECK(record != nullptr && record->idLength == sizeof(id) && record->payloadLength == 5 && (record->header & SFE_ST25DV_NDEF_ME));
+  CHECK(record != nullptr && memcmp(&message[2 + record->typeOffset + record->typeLength], id, sizeof(id)) == 0);
+
+  // Over 255 bytes of payload: 4-byte Payload Length and 3-byte L field
+  composer.clear();
+  CHECK(composer.addExternal("lukso.io:cert", payload, sizeof(payload)));
+  CHECK(composer.finish());
+  message = composer.getMessage();
+  uint16_t fieldLength = (message[2] << 8) | message[3];
+  CHECK(message[1] == 0xFF && fieldLength == composer.getLength() - 5 && fieldLength == SFE_ST25DV64KC_NDEFComposer::recordLength(13, 0, sizeof(payload)));
+  CHECK((message[4] & SFE_ST25DV_NDEF_SR) == 0 && message[6] == 0 && message[7] == 0 && message[8] == 0x01 && message[9] == 0x2C);
+  CHECK(memcmp(&message[10 + 13], payload, sizeof(payload)) == 0);
+
+  // Too small a buffer is reported once the message is finished
+  SFE_ST25DV64KC_NDEFComposer small(buffer, 16);
+  CHECK(!small.addExternal("lukso.io:addr", payload, LUKSO_ADDRESS_LENGTH));
+  CHECK(!small.finish());
+}
+
+static bool collectChunk(const uint8_t *data, uint16_t length, uint32_t offset, void *context)
+{
+  std::vector<uint8_t> *collected = (std::vector<uint8_t> *)context;
+  if (offset != collected->size())
+    return false;
+  collected->insert(collected->end(), data, data + length);
+  return true;
+}
+
+// A Text record split over three chunks, written to the tag by hand, read back whole and chunk by chunk
+static void checkNDEFChunks()
+{
+  const uint8_t message[] = {
+      SFE_ST25DV_TYPE5_NDEF_MESSAGE_TLV, 25,
+      SFE_ST25DV_NDEF_MB | SFE_ST25DV_NDEF_CF | SFE_ST25DV_NDEF_SR | SFE_ST25DV_NDEF_TNF_WELL_KNOWN, 1, 5, SFE_ST25DV_NDEF_TEXT_RECORD,
+      2, 'e', 'n', 'c', 'h',
+      SFE_ST25DV_NDEF_CF | SFE_ST25DV_NDEF_SR | SFE_ST25DV_NDEF_TNF_UNCHANGED, 0, 4,
+      'u', 'n', 'k', 'e',
+      SFE_ST25DV_NDEF_ME | SFE_ST25DV_NDEF_SR | SFE_ST25DV_NDEF_TNF_UNCHANGED, 0, 1,
+      'd',
+      SFE_ST25DV_TYPE5_TERMINATOR_TLV};
+
+  // Placed by the RF side, the user area is write protected for I2C
+  SFE_ST25DV64KC_NDEF st25;
+  CHECK(st25.begin(host::bus));
+  uint16_t address = st25.getCCFileLen();
+  uint8_t saved[sizeof(message)];
+  host::model.readUserMemory(address, saved, sizeof(saved));
+  host::model.rfWriteUserMemory(address, message, sizeof(message));
+
+  char text[16], language[4];
+  CHECK(st25.readNDEFText(text, sizeof(text), 1, language, sizeof(language)));
+  CHECK(strcmp(text, "chunked") == 0 && strcmp(language, "en") == 0);
+  CHECK(!st25.readNDEFText(text, 7, 1)); // no room for the NULL
+
+  const uint8_t type[] = {SFE_ST25DV_NDEF_TEXT_RECORD};
+  uint8_t payload[16];
+  uint16_t length = sizeof(payload);
+  CHECK(st25.readNDEFRecord(SFE_ST25DV_NDEF_TNF_WELL_KNOWN, type, sizeof(type), payload, &length));
+  CHECK(length == 10 && memcmp(payload, "\x02" "enchunked", 10) == 0);
+
+  std::vector<uint8_t> collected;
+  CHECK(st25.readNDEFRecordChunks(SFE_ST25DV_NDEF_TNF_WELL_KNOWN, type, sizeof(type), collectChunk, &collected));
+  CHECK(collected.size() == 10 && memcmp(collected.data(), payload, 10) == 0);
+
+  // The same, streamed from the EEPROM
+  st25.setNDEFIndexEnabled(false);
+  CHECK(st25.readNDEFText(text, sizeof(text), 1) && strcmp(text, "chunked") == 0);
+  length = sizeof(payload);
+  CHECK(st25.readNDEFRecord(SFE_ST25DV_NDEF_TNF_WELL_KNOWN, type, sizeof(type), payload, &length) && length == 10);
+  collected.clear();
+  CHECK(st25.readNDEFRecordChunks(SFE_ST25DV_NDEF_TNF_WELL_KNOWN, type, sizeof(type), collectChunk, &collected));
+  CHECK(collected.size() == 10 && memcmp(collected.data(), payload, 10) == 0);
+
+  // A chunked record without its terminating chunk is rejected
+  SFE_ST25DV64KC_NDEFIndex index;
+  memcpy(index.buffer(), &message[2], 14);
+  CHECK(!index.parse(14));
+
+  host::model.rfWriteUserMemory(address, saved, sizeof(saved));
+}
+
+static bool collectPiece(const uint8_t *data, uint16_t length, uint32_t offset, void *context)
+{
+  CHECK(length <= SFE_ST25DV64KC_NDEFReader::CHUNK_SIZE);
+  return collectChunk(data, length, offset, context);
+}
+
+// A message too large for the NDEF index: its records are streamed from the EEPROM
+static void checkNDEFStream()
+{
+  uint8_t certificate[600];
+  for (uint16_t i = 0; i < sizeof(certificate); i++)
+    certificate[i] = (uint8_t)(i * 7);
+
+  uint8_t buffer[sizeof(certificate) + 64];
+  SFE_ST25DV64KC_NDEFComposer composer(buffer, sizeof(buffer));
+  CHECK(composer.addExternal("lukso.io:cert", certificate, sizeof(certificate)));
+  CHECK(composer.addText("streamed"));
+  CHECK(composer.finish());
+
+  SFE_ST25DV64KC_NDEF st25;
+  CHECK(st25.begin(host::bus));
+  uint16_t address = st25.getCCFileLen();
+  std::vector<uint8_t> saved(composer.getLength());
+  host::model.readUserMemory(address, saved.data(), saved.size());
+  host::model.rfWriteUserMemory(address, composer.getMessage(), composer.getLength());
+
+  char text[16];
+  CHECK(st25.readNDEFText(text, sizeof(text), 1) && strcmp(text, "streamed") == 0);
+
+  uint8_t payload[sizeof(certificate)];
+  uint16_t length = sizeof(payload);
+  host::model.resetStatistics();
+  CHECK(st25.readNDEFRecord(SFE_ST25DV_NDEF_TNF_EXTERNAL, (const uint8_t *)"lukso.io:cert", 13, payload, &length));
+  ST25DV64KCModel::Statistics pulled = host::model.statistics;
+  CHECK(length == sizeof(certificate) && memcmp(payload, certificate, sizeof(certificate)) == 0);
+  length = sizeof(certificate) - 1;
+  CHECK(!st25.readNDEFRecord(SFE_ST25DV_NDEF_TNF_EXTERNAL, (const uint8_t *)"lukso.io:cert", 13, payload, &length));
+
+  std::vector<uint8_t> collected;
+  host::model.resetStatistics();
+  CHECK(st25.readNDEFRecordChunks(SFE_ST25DV_NDEF_TNF_EXTERNAL, (const uint8_t *)"lukso.io:cert", 13, collectPiece, &collected));
+  ST25DV64KCModel::Statistics pushed = host::model.statistics;
+  CHECK(collected.size() == sizeof(certificate) && memcmp(collected.data(), certificate, sizeof(certificate)) == 0);
+
+  host::model.rfWriteUserMemory(address, saved.data(), saved.size());
+
+  printf("NDEF stream, %u-byte record: pull %u reads, %5u us, push %u reads, %5u us\n", (unsigned)sizeof(certificate),
+         pulled.readTransactions, (unsigned)pulled.readMicros, pushed.readTransactions, (unsigned)pushed.readMicros);
+}
+
+// EEPROM rows programmed by CONTRACT_ADDRESS: only the rows of the changed record, none for the same address again
+static void checkNDEFUpdate()
+{
+  const char *address = "0x8464135c8f25da09e49bc8782676a84730c318bc";
+  uint8_t request[1 + LUKSO_ADDRESS_AS_STRING_LENGTH] = {NFCTag::CONTRACT_ADDRESS};
+  memcpy(&request[1], address, LUKSO_ADDRESS_AS_STRING_LENGTH);
+
+  host::model.resetStatistics();
+  uint32_t erases = EEPROM.erases;
+  CHECK(exchange(request, sizeof(request)) && reply[0] == NFCTag::CONTRACT_ADDRESS);
+  uint32_t changedCycles = host::model.statistics.eepromProgramCycles;
+  // The µC eeprom page, which also holds the wallet keys, is erased once
+  CHECK(EEPROM.erases == erases + 1);
+
+  host::model.resetStatistics();
+  CHECK(exchange(request, sizeof(request)) && reply[0] == NFCTag::CONTRACT_ADDRESS);
+  uint32_t sameCycles = host::model.statistics.eepromProgramCycles;
+  CHECK(EEPROM.erases == erases + 1);
+
+  SFE_ST25DV64KC_NDEF st25;
+  CHECK(st25.begin(host::bus));
+#ifdef NDEF_EXTERNAL_TYPE_RECORDS
+  uint8_t contract[LUKSO_ADDRESS_LENGTH], expected[LUKSO_ADDRESS_LENGTH];
+  uint16_t length = sizeof(contract);
+  hex2bin(address + 2, expected);
+  CHECK(st25.readNDEFRecord(SFE_ST25DV_NDEF_TNF_EXTERNAL, (const uint8_t *)NDEF_EXTERNAL_TYPE_CONTRACT, strlen(NDEF_EXTERNAL_TYPE_CONTRACT), contract, &length));
+  CHECK(length == LUKSO_ADDRESS_LENGTH && memcmp(contract, expected, LUKSO_ADDRESS_LENGTH) == 0);
+#else
+  char contract[LUKSO_ADDRESS_AS_STRING_LENGTH + 1];
+  CHECK(st25.readNDEFText(contract, sizeof(contract), 2) && strcmp(contract, address) == 0);
+#endif
+  CHECK(changedCycles > 0 && changedCycles < 8 && sameCycles == 0);
+
+  printf("NDEF update, new contract address: %u rows programmed, same address again: %u\n", changedCycles, sameCycles);
+}
+
+static void benchmark(const char *name, const uint8_t *request, uint16_t requestLength, unsigned iterations)
+{
+  std::vector<uint32_t> latencies;
+  latencies.reserve(iterations);
+
+  host::model.resetStatistics();
+  uint32_t start = micros();
+  for (unsigned i = 0; i < iterations; i++)
+  {
+    uint32_t begin = micros();
+    if (!exchange(request, requestLength))
+    {
+      fprintf(stderr, "%s: exchange %u failed\n", name, i);
+      failures++;
+      return;
+    }
+    latencies.push_back(micros() - begin);
+  }
+  uint32_t total = micros() - start;
+
+  std::sort(latencies.begin(), latencies.end());
+  const ST25DV64KCModel::Statistics &bus = host::model.statistics;
+  printf("%-16s %8u %10.1f %10u %10u %10u %12.1f %12.1f\n", name, iterations, iterations * 1e6 / total,
+         latencies.front(), latencies[latencies.size() / 2], latencies.back(),
+         (double)bus.readMicros / iterations, (double)bus.writeMicros / iterations);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned iterations = argc > 1 ? (unsigned)atoi(argv[1]) : 200;
+  if (iterations == 0)
+    iterations = 1;
+
+  host::seedRandom(0x5eed);
+  if (!host::boot(wallet, nfcTag))
+  {
+    fprintf(stderr, "boot failed\n");
+    return 1;
+  }
+
+  const ST25DV64KCModel::Statistics &boot = host::model.statistics;
+  printf("Boot: %u I2C reads, %u I2C writes, %u register program cycles, %u us on the bus\n", boot.readTransactions,
+         boot.writeTransactions, boot.registerProgramCycles, (unsigned)(boot.readMicros + boot.writeMicros + boot.probeMicros));
+
+  checkAddressChecksum();
+  checkHello();
+  checkGetIdentity(false, nullptr);
+  checkSign();
+  checkClockGovernor();
+  checkIdleScheduler();
+  checkReplyTransfer();
+  checkContractAddress();
+  checkErrors();
+  checkDiagnostics();
+  checkJobScheduler();
+  checkNDEFComposer();
+  checkNDEFChunks();
+  checkNDEFStream();
+  compareNDEFRead();
+  checkNDEFUpdate();
+  compareMailboxReceive(1);
+  compareMailboxReceive(1 + KECCAK_HASH_LENGTH);
+  compareMailboxReceive(MAILBOX_LENGTH);
+  CHECK(host::bus.asyncTransfers > 0); // replies went through the asynchronous path
+#ifdef SFE_ST25DV64KC_DMA_BUS_AVAILABLE
+  checkDMABus();
+#endif
+
+  if (failures != 0)
+  {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("All checks passed.\n\n");
+
+  // Times include the modeled bus time at 100 kHz, the settle time before the mailbox is read is excluded
+  printf("%-16s %8s %10s %10s %10s %10s %12s %12s\n", "message", "count", "msg/s", "min us", "p50 us", "max us", "i2c rd us", "i2c wr us");
+  uint8_t hello[] = {NFCTag::HELLO};
+  benchmark("HELLO", hello, sizeof(hello), iterations);
+  uint8_t identity[] = {NFCTag::GET_IDENTITY};
+  benchmark("GET_IDENTITY", identity, sizeof(identity), iterations);
+  uint8_t sign[1 + KECCAK_HASH_LENGTH] = {NFCTag::SIGN};
+  for (uint8_t i = 0; i < KECCAK_HASH_LENGTH; i++)
+    sign[1 + i] = i;
+  benchmark("SIGN", sign, sizeof(sign), iterations);
+
+  const SFE_ST2525DV64KC_IO::BusyStatistics &busy = nfcTag.getBusyStatistics();
+  printf("\nEEPROM write cycles: %u, mean busy %u us, max busy %u us, %u polls, %u timeouts\n", busy.writeCycles,
+         busy.writeCycles ? busy.totalMicros / busy.writeCycles : 0, busy.maxMicros, busy.polls, busy.timeouts);
+
+  const SFE_ST25DV64KC::RegisterCacheStatistics &cache = nfcTag.getRegisterCacheStatistics();
+  printf("Register cache: %u hits, %u misses, %u skipped writes\n", cache.hits, cache.misses, cache.skippedWrites);
+
+  // Host time: the clock switch is recorded only, so the points differ on the target alone
+  for (uint8_t point = 0; point < ClockGovernor::OPERATING_POINT_COUNT; point++)
+  {
+    const ClockGovernor::Statistics &clock = governor.getStatistics((ClockGovernor::OperatingPoint)point);
+    if (clock.bursts > 0)
+      printf("Sign bursts at %2u MHz: %u, mean %u us, max %u us\n", ClockGovernor::operatingPoints[point].megahertz,
+             clock.bursts, clock.totalMicros / clock.bursts, clock.maxMicros);
+  }
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,492 @@
+// Synthetic load generator for the tap protocol.
+//
+// Replays a configurable mix of mailbox messages, malformed frames and retry storms against NFCTag::handleMessage
+// and reports p50/p95/p99/max latency per message type, split into stages:
+//   i2c_read   bus time of reads (mailbox status, length, payload, NDEF reads)
+//   i2c_write  bus time of writes (reply, NDEF updates, register writes)
+//   busy_wait  time spent waiting for the ST25DV to finish programming its eeprom (ACK polling, retry delays)
+//   compute    everything else, i.e. crypto and parsing on the µC (measured on the host CPU)
+//
+//   build/load_generator [--count N] [--seed S] [--mix sign=60,contract=5,hello=10,identity=15,malformed=10]
+//                        [--storm-rate PERMILLE] [--storm-length N] [--nack PERMILLE] [--bus-clock HZ]
+//                        [--csv FILE] [--json FILE]
+
+#include "HostHarness.h"
+#include "HostClock.h"
+#include "../arduino-code/NFCTag.h"
+#include <Wire.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+Wallet wallet;
+NFCTag nfcTag(wallet, &host::bus);
+
+enum Kind
+{
+  KIND_SIGN,
+  KIND_CONTRACT,
+  KIND_HELLO,
+  KIND_IDENTITY,
+  KIND_MALFORMED,
+  KIND_COUNT
+};
+
+static const char *kindNames[KIND_COUNT] = {"sign", "contract", "hello", "identity", "malformed"};
+
+enum Stage
+{
+  STAGE_TOTAL,
+  STAGE_I2C_READ,
+  STAGE_I2C_WRITE,
+  STAGE_BUSY_WAIT,
+  STAGE_COMPUTE,
+  STAGE_COUNT
+};
+
+static const char *stageNames[STAGE_COUNT] = {"total", "i2c_read", "i2c_write", "busy_wait", "compute"};
+
+struct Sample
+{
+  uint32_t micros[STAGE_COUNT];
+};
+
+struct Series
+{
+  std::vector<Sample> samples;
+  uint32_t exchanges;
+  uint32_t failedExchanges;  // mailbox refused the request or no reply came back
+  uint32_t unexpectedReplies; // reply id did not match what the request asks for
+  uint32_t retries;          // exchanges belonging to a retry storm
+};
+
+struct Options
+{
+  unsigned count = 1000;
+  uint32_t seed = 1;
+  unsigned mix[KIND_COUNT] = {60, 5, 10, 15, 10};
+  unsigned stormRate = 20; // per mille of requests that turn into a retry storm
+  unsigned stormLength = 5;
+  unsigned nack = 0;
+  uint32_t busClock = 100000;
+  const char *csv = nullptr;
+  const char *json = nullptr;
+};
+
+static uint32_t percentile(std::vector<uint32_t> &values, unsigned p)
+{
+  if (values.empty())
+    return 0;
+  size_t rank = (values.size() * p + 99) / 100;
+  return values[rank == 0 ? 0 : rank - 1];
+}
+
+static bool parseMix(const char *text, unsigned mix[KIND_COUNT])
+{
+  unsigned parsed[KIND_COUNT] = {};
+  std::string list(text);
+  size_t position = 0;
+  while (position < list.size())
+  {
+    size_t end = list.find(',', position);
+    if (end == std::string::npos)
+      end = list.size();
+    std::string item = list.substr(position, end - position);
+    size_t equals = item.find('=');
+    if (equals == std::string::npos)
+      return false;
+
+    std::string name = item.substr(0, equals);
+    int kind = -1;
+    for (int i = 0; i < KIND_COUNT; i++)
+    {
+      if (name == kindNames[i])
+        kind = i;
+    }
+    if (kind < 0)
+      return false;
+    parsed[kind] = (unsigned)atoi(item.c_str() + equals + 1);
+    position = end + 1;
+  }
+
+  unsigned total = 0;
+  for (int i = 0; i < KIND_COUNT; i++)
+    total += parsed[i];
+  if (total == 0)
+    return false;
+  memcpy(mix, parsed, sizeof(parsed));
+  return true;
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    const char *option = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (value == nullptr)
+      return false;
+    i++;
+
+    if (strcmp(option, "--count") == 0)
+      options.count = (unsigned)atoi(value);
+    else if (strcmp(option, "--seed") == 0)
+      options.seed = (uint32_t)strtoul(value, nullptr, 0);
+    else if (strcmp(option, "--mix") == 0)
+    {
+      if (!parseMix(value, options.mix))
+        return false;
+    }
+    else if (strcmp(option, "--storm-rate") == 0)
+      options.stormRate = (unsigned)atoi(value);
+    else if (strcmp(option, "--storm-length") == 0)
+      options.stormLength = (unsigned)atoi(value);
+    else if (strcmp(option, "--nack") == 0)
+      options.nack = (unsigned)atoi(value);
+    else if (strcmp(option, "--bus-clock") == 0)
+      options.busClock = (uint32_t)strtoul(value, nullptr, 0);
+    else if (strcmp(option, "--csv") == 0)
+      options.csv = value;
+    else if (strcmp(option, "--json") == 0)
+      options.json = value;
+    else
+      return false;
+  }
+  return options.count > 0 && options.busClock > 0;
+}
+
+static Kind pickKind(const Options &options)
+{
+  unsigned total = 0;
+  for (int i = 0; i < KIND_COUNT; i++)
+    total += options.mix[i];
+
+  unsigned pick = host::nextRandom() % total;
+  for (int i = 0; i < KIND_COUNT; i++)
+  {
+    if (pick < options.mix[i])
+      return (Kind)i;
+    pick -= options.mix[i];
+  }
+  return KIND_SIGN;
+}
+
+static void randomHex(char *target, unsigned length)
+{
+  static const char digits[] = "0123456789abcdefABCDEF";
+  for (unsigned i = 0; i < length; i++)
+    target[i] = digits[host::nextRandom() % (sizeof(digits) - 1)];
+}
+
+// Builds a request and the reply id it must produce
+static uint16_t buildRequest(Kind kind, uint8_t *request, uint8_t *expectedReply)
+{
+  switch (kind)
+  {
+  case KIND_SIGN:
+    request[0] = NFCTag::SIGN;
+    for (uint8_t i = 0; i < KECCAK_HASH_LENGTH; i++)
+      request[1 + i] = (uint8_t)host::nextRandom();
+    *expectedReply = NFCTag::SIGN;
+    return 1 + KECCAK_HASH_LENGTH;
+
+  case KIND_CONTRACT:
+    request[0] = NFCTag::CONTRACT_ADDRESS;
+    request[1] = '0';
+    request[2] = 'x';
+    randomHex((char *)&request[3], LUKSO_ADDRESS_AS_STRING_LENGTH - 2);
+    *expectedReply = NFCTag::CONTRACT_ADDRESS;
+    return 1 + LUKSO_ADDRESS_AS_STRING_LENGTH;
+
+  case KIND_HELLO:
+    request[0] = NFCTag::HELLO;
+    *expectedReply = NFCTag::HELLO;
+    return 1;
+
+  case KIND_IDENTITY:
+    request[0] = NFCTag::GET_IDENTITY;
+    *expectedReply = NFCTag::GET_IDENTITY;
+    return 1;
+
+  default:
+    break;
+  }
+
+  // Malformed: unknown id, truncated/oversized frame of a known id or a contract address with a bad prefix
+  switch (host::nextRandom() % 4)
+  {
+  case 0:
+  {
+    request[0] = NFCTag::MESSAGE_HANDLER_COUNT + host::nextRandom() % (NFCTag::INVALID_MESSAGE_FORMAT - NFCTag::MESSAGE_HANDLER_COUNT);
+    uint16_t length = 1 + host::nextRandom() % 64;
+    for (uint16_t i = 1; i < length; i++)
+      request[i] = (uint8_t)host::nextRandom();
+    *expectedReply = NFCTag::UNKOWN_MESSAGE;
+    return length;
+  }
+  case 1:
+  {
+    request[0] = NFCTag::SIGN;
+    uint16_t length = 1 + host::nextRandom() % KECCAK_HASH_LENGTH;
+    for (uint16_t i = 1; i < length; i++)
+      request[i] = (uint8_t)host::nextRandom();
+    *expectedReply = NFCTag::INVALID_MESSAGE_LENGTH;
+    return length;
+  }
+  case 2:
+  {
+    request[0] = host::nextRandom() % 2 ? NFCTag::HELLO : NFCTag::GET_IDENTITY;
+    uint16_t length = 2 + host::nextRandom() % (MAILBOX_LENGTH - 1);
+    memset(&request[1], 0, length - 1);
+    *expectedReply = NFCTag::INVALID_MESSAGE_LENGTH;
+    return length;
+  }
+  default:
+    request[0] = NFCTag::CONTRACT_ADDRESS;
+    request[1] = '1';
+    request[2] = 'x';
+    randomHex((char *)&request[3], LUKSO_ADDRESS_AS_STRING_LENGTH - 2);
+    *expectedReply = NFCTag::INVALID_MESSAGE_FORMAT;
+    return 1 + LUKSO_ADDRESS_AS_STRING_LENGTH;
+  }
+}
+
+static void run(Series &series, const uint8_t *request, uint16_t requestLength, uint8_t expectedReply, bool retry)
+{
+  static uint8_t reply[MAILBOX_LENGTH];
+  uint16_t replyLength = 0;
+
+  const ST25DV64KCModel::Statistics before = host::model.statistics;
+  uint64_t virtualBefore = hostClockVirtualMicros();
+  uint32_t start = micros();
+
+  bool success = host::exchange(nfcTag, request, requestLength, reply, &replyLength);
+
+  Sample sample;
+  sample.micros[STAGE_TOTAL] = micros() - start;
+  const ST25DV64KCModel::Statistics &after = host::model.statistics;
+  uint32_t virtualMicros = (uint32_t)(hostClockVirtualMicros() - virtualBefore);
+  sample.micros[STAGE_I2C_READ] = (uint32_t)(after.readMicros - before.readMicros);
+  sample.micros[STAGE_I2C_WRITE] = (uint32_t)(after.writeMicros - before.writeMicros);
+  uint32_t busMicros = sample.micros[STAGE_I2C_READ] + sample.micros[STAGE_I2C_WRITE];
+  sample.micros[STAGE_BUSY_WAIT] = virtualMicros > busMicros ? virtualMicros - busMicros : 0;
+  sample.micros[STAGE_COMPUTE] = sample.micros[STAGE_TOTAL] > virtualMicros ? sample.micros[STAGE_TOTAL] - virtualMicros : 0;
+
+  series.exchanges++;
+  if (retry)
+    series.retries++;
+  if (!success)
+  {
+    series.failedExchanges++;
+    return;
+  }
+  if (replyLength == 0 || reply[0] != expectedReply)
+    series.unexpectedReplies++;
+  series.samples.push_back(sample);
+}
+
+static void printHistogram(const char *name, std::vector<uint32_t> &totals)
+{
+  // Power of two buckets in microseconds
+  unsigned buckets[32] = {};
+  unsigned largest = 0;
+  for (uint32_t value : totals)
+  {
+    unsigned bucket = 0;
+    while (bucket < 31 && (1u << (bucket + 1)) <= value)
+      bucket++;
+    buckets[bucket]++;
+    largest = std::max(largest, buckets[bucket]);
+  }
+
+  printf("\n%s latency histogram\n", name);
+  for (unsigned bucket = 0; bucket < 32; bucket++)
+  {
+    if (buckets[bucket] == 0)
+      continue;
+    unsigned width = (unsigned)((uint64_t)buckets[bucket] * 50 / largest);
+    printf("  %8u - %8u us %7u %s\n", 1u << bucket, (1u << (bucket + 1)) - 1, buckets[bucket], std::string(width ? width : 1, '#').c_str());
+  }
+}
+
+struct Summary
+{
+  const char *name;
+  uint32_t exchanges;
+  uint32_t failedExchanges;
+  uint32_t unexpectedReplies;
+  uint32_t retries;
+  uint32_t p50[STAGE_COUNT];
+  uint32_t p95[STAGE_COUNT];
+  uint32_t p99[STAGE_COUNT];
+  uint32_t max[STAGE_COUNT];
+  double mean[STAGE_COUNT];
+};
+
+static Summary summarize(const char *name, Series &series)
+{
+  Summary summary = {};
+  summary.name = name;
+  summary.exchanges = series.exchanges;
+  summary.failedExchanges = series.failedExchanges;
+  summary.unexpectedReplies = series.unexpectedReplies;
+  summary.retries = series.retries;
+
+  std::vector<uint32_t> values;
+  for (int stage = 0; stage < STAGE_COUNT; stage++)
+  {
+    values.clear();
+    double sum = 0;
+    for (const Sample &sample : series.samples)
+    {
+      values.push_back(sample.micros[stage]);
+      sum += sample.micros[stage];
+    }
+    std::sort(values.begin(), values.end());
+    summary.p50[stage] = percentile(values, 50);
+    summary.p95[stage] = percentile(values, 95);
+    summary.p99[stage] = percentile(values, 99);
+    summary.max[stage] = values.empty() ? 0 : values.back();
+    summary.mean[stage] = values.empty() ? 0 : sum / values.size();
+  }
+  return summary;
+}
+
+static void writeCsv(const char *path, const std::vector<Summary> &summaries)
+{
+  FILE *file = fopen(path, "w");
+  if (file == nullptr)
+  {
+    perror(path);
+    return;
+  }
+
+  fprintf(file, "message,stage,exchanges,failed,unexpected,retries,mean_us,p50_us,p95_us,p99_us,max_us\n");
+  for (const Summary &summary : summaries)
+  {
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+      fprintf(file, "%s,%s,%u,%u,%u,%u,%.1f,%u,%u,%u,%u\n", summary.name, stageNames[stage], summary.exchanges, summary.failedExchanges,
+              summary.unexpectedReplies, summary.retries, summary.mean[stage], summary.p50[stage], summary.p95[stage], summary.p99[stage], summary.max[stage]);
+  }
+  fclose(file);
+}
+
+static void writeJson(const char *path, const Options &options, const std::vector<Summary> &summaries, double throughput)
+{
+  FILE *file = fopen(path, "w");
+  if (file == nullptr)
+  {
+    perror(path);
+    return;
+  }
+
+  fprintf(file, "{\n  \"count\": %u,\n  \"seed\": %u,\n  \"bus_clock_hz\": %u,\n  \"nack_per_mille\": %u,\n", options.count, options.seed, options.busClock, options.nack);
+  fprintf(file, "  \"storm_rate_per_mille\": %u,\n  \"storm_length\": %u,\n  \"throughput_per_s\": %.2f,\n  \"messages\": {\n", options.stormRate, options.stormLength, throughput);
+  for (size_t i = 0; i < summaries.size(); i++)
+  {
+    const Summary &summary = summaries[i];
+    fprintf(file, "    \"%s\": {\n      \"exchanges\": %u,\n      \"failed\": %u,\n      \"unexpected\": %u,\n      \"retries\": %u,\n      \"stages\": {\n",
+            summary.name, summary.exchanges, summary.failedExchanges, summary.unexpectedReplies, summary.retries);
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+      fprintf(file, "        \"%s\": {\"mean_us\": %.1f, \"p50_us\": %u, \"p95_us\": %u, \"p99_us\": %u, \"max_us\": %u}%s\n", stageNames[stage],
+              summary.mean[stage], summary.p50[stage], summary.p95[stage], summary.p99[stage], summary.max[stage], stage + 1 < STAGE_COUNT ? "," : "");
+    fprintf(file, "      }\n    }%s\n", i + 1 < summaries.size() ? "," : "");
+  }
+  fprintf(file, "  }\n}\n");
+  fclose(file);
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  if (!parseOptions(argc, argv, options))
+  {
+    fprintf(stderr, "usage: %s [--count N] [--seed S] [--mix sign=60,contract=5,hello=10,identity=15,malformed=10]\n"
+                    "          [--storm-rate PERMILLE] [--storm-length N] [--nack PERMILLE] [--bus-clock HZ] [--csv FILE] [--json FILE]\n",
+            argv[0]);
+    return 2;
+  }
+
+  host::seedRandom(options.seed);
+  if (!host::boot(wallet, nfcTag))
+  {
+    fprintf(stderr, "boot failed\n");
+    return 1;
+  }
+
+  Wire.setClock(options.busClock);
+  host::model.timing.nackProbabilityPerMille = options.nack;
+  host::model.resetStatistics();
+
+  Series series[KIND_COUNT] = {};
+  uint8_t request[MAILBOX_LENGTH];
+  uint32_t start = micros();
+  unsigned exchanges = 0;
+
+  for (unsigned i = 0; i < options.count; i++)
+  {
+    Kind kind = pickKind(options);
+    uint8_t expectedReply;
+    uint16_t requestLength = buildRequest(kind, request, &expectedReply);
+
+    run(series[kind], request, requestLength, expectedReply, false);
+    exchanges++;
+
+    // The phone missed the reply and resends the same frame back to back
+    if (host::nextRandom() % 1000 < options.stormRate)
+    {
+      for (unsigned retry = 0; retry < options.stormLength; retry++)
+      {
+        run(series[kind], request, requestLength, expectedReply, true);
+        exchanges++;
+      }
+    }
+  }
+  uint32_t elapsed = micros() - start;
+  double throughput = elapsed ? exchanges * 1e6 / elapsed : 0;
+
+  std::vector<Summary> summaries;
+  Series all = {};
+  for (int kind = 0; kind < KIND_COUNT; kind++)
+  {
+    if (series[kind].exchanges == 0)
+      continue;
+    summaries.push_back(summarize(kindNames[kind], series[kind]));
+    all.samples.insert(all.samples.end(), series[kind].samples.begin(), series[kind].samples.end());
+    all.exchanges += series[kind].exchanges;
+    all.failedExchanges += series[kind].failedExchanges;
+    all.unexpectedReplies += series[kind].unexpectedReplies;
+    all.retries += series[kind].retries;
+  }
+  summaries.push_back(summarize("all", all));
+
+  printf("%u exchanges in %.3f s (%.1f/s), bus %u Hz, %u injected NACKs, %u busy NACKs\n\n", exchanges, elapsed / 1e6, throughput,
+         options.busClock, host::model.statistics.injectedNacks, host::model.statistics.busyNacks);
+  printf("%-10s %-10s %8s %6s %6s %10s %8s %8s %8s %8s\n", "message", "stage", "count", "failed", "unexp", "mean us", "p50", "p95", "p99", "max");
+  for (const Summary &summary : summaries)
+  {
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+      printf("%-10s %-10s %8u %6u %6u %10.1f %8u %8u %8u %8u\n", stage == 0 ? summary.name : "", stageNames[stage], summary.exchanges,
+             summary.failedExchanges, summary.unexpectedReplies, summary.mean[stage], summary.p50[stage], summary.p95[stage], summary.p99[stage], summary.max[stage]);
+  }
+
+  for (int kind = 0; kind < KIND_COUNT; kind++)
+  {
+    if (series[kind].samples.empty())
+      continue;
+    std::vector<uint32_t> totals;
+    for (const Sample &sample : series[kind].samples)
+      totals.push_back(sample.micros[STAGE_TOTAL]);
+    printHistogram(kindNames[kind], totals);
+  }
+
+  if (options.csv != nullptr)
+    writeCsv(options.csv, summaries);
+  if (options.json != nullptr)
+    writeJson(options.json, options, summaries, throughput);
+
+  return all.unexpectedReplies == 0 ? 0 : 1;
+}
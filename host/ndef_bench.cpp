@@ -0,0 +1,388 @@
+// Round-trip checks and an encode/decode benchmark for the NDEF writers and readers against the ST25DV64KC model.
+//
+// Random messages are written with the record-by-record writers and with the composer, then read back through the
+// NDEF index and streamed from the EEPROM. Both writers have to lay out URI and Text records byte for byte alike.
+// The benchmark reports, per record, the I2C transactions and the payload throughput including modeled bus time.
+//
+//   build/ndef_bench [messages] [iterations]
+
+#include "HostHarness.h"
+#include "../arduino-code/SparkFun_ST25DV64KC_NDEF.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(condition)                                              \
+  do                                                                  \
+  {                                                                   \
+    if (!(condition))                                                 \
+    {                                                                 \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                     \
+    }                                                                 \
+  } while (0)
+
+static SFE_ST25DV64KC_NDEF st25;
+
+enum Kind
+{
+  KIND_URI,
+  KIND_TEXT,
+  KIND_WIFI,
+  KIND_EXTERNAL,
+  KIND_COUNT
+};
+
+struct TestRecord
+{
+  Kind kind;
+  uint8_t code;            // URI prefix code
+  std::string first;       // URI, text, SSID or external type
+  std::string second;      // language or password
+  std::vector<uint8_t> payload; // external payload
+};
+
+static uint32_t randomBelow(uint32_t limit)
+{
+  return host::nextRandom() % limit;
+}
+
+static std::string randomString(uint32_t minLength, uint32_t maxLength, bool printable)
+{
+  std::string s(minLength + randomBelow(maxLength - minLength + 1), ' ');
+  for (char &c : s)
+    c = printable ? (char)(' ' + 1 + randomBelow(94)) : (char)(1 + randomBelow(255)); // no NULLs
+  return s;
+}
+
+// kinds: bit mask of the Kinds to choose from
+static TestRecord randomRecord(uint8_t kinds)
+{
+  TestRecord record;
+  do
+    record.kind = (Kind)randomBelow(KIND_COUNT);
+  while (!(kinds & (1 << record.kind)));
+  switch (record.kind)
+  {
+    case KIND_URI:
+      record.code = randomBelow(SFE_ST25DV_NDEF_URI_ID_CODE_URN_NFC + 1);
+      record.first = randomString(0, 60, true);
+      break;
+    case KIND_TEXT:
+      record.first = randomString(0, randomBelow(4) == 0 ? 300 : 40, false); // some long records
+      record.second = randomString(0, 5, true);
+      break;
+    case KIND_WIFI:
+      record.first = randomString(1, 32, true);
+      record.second = randomString(1, 63, true);
+      break;
+    default:
+      record.first = "lukso.io:" + randomString(1, 30, true);
+      record.payload.resize(randomBelow(400));
+      for (uint8_t &b : record.payload)
+        b = (uint8_t)host::nextRandom();
+      break;
+  }
+  return record;
+}
+
+static void describe(const char *what, const std::vector<TestRecord> &records)
+{
+  static const char *kindNames[KIND_COUNT] = {"URI", "Text", "WiFi", "External"};
+  fprintf(stderr, "%s:", what);
+  for (const TestRecord &record : records)
+    fprintf(stderr, " %s(%u,%u,%u)", kindNames[record.kind], (unsigned)record.first.size(), (unsigned)record.second.size(), (unsigned)record.payload.size());
+  fprintf(stderr, "\n");
+}
+
+static bool writeLegacy(const std::vector<TestRecord> &records)
+{
+  uint16_t address = st25.getCCFileLen();
+  for (size_t i = 0; i < records.size(); i++)
+  {
+    const TestRecord &record = records[i];
+    bool MB = i == 0, ME = i == records.size() - 1;
+    bool ok = false;
+    if (record.kind == KIND_URI)
+      ok = st25.writeNDEFURI(record.first.c_str(), record.code, &address, MB, ME);
+    else if (record.kind == KIND_TEXT)
+      ok = st25.writeNDEFText((const uint8_t *)record.first.data(), record.first.size(), &address, MB, ME, record.second.c_str());
+    else if (record.kind == KIND_WIFI)
+      ok = st25.writeNDEFWiFi(record.first.c_str(), record.second.c_str(), &address, MB, ME);
+    if (!ok)
+      return false;
+  }
+  return true;
+}
+
+static bool compose(SFE_ST25DV64KC_NDEFComposer &composer, const std::vector<TestRecord> &records)
+{
+  composer.clear();
+  for (const TestRecord &record : records)
+  {
+    bool ok = false;
+    if (record.kind == KIND_URI)
+      ok = composer.addURI(record.first.c_str(), record.code);
+    else if (record.kind == KIND_TEXT)
+      ok = composer.addText((const uint8_t *)record.first.data(), record.first.size(), record.second.c_str());
+    else if (record.kind == KIND_EXTERNAL)
+      ok = composer.addExternal(record.first.c_str(), record.payload.data(), record.payload.size());
+    if (!ok)
+      return false;
+  }
+  return composer.finish();
+}
+
+// Every record is found again, by type and position among the records of its type
+static void checkRead(const std::vector<TestRecord> &records)
+{
+  uint8_t seen[KIND_COUNT] = {};
+  for (const TestRecord &record : records)
+  {
+    uint8_t recordNo = ++seen[record.kind];
+    if (record.kind == KIND_URI)
+    {
+      char uri[128];
+      std::string expected = std::string(st25.getURIPrefix(record.code)) + record.first;
+      CHECK(st25.readNDEFURI(uri, sizeof(uri), recordNo) && expected == uri);
+    }
+    else if (record.kind == KIND_TEXT)
+    {
+      uint8_t text[512];
+      uint16_t textLength = sizeof(text);
+      char language[8] = ""; // left alone when the record has none
+      CHECK(st25.readNDEFText(text, &textLength, recordNo, language, sizeof(language)));
+      CHECK(std::string((const char *)text, textLength) == record.first && record.second == language);
+    }
+    else if (record.kind == KIND_WIFI)
+    {
+      char ssid[64], passwd[128];
+      CHECK(st25.readNDEFWiFi(ssid, sizeof(ssid), passwd, sizeof(passwd), recordNo));
+      CHECK(record.first == ssid && record.second == passwd);
+    }
+    else
+    {
+      uint8_t payload[512];
+      uint16_t payloadLength = sizeof(payload);
+      uint8_t n = 0; // external types differ, count the ones with this type
+      for (const TestRecord &other : records)
+      {
+        if (&other == &record)
+          break;
+        n += (other.kind == KIND_EXTERNAL) && (other.first == record.first);
+      }
+      CHECK(st25.readNDEFRecord(SFE_ST25DV_NDEF_TNF_EXTERNAL, (const uint8_t *)record.first.data(), record.first.size(), payload, &payloadLength, n + 1));
+      CHECK(payloadLength == record.payload.size() && std::equal(record.payload.begin(), record.payload.end(), payload));
+    }
+  }
+
+  // One past the last of each type is not there
+  char uri[128];
+  CHECK(!st25.readNDEFURI(uri, sizeof(uri), seen[KIND_URI] + 1));
+  char text[512];
+  CHECK(!st25.readNDEFText(text, sizeof(text), seen[KIND_TEXT] + 1));
+}
+
+static void checkReadBothWays(const std::vector<TestRecord> &records)
+{
+  int before = failures;
+  st25.setNDEFIndexEnabled(true);
+  checkRead(records);
+  if (failures != before)
+    describe("indexed", records);
+  before = failures;
+  st25.setNDEFIndexEnabled(false);
+  checkRead(records);
+  if (failures != before)
+    describe("streamed", records);
+  st25.setNDEFIndexEnabled(true);
+}
+
+static std::vector<uint8_t> userMemory(uint16_t length)
+{
+  std::vector<uint8_t> data(length);
+  host::model.readUserMemory(st25.getCCFileLen(), data.data(), length);
+  return data;
+}
+
+static void roundTrip(unsigned messages)
+{
+  static uint8_t buffer[4096];
+  SFE_ST25DV64KC_NDEFComposer composer(buffer, sizeof(buffer));
+
+  unsigned records = 0, identical = 0, unchanged = 0;
+  for (unsigned m = 0; m < messages; m++)
+  {
+    std::vector<TestRecord> message(1 + randomBelow(6));
+
+    // Record by record: URI, Text and WiFi
+    for (TestRecord &record : message)
+      record = randomRecord((1 << KIND_URI) | (1 << KIND_TEXT) | (1 << KIND_WIFI));
+    CHECK(writeLegacy(message));
+    checkReadBothWays(message);
+
+    // Composed: URI, Text and External
+    for (TestRecord &record : message)
+      record = randomRecord((1 << KIND_URI) | (1 << KIND_TEXT) | (1 << KIND_EXTERNAL));
+    CHECK(compose(composer, message) && st25.writeNDEFMessage(composer));
+    checkReadBothWays(message);
+
+    // Written again, nothing changes. Also when compared against the message read back
+    if (composer.getLength() <= SFE_ST25DV64KC_NDEFIndex::CAPACITY)
+    {
+      SFE_ST25DV64KC_NDEF::NDEFWriteReport written;
+      CHECK(st25.writeNDEFMessage(composer, NULL, &written) && written.bytes == 0 && written.rowsWritten == 0);
+      st25.invalidateNDEFIndex();
+      CHECK(st25.isNDEFMessageWritten(composer));
+      unchanged++;
+    }
+
+    // Both writers agree on URI and Text records
+    for (TestRecord &record : message)
+      record = randomRecord((1 << KIND_URI) | (1 << KIND_TEXT));
+    CHECK(writeLegacy(message) && compose(composer, message));
+    std::vector<uint8_t> legacy = userMemory(composer.getLength());
+    std::vector<uint8_t> composed(composer.getMessage(), composer.getMessage() + composer.getLength());
+    if (legacy == composed)
+      identical++;
+    else
+      describe("the writers disagree", message);
+    CHECK(legacy == composed);
+
+    records += 3 * message.size();
+  }
+  printf("Round trip: %u messages, %u records, both writers identical in %u of %u, %u rewrites skipped\n", 3 * messages, records,
+         identical, messages, unchanged);
+}
+
+// The benchmark record: the payload changes with each iteration so every write programs the EEPROM
+static void fillRecord(TestRecord &record, unsigned iteration)
+{
+  if (record.kind == KIND_EXTERNAL)
+    record.payload[0] = (uint8_t)iteration;
+  else if (!record.first.empty())
+    record.first[0] = 'A' + iteration % 26;
+}
+
+static uint32_t payloadBytes(const TestRecord &record)
+{
+  return record.kind == KIND_EXTERNAL ? record.payload.size() : record.first.size() + record.second.size();
+}
+
+static void report(const char *operation, const char *name, const TestRecord &record, unsigned iterations, uint32_t micros)
+{
+  const ST25DV64KCModel::Statistics &bus = host::model.statistics;
+  printf("%-16s %-14s %8u %10.1f %10.1f %10.1f %12.0f\n", operation, name, payloadBytes(record),
+         (double)bus.readTransactions / iterations, (double)bus.writeTransactions / iterations, (double)micros / iterations,
+         (double)payloadBytes(record) * iterations * 1e6 / micros);
+}
+
+static void benchmark(const char *name, TestRecord record, unsigned iterations)
+{
+  static uint8_t buffer[1024];
+  SFE_ST25DV64KC_NDEFComposer composer(buffer, sizeof(buffer));
+  std::vector<TestRecord> message(1, record);
+
+  // Writes
+  if (record.kind != KIND_EXTERNAL)
+  {
+    host::model.resetStatistics();
+    uint32_t start = micros();
+    for (unsigned i = 0; i < iterations; i++)
+    {
+      fillRecord(message[0], i);
+      CHECK(writeLegacy(message));
+    }
+    report("write record", name, record, iterations, micros() - start);
+  }
+  if (record.kind != KIND_WIFI)
+  {
+    host::model.resetStatistics();
+    uint32_t start = micros();
+    for (unsigned i = 0; i < iterations; i++)
+    {
+      fillRecord(message[0], i + 1);
+      CHECK(compose(composer, message) && st25.writeNDEFMessage(composer));
+    }
+    report("write composed", name, record, iterations, micros() - start);
+  }
+
+  // Reads. Each one rebuilds the index, as after an RF write
+  uint8_t payload[1024];
+  for (int indexed = 1; indexed >= 0; indexed--)
+  {
+    st25.setNDEFIndexEnabled(indexed);
+    host::model.resetStatistics();
+    uint32_t start = micros();
+    for (unsigned i = 0; i < iterations; i++)
+    {
+      st25.invalidateNDEFIndex();
+      uint16_t length = sizeof(payload);
+      bool ok;
+      if (record.kind == KIND_URI)
+        ok = st25.readNDEFURI((char *)payload, sizeof(payload));
+      else if (record.kind == KIND_TEXT)
+        ok = st25.readNDEFText(payload, &length);
+      else if (record.kind == KIND_WIFI)
+        ok = st25.readNDEFWiFi((char *)payload, 64, (char *)payload + 64, 128);
+      else
+        ok = st25.readNDEFRecord(SFE_ST25DV_NDEF_TNF_EXTERNAL, (const uint8_t *)record.first.data(), record.first.size(), payload, &length);
+      CHECK(ok);
+    }
+    report(indexed ? "read indexed" : "read streamed", name, record, iterations, micros() - start);
+  }
+  st25.setNDEFIndexEnabled(true);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned messages = argc > 1 ? (unsigned)atoi(argv[1]) : 200;
+  unsigned iterations = argc > 2 ? (unsigned)atoi(argv[2]) : 50;
+  if (iterations == 0)
+    iterations = 1;
+
+  host::seedRandom(0x6e64);
+  if (!host::beginTag(st25))
+  {
+    fprintf(stderr, "begin failed\n");
+    return 1;
+  }
+
+  roundTrip(messages);
+
+  if (failures != 0)
+  {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("All checks passed.\n\n");
+
+  // Per record: I2C transactions, time including the modeled bus time at 100 kHz, payload bytes per second
+  printf("%-16s %-14s %8s %10s %10s %10s %12s\n", "operation", "record", "bytes", "i2c rd", "i2c wr", "us", "bytes/s");
+  TestRecord record;
+  record.kind = KIND_URI;
+  record.code = SFE_ST25DV_NDEF_URI_ID_CODE_HTTPS_WWW;
+  record.first = "phygital.tuszy.com/some/longer/path";
+  benchmark("URI", record, iterations);
+  record.kind = KIND_TEXT;
+  record.first = std::string(42, 'x');
+  record.second = "en";
+  benchmark("Text 42", record, iterations);
+  record.first = std::string(200, 'x');
+  benchmark("Text 200", record, iterations);
+  record.kind = KIND_WIFI;
+  record.first = "phygital";
+  record.second = "correct horse battery staple";
+  benchmark("WiFi", record, iterations);
+  record.kind = KIND_EXTERNAL;
+  record.first = "lukso.io:cert";
+  record.payload.assign(600, 0x5a);
+  benchmark("External 600", record, iterations);
+
+  return failures == 0 ? 0 : 1;
+}
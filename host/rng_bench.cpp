@@ -0,0 +1,332 @@
+// Checks of the entropy pool's health tests and of the Keccak DRBG, the throughput of each way to get random bytes
+// and a comparison of the time signing spends waiting for the RNG.
+//
+// The RNG is modeled as a word source that costs RNG_WORD_MICROS of virtual time per 32-bit word, about what the
+// STM32L4 RNG needs on the 8 MHz MSI clock. The per-word path is trueRandomNumberGenerator() as it was before the
+// pool: one blocking RNG read per 4 bytes. With the pool, the RNG interrupt fills it between signatures. The DRBG
+// runs at the speed of this machine, not of the STM32, so compare its permutations rather than its time.
+//
+//   build/rng_bench [signatures]
+
+#include "HostHarness.h"
+#include "HostClock.h"
+#include "../arduino-code/EntropyPool.h"
+#include "../arduino-code/KeccakDRBG.h"
+#include "../arduino-code/crypto-util.h"
+#include "../arduino-code/uECC.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(condition)                                              \
+  do                                                                  \
+  {                                                                   \
+    if (!(condition))                                                 \
+    {                                                                 \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                     \
+    }                                                                 \
+  } while (0)
+
+static const uint32_t RNG_WORD_MICROS = 6;
+
+// The modeled RNG: what it delivers and how many words it has been asked for
+static uint32_t (*rngSource)() = &host::nextRandom;
+static uint32_t rngWords = 0;
+
+static uint32_t rngWord()
+{
+  rngWords++;
+  hostClockAdvance(RNG_WORD_MICROS);
+  return rngSource();
+}
+
+static bool waitForSample();
+static EntropyPool pool(&waitForSample);
+
+static bool waitForSample()
+{
+  pool.addSample(rngWord());
+  return true;
+}
+
+// The RNG interrupt while the firmware is idle
+static void fillPool()
+{
+  while (!pool.isFull() && pool.addSample(rngWord()))
+    ;
+}
+
+static int perWordRNG(uint8_t *dest, unsigned size)
+{
+  for (unsigned i = 0; i < size; i += 4)
+  {
+    uint32_t word = rngWord();
+    for (uint8_t j = 0; j < 4 && i + j < size; j++)
+      dest[i + j] = (uint8_t)(word >> (j * 8));
+  }
+  return 1;
+}
+
+static int pooledRNG(uint8_t *dest, unsigned size)
+{
+  return pool.read(dest, size) ? 1 : 0;
+}
+
+static bool readPool(uint8_t *dest, unsigned size)
+{
+  return pool.read(dest, size);
+}
+
+static KeccakDRBG drbg(&readPool);
+
+static int drbgRNG(uint8_t *dest, unsigned size)
+{
+  return drbg.generate(dest, size) ? 1 : 0;
+}
+
+static uint32_t sequenceState = 1;
+
+static uint32_t sequenceWord()
+{
+  sequenceState ^= sequenceState << 13;
+  sequenceState ^= sequenceState >> 17;
+  sequenceState ^= sequenceState << 5;
+  return sequenceState;
+}
+
+static uint32_t stuckWord()
+{
+  return 0;
+}
+
+static uint32_t repeatingWord()
+{
+  return 0x12345678; // no byte repeats right away, but every window is a quarter the same value
+}
+
+static void checkHealthTests()
+{
+  // A good source never trips the tests, and the pool hands out its bytes in order, from where the startup
+  // tests stopped
+  sequenceState = 1;
+  rngSource = &sequenceWord;
+  pool.reset();
+  uint32_t words = rngWords;
+  fillPool();
+  CHECK(rngWords - words == EntropyPool::STARTUP_SAMPLES / 4 + EntropyPool::CAPACITY / 4);
+  CHECK(pool.isFull() && pool.available() == EntropyPool::CAPACITY);
+
+  uint32_t state = sequenceState;
+  sequenceState = 1;
+  for (uint16_t i = 0; i < EntropyPool::STARTUP_SAMPLES / 4; i++)
+    sequenceWord();
+  std::vector<uint8_t> expected(1 << 16), actual(1 << 16);
+  for (size_t i = 0; i < expected.size(); i += 4)
+  {
+    uint32_t word = sequenceWord();
+    memcpy(&expected[i], &word, 4);
+  }
+  sequenceState = state;
+  for (size_t offset = 0; offset < actual.size();)
+  {
+    size_t length = 1 + rand() % 100;
+    if (length > actual.size() - offset)
+      length = actual.size() - offset;
+    CHECK(pool.read(&actual[offset], length));
+    offset += length;
+    if (rand() % 4 == 0)
+      fillPool();
+  }
+  CHECK(actual == expected);
+  CHECK(!pool.hasFailed() && pool.getRepetitionFailures() == 0 && pool.getProportionFailures() == 0);
+
+  // A stuck source fails the repetition count test within the startup tests and nothing is handed out
+  uint8_t buffer[32];
+  rngSource = &stuckWord;
+  pool.reset();
+  fillPool();
+  CHECK(pool.hasFailed() && pool.available() == 0 && pool.getRepetitionFailures() == 1);
+  CHECK(!pool.read(buffer, sizeof(buffer)));
+
+  // Failing while running: what was stored is not handed out any more
+  rngSource = &host::nextRandom;
+  pool.reset();
+  fillPool();
+  rngSource = &repeatingWord;
+  while (!pool.hasFailed())
+  {
+    CHECK(pool.read(buffer, 4));
+    pool.addSample(rngWord());
+  }
+  CHECK(pool.getProportionFailures() == 1 && pool.getRepetitionFailures() == 1); // the counts add up across resets
+  CHECK(!pool.read(buffer, sizeof(buffer)));
+
+  // Recovers after a reset
+  rngSource = &host::nextRandom;
+  pool.reset();
+  CHECK(pool.read(buffer, sizeof(buffer)) && !pool.hasFailed());
+}
+
+static uint32_t entropyCalls = 0;
+static bool entropyFails = false;
+
+// Counts up from 0, so two DRBGs seeded from it start alike
+static bool countingEntropy(uint8_t *dest, unsigned size)
+{
+  if (entropyFails)
+    return false;
+  for (unsigned i = 0; i < size; i++)
+    dest[i] = (uint8_t)(entropyCalls * size + i);
+  entropyCalls++;
+  return true;
+}
+
+static void checkDRBG()
+{
+  // The raw digest is the hex one
+  Keccak keccak(Keccak::Keccak512);
+  uint8_t digest[64], fromHex[64];
+  keccak.add("abc", 3);
+  keccak.getHash(digest);
+  hex2bin(keccak("abc", 3).c_str(), fromHex);
+  CHECK(memcmp(digest, fromHex, sizeof(digest)) == 0);
+
+  // Deterministic for the same entropy, and no block repeats
+  entropyCalls = 0;
+  KeccakDRBG first(&countingEntropy);
+  std::vector<uint8_t> a(3 * KeccakDRBG::RESEED_INTERVAL), b(a.size());
+  for (size_t offset = 0; offset < a.size(); offset += 32)
+    CHECK(first.generate(&a[offset], 32));
+  CHECK(first.getReseedCount() == 3 && entropyCalls == 3);
+  entropyCalls = 0;
+  KeccakDRBG second(&countingEntropy);
+  for (size_t offset = 0; offset < b.size(); offset += 32)
+    CHECK(second.generate(&b[offset], 32));
+  CHECK(a == b);
+  for (size_t offset = 32; offset < a.size(); offset += 32)
+    CHECK(memcmp(&a[offset - 32], &a[offset], 32) != 0);
+
+  // After wipe() the output depends on the new entropy only: two generators that went different ways agree again
+  entropyCalls = 100;
+  first.wipe();
+  CHECK(!first.isSeeded());
+  CHECK(first.generate(&a[0], 64));
+  entropyCalls = 100;
+  second.wipe();
+  CHECK(second.generate(&b[0], 64));
+  CHECK(memcmp(&a[0], &b[0], 64) == 0);
+
+  // No entropy, no output once a reseed is due
+  entropyFails = true;
+  first.wipe();
+  CHECK(!first.generate(&a[0], 32));
+  entropyFails = false;
+  CHECK(first.generate(&a[0], 32));
+}
+
+// Bytes per second of modeled time (the RNG) plus host time (copies, Keccak)
+static double throughput(uECC_RNG_Function rng, unsigned requestSize, uint32_t bytes, bool refill)
+{
+  std::vector<uint8_t> buffer(requestSize);
+  uint64_t elapsed = 0;
+  for (uint32_t done = 0; done < bytes; done += requestSize)
+  {
+    if (refill && !pool.isFull())
+      fillPool();
+    uint32_t start = micros();
+    CHECK(rng(buffer.data(), requestSize) == 1);
+    elapsed += (uint32_t)(micros() - start);
+  }
+  return elapsed > 0 ? (double)bytes * 1e6 / elapsed : 0;
+}
+
+struct SignResult
+{
+  double words;
+  double waits;
+  double rngMicros;
+  double micros;
+  double permutations;
+};
+
+static SignResult benchmarkSign(uECC_RNG_Function rng, bool refill, uint32_t signatures)
+{
+  uint8_t privateKey[uECC_BYTES], publicKey[uECC_BYTES * 2], hash[uECC_BYTES], signature[uECC_BYTES * 2 + 1];
+  uECC_set_rng(&perWordRNG);
+  uECC_make_key(publicKey, privateKey);
+
+  uECC_set_rng(rng);
+  rngSource = &host::nextRandom;
+  pool.reset();
+  fillPool();
+  drbg.wipe();
+  uint32_t waits = pool.getWaits();
+  uint32_t permutations = drbg.getPermutations();
+  uint64_t rngMicros = 0;
+  uint32_t words = 0;
+  uint64_t elapsed = 0;
+  bool verified = true;
+  for (uint32_t i = 0; i < signatures; i++)
+  {
+    for (uint8_t j = 0; j < uECC_BYTES; j++)
+      hash[j] = (uint8_t)host::nextRandom();
+    if (refill)
+      fillPool(); // between signatures, the RNG interrupt has time to fill the pool
+
+    uint32_t start = micros();
+    uint32_t wordsBefore = rngWords;
+    verified &= uECC_sign(privateKey, hash, signature, 0) == 1;
+    elapsed += (uint32_t)(micros() - start);
+    words += rngWords - wordsBefore;
+    rngMicros += (uint64_t)(rngWords - wordsBefore) * RNG_WORD_MICROS;
+
+    verified &= uECC_verify(publicKey, hash, signature) == 1;
+  }
+  CHECK(verified);
+
+  SignResult result;
+  result.words = (double)words / signatures;
+  result.waits = (double)(pool.getWaits() - waits) / signatures;
+  result.rngMicros = (double)rngMicros / signatures;
+  result.micros = (double)elapsed / signatures;
+  result.permutations = (double)(drbg.getPermutations() - permutations) / signatures;
+  return result;
+}
+
+static void printResult(const char *name, const SignResult &result)
+{
+  printf("%-22s %10.1f %10.1f %10.1f %12.1f %12.1f\n", name, result.words, result.waits, result.rngMicros, result.permutations, result.micros);
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t signatures = argc > 1 ? atoi(argv[1]) : 50;
+
+  checkHealthTests();
+  checkDRBG();
+  if (failures > 0)
+  {
+    printf("%d checks failed.\n", failures);
+    return 1;
+  }
+  printf("All checks passed.\n\n");
+
+  const uint32_t bytes = 1 << 16;
+  printf("%-22s %14s %14s\n", "source", "32 B requests", "4 KB requests");
+  printf("%-22s %14.0f %14.0f\n", "per word", throughput(&perWordRNG, 32, bytes, false), throughput(&perWordRNG, 4096, bytes, false));
+  printf("%-22s %14.0f %14s\n", "pool, refilled", throughput(&pooledRNG, 32, bytes, true), "-");
+  printf("%-22s %14.0f %14.0f\n", "Keccak DRBG", throughput(&drbgRNG, 32, bytes, true), throughput(&drbgRNG, 4096, bytes, true));
+  printf("bytes/s; a 4 KB request does not fit the pool\n\n");
+
+  printf("%-22s %10s %10s %10s %12s %12s\n", "RNG path", "rng words", "waits", "rng us", "keccak-f", "us/sign");
+  printResult("per word", benchmarkSign(&perWordRNG, false, signatures));
+  printResult("pool, refilled", benchmarkSign(&pooledRNG, true, signatures));
+  printResult("pool, back to back", benchmarkSign(&pooledRNG, false, signatures));
+  printResult("DRBG, back to back", benchmarkSign(&drbgRNG, false, signatures));
+  printf("\nper signature: RNG reads and modeled RNG time inside uECC_sign, Keccak-f[1600] permutations of the DRBG\n");
+  return failures > 0 ? 1 : 0;
+}